@@ -0,0 +1,152 @@
+/*
+ * Remote-port loopback peer.
+ *
+ * Copyright (c) 2020 Xilinx Inc.
+ *
+ * This code is licensed under the GNU GPL.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/units.h"
+#include "qemu/cutils.h"
+#include "qemu/sockets.h"
+#include "qapi/error.h"
+
+#include "rp-peer.h"
+
+static void usage(const char *name, int status)
+{
+    printf("Usage: %s [OPTIONS] (-u <socket> | -s <shm-file>)\n"
+           "\n"
+           "Stand-in remote-port peer. Answers bus accesses from a memory\n"
+           "model and acknowledges syncs and interrupts.\n"
+           "\n"
+           "  -u <socket>   unix socket of the remote-port adaptor, e.g\n"
+           "                <machine-path>/qemu-rport-_machine_cosim.\n"
+           "                Connects, or listens if nobody is there yet\n"
+           "  -s <file>     shared-memory ring created by an adaptor with\n"
+           "                shm=on\n"
+           "  -b <addr>     bus address of the memory model (default 0)\n"
+           "  -m <size>     size of the memory model (default 256M)\n"
+           "  -p <n>        busy-poll iterations on the shm ring\n"
+           "  -v            verbose\n"
+           "  -h            this help\n",
+           name);
+    exit(status);
+}
+
+static int rp_peer_connect(const char *path)
+{
+    Error *err = NULL;
+    int listen_fd;
+    int fd;
+
+    fd = unix_connect(path, NULL);
+    if (fd >= 0) {
+        return fd;
+    }
+
+    /* The adaptor is going to connect to us.  */
+    listen_fd = unix_listen(path, &err);
+    if (listen_fd < 0) {
+        error_report_err(err);
+        return -1;
+    }
+
+    do {
+        fd = qemu_accept(listen_fd, NULL, NULL);
+    } while (fd < 0 && errno == EINTR);
+    close(listen_fd);
+    unlink(path);
+    return fd;
+}
+
+int main(int argc, char **argv)
+{
+    const char *socket_path = NULL;
+    const char *shm_path = NULL;
+    RemotePortShm *shm = NULL;
+    uint64_t mem_base = 0;
+    uint64_t mem_size = 256 * MiB;
+    uint64_t poll = 0;
+    bool verbose = false;
+    Error *err = NULL;
+    RPPeer p;
+    int fd = -1;
+    int c;
+
+    while ((c = getopt(argc, argv, "u:s:b:m:p:vh")) != -1) {
+        switch (c) {
+        case 'u':
+            socket_path = optarg;
+            break;
+        case 's':
+            shm_path = optarg;
+            break;
+        case 'b':
+            if (qemu_strtou64(optarg, NULL, 0, &mem_base) < 0) {
+                usage(argv[0], EXIT_FAILURE);
+            }
+            break;
+        case 'm':
+            if (qemu_strtosz(optarg, NULL, &mem_size) < 0) {
+                usage(argv[0], EXIT_FAILURE);
+            }
+            break;
+        case 'p':
+            if (qemu_strtou64(optarg, NULL, 0, &poll) < 0
+                || poll > UINT32_MAX) {
+                usage(argv[0], EXIT_FAILURE);
+            }
+            break;
+        case 'v':
+            verbose = true;
+            break;
+        case 'h':
+            usage(argv[0], EXIT_SUCCESS);
+            break;
+        default:
+            usage(argv[0], EXIT_FAILURE);
+            break;
+        }
+    }
+
+    if (!socket_path == !shm_path) {
+        usage(argv[0], EXIT_FAILURE);
+    }
+
+    if (shm_path) {
+        shm = rp_shm_attach(shm_path, poll, &err);
+        if (!shm) {
+            error_report_err(err);
+            return EXIT_FAILURE;
+        }
+    } else {
+        fd = rp_peer_connect(socket_path);
+        if (fd < 0) {
+            fprintf(stderr, "Unable to connect to %s\n", socket_path);
+            return EXIT_FAILURE;
+        }
+    }
+
+    rp_peer_init(&p, fd, shm, mem_base, mem_size);
+    p.verbose = verbose;
+
+    rp_peer_say_hello(&p);
+    while (rp_peer_serve_one(&p)) {
+        /* Serve until the adaptor goes away.  */
+    }
+
+    printf("reads=%" PRIu64 " writes=%" PRIu64 " batches=%" PRIu64
+           " interrupts=%" PRIu64 " syncs=%" PRIu64 " errors=%" PRIu64 "\n",
+           p.stats.reads, p.stats.writes, p.stats.batches,
+           p.stats.interrupts, p.stats.syncs, p.stats.errors);
+
+    rp_peer_cleanup(&p);
+    if (shm) {
+        rp_shm_close(shm);
+    } else {
+        close(fd);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,341 @@
+/*
+ * Remote-port loopback peer.
+ *
+ * Copyright (c) 2020 Xilinx Inc.
+ *
+ * This code is licensed under the GNU GPL.
+ */
+
+#include "qemu/osdep.h"
+
+#include "rp-peer.h"
+
+void rp_peer_init(RPPeer *p, int fd, RemotePortShm *shm,
+                  uint64_t mem_base, uint64_t mem_size)
+{
+    memset(p, 0, sizeof *p);
+    p->fd = fd;
+    p->shm = shm;
+    p->mem_base = mem_base;
+    p->mem_size = mem_size;
+    if (mem_size) {
+        p->mem = g_malloc0(mem_size);
+    }
+
+    /* Make sure we have a decent bufsize to start with.  */
+    rp_dpkt_alloc(&p->pkt, sizeof p->pkt.pkt->busaccess_ext_base + 4096);
+    rp_dpkt_alloc(&p->rsp, sizeof p->rsp.pkt->busaccess_ext_base + 4096);
+}
+
+void rp_peer_cleanup(RPPeer *p)
+{
+    rp_dpkt_free(&p->pkt);
+    rp_dpkt_free(&p->rsp);
+    g_free(p->mem);
+    p->mem = NULL;
+}
+
+static bool rp_peer_read(RPPeer *p, void *buf, size_t count)
+{
+    uint8_t *b = buf;
+    size_t done = 0;
+
+    if (p->shm) {
+        return rp_shm_read(p->shm, buf, count) == count;
+    }
+
+    while (done < count) {
+        ssize_t r = read(p->fd, b + done, count - done);
+
+        if (r < 0 && errno == EINTR) {
+            continue;
+        }
+        if (r <= 0) {
+            return false;
+        }
+        done += r;
+    }
+    return true;
+}
+
+void rp_peer_writev(RPPeer *p, const struct iovec *iov, int iovcnt)
+{
+    int i;
+
+    if (p->shm) {
+        rp_shm_writev(p->shm, iov, iovcnt);
+        return;
+    }
+
+    for (i = 0; i < iovcnt; i++) {
+        if (iov[i].iov_len) {
+            qemu_write_full(p->fd, iov[i].iov_base, iov[i].iov_len);
+        }
+    }
+}
+
+void rp_peer_write(RPPeer *p, const void *buf, size_t count)
+{
+    struct iovec iov = { .iov_base = (void *) buf, .iov_len = count };
+
+    rp_peer_writev(p, &iov, 1);
+}
+
+bool rp_peer_recv(RPPeer *p, RemotePortDynPkt *dpkt)
+{
+    struct rp_pkt *pkt = dpkt->pkt;
+
+    if (!rp_peer_read(p, &pkt->hdr, sizeof pkt->hdr)) {
+        return false;
+    }
+    rp_decode_hdr(pkt);
+
+    if (pkt->hdr.len) {
+        rp_dpkt_alloc(dpkt, sizeof pkt->hdr + pkt->hdr.len);
+        /* pkt may move due to realloc.  */
+        pkt = dpkt->pkt;
+        if (!rp_peer_read(p, &pkt->hdr + 1, pkt->hdr.len)) {
+            return false;
+        }
+        rp_decode_payload(pkt);
+    }
+    return true;
+}
+
+void rp_peer_say_hello(RPPeer *p)
+{
+    struct rp_pkt_hello pkt;
+    uint32_t caps[] = {
+        CAP_BUSACCESS_EXT_BASE,
+        CAP_WIRE_POSTED_UPDATES,
+        CAP_BUSACCESS_BATCH,
+    };
+    struct iovec iov[] = {
+        { .iov_base = &pkt },
+        { .iov_base = caps, .iov_len = sizeof caps },
+    };
+
+    iov[0].iov_len = rp_encode_hello_caps(p->id++, 0, &pkt,
+                                          RP_VERSION_MAJOR, RP_VERSION_MINOR,
+                                          caps, caps, ARRAY_SIZE(caps));
+    rp_peer_writev(p, iov, ARRAY_SIZE(iov));
+}
+
+bool rp_peer_process_hello(RPPeer *p, struct rp_pkt *pkt)
+{
+    if (pkt->hello.version.major != RP_VERSION_MAJOR) {
+        fprintf(stderr, "remote-port version missmatch remote=%d.%d "
+                "local=%d.%d\n",
+                pkt->hello.version.major, pkt->hello.version.minor,
+                RP_VERSION_MAJOR, RP_VERSION_MINOR);
+        return false;
+    }
+
+    p->state.version = pkt->hello.version;
+    if (pkt->hello.caps.len && !p->hello_seen) {
+        void *caps = (char *) pkt + pkt->hello.caps.offset;
+
+        rp_process_caps(&p->state, caps, pkt->hello.caps.len);
+    }
+    p->hello_seen = true;
+    return true;
+}
+
+/* Find the backing store for an access, or NULL if it is out of range.  */
+static uint8_t *rp_peer_mem(RPPeer *p, uint64_t addr, uint32_t len)
+{
+    uint64_t offset = addr - p->mem_base;
+
+    if (addr < p->mem_base || offset > p->mem_size
+        || len > p->mem_size - offset) {
+        p->stats.errors++;
+        if (p->verbose) {
+            fprintf(stderr, "access outside of memory %" PRIx64 "/%u\n",
+                    addr, len);
+        }
+        return NULL;
+    }
+    return p->mem + offset;
+}
+
+static void rp_peer_busaccess(RPPeer *p, struct rp_pkt *pkt)
+{
+    struct rp_encode_busaccess_in in;
+    bool write = pkt->hdr.cmd == RP_CMD_write;
+    uint32_t len = pkt->busaccess.len;
+    size_t pktlen = sizeof(struct rp_pkt_busaccess_ext_base);
+    uint8_t *mem = rp_peer_mem(p, pkt->busaccess.addr, len);
+    uint8_t *data;
+    size_t enclen;
+
+    if (!write) {
+        pktlen += len;
+    }
+    rp_dpkt_alloc(&p->rsp, pktlen);
+
+    if (write) {
+        data = rp_busaccess_rx_dataptr(&p->state, &pkt->busaccess_ext_base);
+        if (mem) {
+            memcpy(mem, data, len);
+        }
+        p->stats.writes++;
+    } else {
+        data = rp_busaccess_tx_dataptr(&p->state,
+                                       &p->rsp.pkt->busaccess_ext_base);
+        if (mem) {
+            memcpy(data, mem, len);
+        } else {
+            memset(data, 0, len);
+        }
+        p->stats.reads++;
+    }
+
+    rp_encode_busaccess_in_rsp_init(&in, pkt);
+    in.clk = pkt->busaccess.timestamp;
+    if (!mem) {
+        in.attr |= RP_RESP_ADDR_ERROR << RP_BUS_RESP_SHIFT;
+    }
+    enclen = rp_encode_busaccess(&p->state, &p->rsp.pkt->busaccess_ext_base,
+                                 &in);
+    rp_peer_write(p, p->rsp.pkt, enclen);
+}
+
+static void rp_peer_batch(RPPeer *p, struct rp_pkt *pkt)
+{
+    struct rp_pkt_batch *batch = &pkt->batch;
+    struct rp_batch_entry *entry = rp_batch_entries(batch);
+    struct rp_batch_entry *rsp_entry;
+    uint8_t *wdata = rp_batch_dataptr(batch);
+    uint8_t *rdata;
+    uint64_t rlen = 0;
+    size_t rsplen;
+    unsigned int status = RP_RESP_OK;
+    uint32_t i;
+
+    for (i = 0; i < batch->nr_entries; i++) {
+        if (!(entry[i].flags & RP_BATCH_ENTRY_WRITE)) {
+            rlen += entry[i].len;
+        }
+    }
+    rsplen = sizeof(struct rp_pkt_batch)
+             + (uint64_t) batch->nr_entries * sizeof *entry + rlen;
+    assert(rsplen <= UINT32_MAX);
+
+    /* The echoed entries go right after the header, then the read data.  */
+    rp_dpkt_alloc(&p->rsp, rsplen);
+    rsp_entry = (void *) ((uint8_t *) p->rsp.pkt + sizeof(struct rp_pkt_batch));
+    rdata = (uint8_t *) (rsp_entry + batch->nr_entries);
+
+    for (i = 0; i < batch->nr_entries; i++) {
+        uint8_t *mem = rp_peer_mem(p, entry[i].addr, entry[i].len);
+        unsigned int resp = mem ? RP_RESP_OK : RP_RESP_ADDR_ERROR;
+
+        if (entry[i].flags & RP_BATCH_ENTRY_WRITE) {
+            if (mem) {
+                memcpy(mem, wdata, entry[i].len);
+            }
+            wdata += entry[i].len;
+        } else {
+            if (mem) {
+                memcpy(rdata, mem, entry[i].len);
+            } else {
+                memset(rdata, 0, entry[i].len);
+            }
+            rdata += entry[i].len;
+        }
+        if (status == RP_RESP_OK) {
+            status = resp;
+        }
+        rp_encode_batch_entry(&rsp_entry[i], entry[i].addr, entry[i].len,
+                              (entry[i].flags & ~RP_BATCH_ENTRY_RESP_MASK)
+                              | (resp << RP_BATCH_ENTRY_RESP_SHIFT));
+    }
+    p->stats.batches++;
+
+    if (pkt->hdr.flags & RP_PKT_FLAGS_posted) {
+        return;
+    }
+
+    rp_encode_batch(pkt->hdr.id, pkt->hdr.dev, &p->rsp.pkt->batch,
+                    batch->timestamp, batch->master_id,
+                    (batch->attributes & ~RP_BUS_RESP_MASK)
+                    | (status << RP_BUS_RESP_SHIFT),
+                    batch->nr_entries, rlen,
+                    pkt->hdr.flags | RP_PKT_FLAGS_response);
+    rp_peer_write(p, p->rsp.pkt, rsplen);
+}
+
+static void rp_peer_interrupt(RPPeer *p, struct rp_pkt *pkt)
+{
+    struct rp_pkt_interrupt rsp;
+    size_t enclen;
+
+    if (p->verbose) {
+        printf("dev %u: line %u = %u\n", pkt->hdr.dev,
+               pkt->interrupt.line, pkt->interrupt.val);
+    }
+    p->stats.interrupts++;
+
+    if (pkt->hdr.flags & RP_PKT_FLAGS_posted) {
+        return;
+    }
+
+    enclen = rp_encode_interrupt_f(pkt->hdr.id, pkt->hdr.dev, &rsp,
+                                   pkt->interrupt.timestamp,
+                                   pkt->interrupt.line,
+                                   pkt->interrupt.vector,
+                                   pkt->interrupt.val,
+                                   pkt->hdr.flags | RP_PKT_FLAGS_response);
+    rp_peer_write(p, &rsp, enclen);
+}
+
+static void rp_peer_sync(RPPeer *p, struct rp_pkt *pkt)
+{
+    struct rp_pkt_sync rsp;
+    size_t enclen;
+
+    /* We have no notion of time, we are always in sync.  */
+    enclen = rp_encode_sync_resp(pkt->hdr.id, pkt->hdr.dev, &rsp,
+                                 pkt->sync.timestamp);
+    rp_peer_write(p, &rsp, enclen);
+    p->stats.syncs++;
+}
+
+bool rp_peer_serve_one(RPPeer *p)
+{
+    struct rp_pkt *pkt;
+
+    if (!rp_peer_recv(p, &p->pkt)) {
+        return false;
+    }
+    pkt = p->pkt.pkt;
+
+    if (pkt->hdr.flags & RP_PKT_FLAGS_response) {
+        /* We never issue requests that expect a response.  */
+        return true;
+    }
+
+    switch (pkt->hdr.cmd) {
+    case RP_CMD_hello:
+        return rp_peer_process_hello(p, pkt);
+    case RP_CMD_read:
+    case RP_CMD_write:
+        rp_peer_busaccess(p, pkt);
+        break;
+    case RP_CMD_batch:
+        rp_peer_batch(p, pkt);
+        break;
+    case RP_CMD_interrupt:
+        rp_peer_interrupt(p, pkt);
+        break;
+    case RP_CMD_sync:
+        rp_peer_sync(p, pkt);
+        break;
+    default:
+        if (p->verbose) {
+            fprintf(stderr, "ignoring %s\n", rp_cmd_to_string(pkt->hdr.cmd));
+        }
+        break;
+    }
+    return true;
+}
@@ -0,0 +1,80 @@
+/*
+ * Remote-port loopback peer.
+ *
+ * Copyright (c) 2020 Xilinx Inc.
+ *
+ * This code is licensed under the GNU GPL.
+ */
+#ifndef RP_PEER_H
+#define RP_PEER_H
+
+#include "hw/remote-port-proto.h"
+#include "hw/remote-port-shm.h"
+
+/*
+ * A minimal remote-port end-point built on remote-port-proto.c. As a
+ * peer it answers bus accesses from a flat memory model, and answers
+ * syncs and interrupts right away, standing in for a SystemC/RTL
+ * simulator. The same object drives the other end in benchmarks.
+ */
+typedef struct RPPeer {
+    /* Exactly one of these is the transport.  */
+    int fd;
+    RemotePortShm *shm;
+
+    struct rp_peer_state state;
+    bool hello_seen;
+    RemotePortDynPkt pkt;
+    RemotePortDynPkt rsp;
+    uint32_t id;
+
+    /* Memory model, accesses outside of it read as zero.  */
+    uint64_t mem_base;
+    uint64_t mem_size;
+    uint8_t *mem;
+
+    bool verbose;
+
+    struct {
+        uint64_t reads;
+        uint64_t writes;
+        uint64_t batches;
+        uint64_t interrupts;
+        uint64_t syncs;
+        uint64_t errors;
+    } stats;
+} RPPeer;
+
+/**
+ * rp_peer_init:
+ * @p: The peer
+ * @fd: Connected socket to use as transport, or -1
+ * @shm: Ring pair to use as transport if @fd is -1
+ * @mem_base: Bus address of the memory model
+ * @mem_size: Size of the memory model, may be 0
+ */
+void rp_peer_init(RPPeer *p, int fd, RemotePortShm *shm,
+                  uint64_t mem_base, uint64_t mem_size);
+void rp_peer_cleanup(RPPeer *p);
+
+void rp_peer_writev(RPPeer *p, const struct iovec *iov, int iovcnt);
+void rp_peer_write(RPPeer *p, const void *buf, size_t count);
+
+/*
+ * Receive and decode one packet into @dpkt. Returns false if the other
+ * end went away.
+ */
+bool rp_peer_recv(RPPeer *p, RemotePortDynPkt *dpkt);
+
+void rp_peer_say_hello(RPPeer *p);
+
+/* Check the version and pick up the capabilities of the other end.  */
+bool rp_peer_process_hello(RPPeer *p, struct rp_pkt *pkt);
+
+/*
+ * Receive and answer one packet. Returns false when the other end went
+ * away or spoke an incompatible protocol version.
+ */
+bool rp_peer_serve_one(RPPeer *p);
+
+#endif
@@ -27,12 +27,17 @@
 #endif
 
 #include "qemu-common.h"
+#include "qemu/atomic.h"
+#include "qemu/cutils.h"
+#include "qemu/host-utils.h"
 #include "qemu/etrace.h"
+#include <zlib.h>
 #include "qemu/timer.h"
 #include "exec/memory.h"
 #include "exec/address-spaces.h"
 #include "cpu.h"
 #include "exec/exec-all.h"
+#include "tcg/tcg.h"
 
 /* Still under development.  */
 #define ETRACE_VERSION_MAJOR 0
@@ -47,6 +52,10 @@ enum {
     TYPE_BARRIER = 6,
     TYPE_OLD_EVENT_U64 = 7,
     TYPE_EVENT_U64 = 8,
+    TYPE_CHUNK = 9,
+    TYPE_CHUNK_INDEX = 10,
+    TYPE_CHUNK_TRAILER = 11,
+    TYPE_TB_PROFILE = 12,
     TYPE_INFO = 0x4554,
 };
 
@@ -58,6 +67,8 @@ struct etrace_hdr {
 
 enum etrace_info_flags {
     ETRACE_INFO_F_TB_CHAINING   = (1 << 0),
+    /* Everything after the INFO and ARCH records is in TYPE_CHUNKs.  */
+    ETRACE_INFO_F_CHUNKED       = (1 << 1),
 };
 
 struct etrace_info_data {
@@ -113,6 +124,60 @@ struct etrace_event_u64 {
     uint16_t event_name_len;
 } QEMU_PACKED;
 
+/*
+ * Chunked output. The record stream is cut at record boundaries into
+ * chunks of roughly chunk= bytes, each deflated on its own so readers
+ * can start decoding at any chunk. start/end_time bound the timestamps
+ * of the records inside, records without a timestamp (TB, BARRIER etc)
+ * don't contribute.
+ *
+ * At close, a TYPE_CHUNK_INDEX record lists every chunk and a fixed size
+ * TYPE_CHUNK_TRAILER, the last record in the file, points at the index.
+ */
+enum etrace_chunk_codec {
+    ETRACE_CHUNK_DEFLATE = 1,
+};
+
+struct etrace_chunk {
+    uint64_t start_time;
+    uint64_t end_time;
+    uint32_t codec;
+    uint32_t raw_len;
+    uint32_t nr_records;
+    uint32_t __reserved;
+} QEMU_PACKED;
+
+struct etrace_chunk_index_entry {
+    /* File offset of the TYPE_CHUNK header.  */
+    uint64_t offset;
+    uint64_t start_time;
+    uint64_t end_time;
+    uint32_t raw_len;
+    uint32_t comp_len;
+} QEMU_PACKED;
+
+#define ETRACE_CHUNK_TRAILER_MAGIC 0x58444e49  /* "INDX" */
+
+struct etrace_chunk_trailer {
+    uint64_t index_offset;
+    uint32_t nr_chunks;
+    uint32_t magic;
+} QEMU_PACKED;
+
+struct etrace_tb_profile {
+    uint64_t time;
+    uint32_t nr_entries;
+    uint32_t __reserved;
+} QEMU_PACKED;
+
+struct etrace_tb_profile_entry {
+    uint64_t vaddr;
+    uint64_t paddr;
+    uint64_t count;
+    uint32_t guest_code_len;
+    uint32_t icount;
+} QEMU_PACKED;
+
 const char *qemu_arg_etrace;
 const char *qemu_arg_etrace_flags;
 struct etracer qemu_etracer = {0};
@@ -133,7 +198,9 @@ struct {
     { "mem", ETRACE_F_MEM },
     { "cpu", ETRACE_F_CPU },
     { "gpio", ETRACE_F_GPIO },
-    { "all", ~0 },
+    { "profile", ETRACE_F_PROFILE },
+    /* Profiling instruments every TB, it has to be asked for by name.  */
+    { "all", ~ETRACE_F_PROFILE },
     { NULL, 0 },
 };
 
@@ -161,7 +228,68 @@ static uint64_t qemu_etrace_str2flags(const char *str, size_t len)
     return flags;
 }
 
-static uint64_t qemu_etrace_opts2flags(const char *opts)
+/*
+ * Options that aren't flags take the form key=value:
+ *   policy=block|drop|sync  what to do when the writer thread falls behind.
+ *   buffer=SIZE             size of each per-thread staging ring.
+ *   compress=on|off         write deflated, indexed chunks.
+ *   chunk=SIZE              uncompressed size of each chunk.
+ *   profile-period=MS       how often to dump the TB profile, 0 for exit only.
+ */
+static void qemu_etrace_str2opt(struct etracer *t, const char *str,
+                                size_t len)
+{
+    g_autofree char *opt = g_strndup(str, len);
+    char *val = strchr(opt, '=');
+    uint64_t size;
+
+    *val++ = 0;
+    if (!strcmp(opt, "policy")) {
+        if (!strcmp(val, "block")) {
+            t->policy = ETRACE_POLICY_BLOCK;
+        } else if (!strcmp(val, "drop")) {
+            t->policy = ETRACE_POLICY_DROP;
+        } else if (!strcmp(val, "sync")) {
+            t->policy = ETRACE_POLICY_SYNC;
+        } else {
+            fprintf(stderr, "Invalid etrace policy %s\n", val);
+            exit(EXIT_FAILURE);
+        }
+    } else if (!strcmp(opt, "buffer")) {
+        if (qemu_strtosz(val, NULL, &size) < 0 || !is_power_of_2(size)
+            || size < 64 * 1024 || size > (1ULL << 31)) {
+            fprintf(stderr, "etrace buffer size %s must be a power of 2 "
+                    "between 64K and 2G\n", val);
+            exit(EXIT_FAILURE);
+        }
+        t->ring_size = size;
+    } else if (!strcmp(opt, "compress")) {
+        if (!strcmp(val, "on")) {
+            t->chunk.enabled = true;
+        } else if (strcmp(val, "off")) {
+            fprintf(stderr, "Invalid etrace compress value %s\n", val);
+            exit(EXIT_FAILURE);
+        }
+    } else if (!strcmp(opt, "chunk")) {
+        if (qemu_strtosz(val, NULL, &size) < 0
+            || size < 4 * 1024 || size > 256 * 1024 * 1024) {
+            fprintf(stderr, "etrace chunk size %s must be between 4K "
+                    "and 256M\n", val);
+            exit(EXIT_FAILURE);
+        }
+        t->chunk.size = size;
+    } else if (!strcmp(opt, "profile-period")) {
+        if (qemu_strtoui(val, NULL, 0, &t->profile.period_ms) < 0) {
+            fprintf(stderr, "Invalid etrace profile-period %s\n", val);
+            exit(EXIT_FAILURE);
+        }
+    } else {
+        fprintf(stderr, "Invalid etrace option %s\n", opt);
+        exit(EXIT_FAILURE);
+    }
+}
+
+static uint64_t qemu_etrace_opts2flags(struct etracer *t, const char *opts)
 {
     uint64_t flags = 0;
     const char *prev = opts, *end = opts;
@@ -170,7 +298,11 @@ static uint64_t qemu_etrace_opts2flags(const char *opts)
         while (*end != ',' && *end != 0) {
             end++;
         }
-        flags |= qemu_etrace_str2flags(prev, end - prev);
+        if (memchr(prev, '=', end - prev)) {
+            qemu_etrace_str2opt(t, prev, end - prev);
+        } else {
+            flags |= qemu_etrace_str2flags(prev, end - prev);
+        }
         while (*end == ',') {
             end++;
         }
@@ -179,22 +311,506 @@ static uint64_t qemu_etrace_opts2flags(const char *opts)
     return flags;
 }
 
-static void etrace_write(struct etracer *t, const void *buf, size_t len)
+static uint64_t etrace_time(void)
+{
+#if defined(CONFIG_USER_ONLY)
+    return 0;
+#else
+    return qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);;
+#endif
+}
+
+static void etrace_fwrite_raw(struct etracer *t, const void *buf, size_t len)
 {
     size_t r;
 
+    if (t->fp_error || !len) {
+        return;
+    }
+
     r = fwrite(buf, 1, len, t->fp);
     if (feof(t->fp) || ferror(t->fp)) {
         fprintf(stderr, "Etrace peer EOF/disconnected!\n");
-        /* FIXME: Allow qemu to continue?  */
-        fclose(t->fp);
-        t->fp = NULL;
-        exit(1);
+        if (t->policy == ETRACE_POLICY_SYNC) {
+            /* FIXME: Allow qemu to continue?  */
+            fclose(t->fp);
+            t->fp = NULL;
+            exit(1);
+        }
+        /*
+         * We can't exit from the writer thread, the atexit handler would
+         * try to join it. Keep draining the rings into the void instead.
+         */
+        t->fp_error = true;
+        return;
     }
     /* FIXME: Make this more robust.  */
     assert(r == len);
+    t->offset += len;
+}
+
+/*
+ * Extract the time span covered by a record. Returns false for records
+ * that don't carry a timestamp.
+ */
+static bool etrace_record_time(struct etracer *t, const struct etrace_hdr *hdr,
+                               const uint8_t *payload,
+                               uint64_t *start, uint64_t *end)
+{
+    size_t entry_size = t->arch_bits == 32 ? sizeof(struct etrace_entry32)
+                                           : sizeof(struct etrace_entry64);
+    size_t time_offset;
+    size_t pos;
+    uint32_t duration;
+
+    switch (hdr->type) {
+    case TYPE_EXEC:
+        time_offset = offsetof(struct etrace_exec, start_time);
+        break;
+    case TYPE_NOTE:
+        time_offset = offsetof(struct etrace_note, time);
+        break;
+    case TYPE_MEM:
+        time_offset = offsetof(struct etrace_mem, time);
+        break;
+    case TYPE_EVENT_U64:
+        time_offset = offsetof(struct etrace_event_u64, time);
+        break;
+    case TYPE_TB_PROFILE:
+        time_offset = offsetof(struct etrace_tb_profile, time);
+        break;
+    default:
+        return false;
+    }
+
+    if (hdr->len < time_offset + sizeof *start) {
+        return false;
+    }
+    memcpy(start, payload + time_offset, sizeof *start);
+    *end = *start;
+
+    if (hdr->type == TYPE_EXEC) {
+        /* The entries run back to back from start_time.  */
+        for (pos = sizeof(struct etrace_exec); pos + entry_size <= hdr->len;
+             pos += entry_size) {
+            memcpy(&duration, payload + pos, sizeof duration);
+            *end += duration;
+        }
+    }
+    return true;
+}
+
+/* Deflate and write out the first len bytes of the chunk buffer.  */
+static void etrace_chunk_emit(struct etracer *t, size_t len)
+{
+    struct etrace_chunk_index_entry entry;
+    struct etrace_chunk ch = {
+        .start_time = t->chunk.start_time,
+        .end_time = t->chunk.end_time,
+        .codec = ETRACE_CHUNK_DEFLATE,
+        .raw_len = len,
+        .nr_records = t->chunk.nr_records,
+    };
+    struct etrace_hdr hdr = {
+        .type = TYPE_CHUNK,
+    };
+    uLongf zlen = compressBound(len);
+    int r;
+
+    if (zlen > t->chunk.zcap) {
+        t->chunk.zcap = zlen;
+        t->chunk.zbuf = g_realloc(t->chunk.zbuf, zlen);
+    }
+
+    r = compress2(t->chunk.zbuf, &zlen, t->chunk.buf, len, Z_BEST_SPEED);
+    /* Only fails on bad arguments or OOM.  */
+    assert(r == Z_OK);
+
+    entry.offset = t->offset;
+    entry.start_time = ch.start_time;
+    entry.end_time = ch.end_time;
+    entry.raw_len = len;
+    entry.comp_len = zlen;
+    g_array_append_val(t->chunk.index, entry);
+
+    hdr.len = sizeof ch + zlen;
+    etrace_fwrite_raw(t, &hdr, sizeof hdr);
+    etrace_fwrite_raw(t, &ch, sizeof ch);
+    etrace_fwrite_raw(t, t->chunk.zbuf, zlen);
+
+    /* Keep any partial record for the next chunk.  */
+    memmove(t->chunk.buf, t->chunk.buf + len, t->chunk.len - len);
+    t->chunk.len -= len;
+    t->chunk.parsed -= len;
+    t->chunk.nr_records = 0;
+    t->chunk.start_time = UINT64_MAX;
+    t->chunk.end_time = 0;
+}
+
+/*
+ * Append to the current chunk and cut it once it holds chunk.size
+ * bytes worth of whole records. Writes reach us in record order but not
+ * necessarily record sized, so walk the headers to find the boundaries.
+ */
+static void etrace_chunk_write(struct etracer *t, const void *buf, size_t len)
+{
+    if (t->chunk.len + len > t->chunk.cap) {
+        t->chunk.cap = MAX(t->chunk.cap * 2, t->chunk.len + len);
+        t->chunk.buf = g_realloc(t->chunk.buf, t->chunk.cap);
+    }
+    memcpy(t->chunk.buf + t->chunk.len, buf, len);
+    t->chunk.len += len;
+
+    while (t->chunk.len - t->chunk.parsed >= sizeof(struct etrace_hdr)) {
+        struct etrace_hdr hdr;
+        uint64_t start, end;
+        const uint8_t *payload;
+
+        memcpy(&hdr, t->chunk.buf + t->chunk.parsed, sizeof hdr);
+        if (t->chunk.len - t->chunk.parsed < sizeof hdr + hdr.len) {
+            break;
+        }
+
+        payload = t->chunk.buf + t->chunk.parsed + sizeof hdr;
+        if (etrace_record_time(t, &hdr, payload, &start, &end)) {
+            t->chunk.start_time = MIN(t->chunk.start_time, start);
+            t->chunk.end_time = MAX(t->chunk.end_time, end);
+        }
+        t->chunk.parsed += sizeof hdr + hdr.len;
+        t->chunk.nr_records++;
+
+        if (t->chunk.parsed >= t->chunk.size) {
+            etrace_chunk_emit(t, t->chunk.parsed);
+        }
+    }
+}
+
+static void etrace_chunk_start(struct etracer *t)
+{
+    t->chunk.cap = t->chunk.size + 64 * 1024;
+    t->chunk.buf = g_malloc(t->chunk.cap);
+    t->chunk.index = g_array_new(false, false,
+                                 sizeof(struct etrace_chunk_index_entry));
+    t->chunk.start_time = UINT64_MAX;
+    t->chunk.end_time = 0;
+    t->chunk.active = true;
+}
+
+/* Write out the last chunk, the index and the trailer.  */
+static void etrace_chunk_finish(struct etracer *t)
+{
+    struct etrace_chunk_trailer trailer = {
+        .nr_chunks = t->chunk.index->len,
+        .magic = ETRACE_CHUNK_TRAILER_MAGIC,
+    };
+    size_t index_len = t->chunk.index->len
+                       * sizeof(struct etrace_chunk_index_entry);
+    struct etrace_hdr hdr;
+
+    if (t->chunk.len) {
+        etrace_chunk_emit(t, t->chunk.len);
+    }
+    t->chunk.active = false;
+
+    trailer.index_offset = t->offset;
+    hdr.type = TYPE_CHUNK_INDEX;
+    hdr.unit_id = 0;
+    hdr.len = index_len;
+    etrace_fwrite_raw(t, &hdr, sizeof hdr);
+    etrace_fwrite_raw(t, t->chunk.index->data, index_len);
+
+    hdr.type = TYPE_CHUNK_TRAILER;
+    hdr.len = sizeof trailer;
+    etrace_fwrite_raw(t, &hdr, sizeof hdr);
+    etrace_fwrite_raw(t, &trailer, sizeof trailer);
+
+    g_array_free(t->chunk.index, true);
+    g_free(t->chunk.buf);
+    g_free(t->chunk.zbuf);
+}
+
+static void etrace_fwrite(struct etracer *t, const void *buf, size_t len)
+{
+    if (t->chunk.active) {
+        etrace_chunk_write(t, buf, len);
+    } else {
+        etrace_fwrite_raw(t, buf, len);
+    }
+}
+
+static __thread struct etrace_ring *etrace_tls_ring;
+
+static struct etrace_ring *etrace_ring_new(struct etracer *t, bool shared)
+{
+    struct etrace_ring *r = g_new0(struct etrace_ring, 1);
+
+    r->t = t;
+    r->size = t->ring_size;
+    r->buf = g_malloc(r->size);
+    r->shared = shared;
+    qemu_sem_init(&r->space, 0);
+    if (shared) {
+        qemu_mutex_init(&r->lock);
+    }
+    return r;
+}
+
+static void etrace_ring_free(struct etrace_ring *r)
+{
+    if (r->shared) {
+        qemu_mutex_destroy(&r->lock);
+    }
+    qemu_sem_destroy(&r->space);
+    g_free(r->buf);
+    g_free(r);
+}
+
+/*
+ * Returns the ring of the calling thread, setting one up on first use.
+ * With MTTCG every vCPU thread ends up with a ring of its own.
+ */
+static struct etrace_ring *etrace_get_ring(struct etracer *t)
+{
+    struct etrace_ring *r = etrace_tls_ring;
+
+    if (likely(r && r->t == t)) {
+        return r;
+    }
+
+    qemu_mutex_lock(&t->rings_lock);
+    if (t->nr_rings < ETRACE_MAX_RINGS) {
+        r = etrace_ring_new(t, false);
+        t->rings[t->nr_rings] = r;
+        /* Publish the ring to the writer thread.  */
+        atomic_store_release(&t->nr_rings, t->nr_rings + 1);
+    } else {
+        r = t->rings[0];
+    }
+    qemu_mutex_unlock(&t->rings_lock);
+
+    etrace_tls_ring = r;
+    return r;
+}
+
+static inline uint32_t etrace_ring_used(struct etrace_ring *r)
+{
+    return r->wpos - atomic_load_acquire(&r->tail);
+}
+
+/* Wait for the writer thread to free up len bytes in the ring.  */
+static void etrace_ring_wait(struct etracer *t, struct etrace_ring *r,
+                             uint32_t len)
+{
+    while (r->size - etrace_ring_used(r) < len) {
+        r->stats.stalls++;
+        atomic_set(&r->waiting, true);
+        qemu_sem_post(&t->writer.wakeup);
+        qemu_sem_wait(&r->space);
+    }
+}
+
+/* Drain everything published in r. Called with fp_lock held.  */
+static uint32_t etrace_ring_drain(struct etracer *t, struct etrace_ring *r)
+{
+    uint32_t head = atomic_load_acquire(&r->head);
+    uint32_t tail = r->tail;
+    uint32_t len = head - tail;
+    uint32_t pos = tail & (r->size - 1);
+    uint32_t chunk = MIN(len, r->size - pos);
+
+    etrace_fwrite(t, r->buf + pos, chunk);
+    etrace_fwrite(t, r->buf, len - chunk);
+    atomic_store_release(&r->tail, head);
+
+    if (atomic_xchg(&r->waiting, false)) {
+        qemu_sem_post(&r->space);
+    }
+    return len;
+}
+
+static void *etrace_writer_thread(void *opaque)
+{
+    struct etracer *t = opaque;
+    bool stop;
+
+    do {
+        unsigned int nr_rings = atomic_load_acquire(&t->nr_rings);
+        uint32_t done = 0;
+        unsigned int i;
+
+        /* Sample stop first so the last pass drains everything.  */
+        stop = atomic_read(&t->writer.stop);
+
+        qemu_mutex_lock(&t->fp_lock);
+        for (i = 0; i < nr_rings; i++) {
+            done += etrace_ring_drain(t, t->rings[i]);
+        }
+        if (!done && !t->fp_error) {
+            /* Idle, push out what stdio is holding on to.  */
+            fflush(t->fp);
+        }
+        qemu_mutex_unlock(&t->fp_lock);
+
+        if (!done && !stop) {
+            qemu_sem_timedwait(&t->writer.wakeup, 10);
+        }
+    } while (!stop);
+    return NULL;
+}
+
+/*
+ * The record the calling thread has open, see etrace_record_begin. Kept
+ * per thread rather than per ring since ring 0 is shared.
+ */
+static __thread bool etrace_tls_in_record;
+static __thread uint32_t etrace_tls_rec_left;
+
+/*
+ * Open a record of len bytes, header included, in the ring of the calling
+ * thread. The following etrace_write calls fill it and etrace_write_done
+ * closes it, which publishes the record to the writer thread.
+ *
+ * Records don't nest. Nothing between etrace_write_header and
+ * etrace_write_done may end up tracing on the same thread, e.g through
+ * an MMIO access, as that would interleave two records in the same
+ * slot; it is a fatal error.
+ */
+static void etrace_record_begin(struct etracer *t, uint32_t len)
+{
+    struct etrace_ring *r;
+
+    if (etrace_tls_in_record) {
+        fprintf(stderr, "etrace: nested record, tracing from within a "
+                "record writer\n");
+        abort();
+    }
+    etrace_tls_in_record = true;
+    etrace_tls_rec_left = len;
+
+    if (t->policy == ETRACE_POLICY_SYNC) {
+        /*
+         * vCPU threads write straight to the file, keep their records
+         * whole and the chunk buffer consistent under MTTCG.
+         */
+        qemu_mutex_lock(&t->fp_lock);
+        return;
+    }
+
+    r = etrace_get_ring(t);
+    if (r->shared) {
+        qemu_mutex_lock(&r->lock);
+    }
+
+    r->rec_drop = false;
+    r->rec_direct = false;
+
+    if (len > r->size / 2) {
+        /*
+         * Too large to stage (typically TB dumps). Let the writer catch
+         * up with what this thread already queued and write it directly.
+         */
+        etrace_ring_wait(t, r, r->size);
+        qemu_mutex_lock(&t->fp_lock);
+        r->rec_direct = true;
+        return;
+    }
+
+    if (r->size - etrace_ring_used(r) < len) {
+        if (t->policy == ETRACE_POLICY_DROP) {
+            r->rec_drop = true;
+            r->stats.dropped_records++;
+            r->stats.dropped_bytes += len;
+            return;
+        }
+        etrace_ring_wait(t, r, len);
+    }
 }
 
+static void etrace_record_put(struct etracer *t, const void *buf, size_t len)
+{
+    struct etrace_ring *r;
+
+    assert(etrace_tls_in_record);
+    if (len > etrace_tls_rec_left) {
+        /* Keep the stream parseable, the header is already out.  */
+        fprintf(stderr, "etrace: record payload exceeds its header by %zu"
+                " bytes, truncating\n", len - etrace_tls_rec_left);
+        len = etrace_tls_rec_left;
+    }
+    etrace_tls_rec_left -= len;
+
+    if (t->policy == ETRACE_POLICY_SYNC) {
+        etrace_fwrite(t, buf, len);
+        return;
+    }
+
+    r = etrace_get_ring(t);
+    if (r->rec_direct) {
+        etrace_fwrite(t, buf, len);
+    } else if (!r->rec_drop) {
+        uint32_t pos = r->wpos & (r->size - 1);
+        uint32_t chunk = MIN(len, r->size - pos);
+
+        memcpy(r->buf + pos, buf, chunk);
+        memcpy(r->buf, (const uint8_t *) buf + chunk, len - chunk);
+        r->wpos += len;
+    }
+}
+
+static void etrace_record_end(struct etracer *t)
+{
+    static const uint8_t zeros[64];
+    struct etrace_ring *r;
+
+    assert(etrace_tls_in_record);
+    if (etrace_tls_rec_left) {
+        fprintf(stderr, "etrace: record payload short of its header by %u"
+                " bytes, padding\n", etrace_tls_rec_left);
+        while (etrace_tls_rec_left) {
+            etrace_record_put(t, zeros, MIN(etrace_tls_rec_left,
+                                            sizeof zeros));
+        }
+    }
+    etrace_tls_in_record = false;
+
+    if (t->policy == ETRACE_POLICY_SYNC) {
+        qemu_mutex_unlock(&t->fp_lock);
+        return;
+    }
+
+    r = etrace_get_ring(t);
+    if (r->rec_direct) {
+        r->rec_direct = false;
+        qemu_mutex_unlock(&t->fp_lock);
+    } else if (!r->rec_drop) {
+        uint32_t tail = atomic_read(&r->tail);
+        uint32_t head = r->head;
+
+        r->stats.records++;
+        r->stats.bytes += r->wpos - head;
+        atomic_store_release(&r->head, r->wpos);
+
+        /* Kick the writer when crossing the half-full mark.  */
+        if (head - tail <= r->size / 2 && r->wpos - tail > r->size / 2) {
+            qemu_sem_post(&t->writer.wakeup);
+        }
+    }
+
+    if (r->shared) {
+        qemu_mutex_unlock(&r->lock);
+    }
+}
+
+static void etrace_write(struct etracer *t, const void *buf, size_t len)
+{
+    if (unlikely(!t->fp)) {
+        return;
+    }
+
+    etrace_record_put(t, buf, len);
+}
+
+/* Open a record, every call must be paired with etrace_write_done.  */
 static void etrace_write_header(struct etracer *t, uint16_t type,
                                 uint16_t unit_id, uint32_t len)
 {
@@ -203,9 +819,70 @@ static void etrace_write_header(struct etracer *t, uint16_t type,
         .unit_id = unit_id,
         .len = len
     };
+
+    if (unlikely(!t->fp)) {
+        return;
+    }
+
+    etrace_record_begin(t, sizeof hdr + len);
     etrace_write(t, &hdr, sizeof hdr);
 }
 
+static void etrace_write_done(struct etracer *t)
+{
+    if (unlikely(!t->fp)) {
+        return;
+    }
+
+    etrace_record_end(t);
+}
+
+static void etrace_writer_start(struct etracer *t)
+{
+    qemu_mutex_init(&t->rings_lock);
+    qemu_sem_init(&t->writer.wakeup, 0);
+
+    t->rings[0] = etrace_ring_new(t, true);
+    t->nr_rings = 1;
+
+    qemu_thread_create(&t->writer.thread, "etrace-writer",
+                       etrace_writer_thread, t, QEMU_THREAD_JOINABLE);
+}
+
+static void etrace_writer_stop(struct etracer *t)
+{
+    unsigned int i;
+
+    atomic_set(&t->writer.stop, true);
+    qemu_sem_post(&t->writer.wakeup);
+    qemu_thread_join(&t->writer.thread);
+
+    for (i = 0; i < t->nr_rings; i++) {
+        etrace_ring_free(t->rings[i]);
+        t->rings[i] = NULL;
+    }
+    t->nr_rings = 0;
+    qemu_sem_destroy(&t->writer.wakeup);
+    qemu_mutex_destroy(&t->rings_lock);
+}
+
+void etrace_get_stats(struct etracer *t, struct etrace_stats *st)
+{
+    unsigned int nr_rings = atomic_load_acquire(&t->nr_rings);
+    unsigned int i;
+
+    memset(st, 0, sizeof *st);
+    for (i = 0; i < nr_rings; i++) {
+        struct etrace_ring *r = t->rings[i];
+
+        st->records += r->stats.records;
+        st->bytes += r->stats.bytes;
+        st->dropped_records += r->stats.dropped_records;
+        st->dropped_bytes += r->stats.dropped_bytes;
+        st->stalls += r->stats.stalls;
+    }
+}
+
 #define UNIX_PREFIX "unix:"
 
 static int sk_unix_client(const char *descr)
@@ -261,6 +938,193 @@ static FILE *etrace_open(const char *descr)
     return fp;
 }
 
+/*
+ * The INFO and ARCH records go out uncompressed, ahead of the writer
+ * thread, so readers can always identify the file from its first bytes.
+ */
+static void etrace_write_preamble(struct etracer *t, uint16_t type,
+                                  const void *buf, uint32_t len)
+{
+    struct etrace_hdr hdr = {
+        .type = type,
+        .unit_id = 0,
+        .len = len
+    };
+
+    etrace_fwrite_raw(t, &hdr, sizeof hdr);
+    etrace_fwrite_raw(t, buf, len);
+}
+
+static guint etrace_profile_hash(gconstpointer v)
+{
+    const struct etrace_tb_profile_entry *e = v;
+
+    return g_int64_hash(&e->vaddr) ^ g_int64_hash(&e->paddr);
+}
+
+static gboolean etrace_profile_equal(gconstpointer a, gconstpointer b)
+{
+    const struct etrace_tb_profile_entry *ea = a, *eb = b;
+
+    return ea->vaddr == eb->vaddr && ea->paddr == eb->paddr;
+}
+
+static GHashTable *etrace_profile_table_new(void)
+{
+    return g_hash_table_new_full(etrace_profile_hash, etrace_profile_equal,
+                                 g_free, NULL);
+}
+
+/* Add count executions of a block to the table.  */
+static void etrace_profile_account(GHashTable *ht, uint64_t vaddr,
+                                   uint64_t paddr, uint32_t len,
+                                   uint32_t icount, uint64_t count)
+{
+    struct etrace_tb_profile_entry key = {
+        .vaddr = vaddr,
+        .paddr = paddr,
+    };
+    struct etrace_tb_profile_entry *e = g_hash_table_lookup(ht, &key);
+
+    if (!e) {
+        e = g_memdup(&key, sizeof key);
+        g_hash_table_add(ht, e);
+    }
+    e->count += count;
+    /* Keep the last translation's shape.  */
+    e->guest_code_len = len;
+    e->icount = icount;
+}
+
+static void etrace_profile_account_tb(GHashTable *ht, TranslationBlock *tb,
+                                      uint64_t count)
+{
+    uint64_t paddr = tb->page_addr[0] + (tb->pc & ~TARGET_PAGE_MASK);
+
+    etrace_profile_account(ht, tb->pc, paddr, tb->size, tb->icount, count);
+}
+
+/*
+ * Fold the count of a TB that is about to go away into the retired
+ * table. Called on invalidation and for every TB before a flush.
+ */
+void etrace_profile_retire_tb(struct etracer *t, TranslationBlock *tb)
+{
+    uint64_t count;
+
+    qemu_mutex_lock(&t->profile.lock);
+    count = tb->exec_count;
+    tb->exec_count = 0;
+    if (count) {
+        etrace_profile_account_tb(t->profile.retired, tb, count);
+    }
+    qemu_mutex_unlock(&t->profile.lock);
+}
+
+static gboolean etrace_profile_live_iter(gpointer key, gpointer value,
+                                         gpointer data)
+{
+    TranslationBlock *tb = value;
+    uint64_t count = tb->exec_count;
+
+    if (count) {
+        etrace_profile_account_tb(data, tb, count);
+    }
+    return false;
+}
+
+static void etrace_profile_copy(gpointer key, gpointer value, gpointer data)
+{
+    struct etrace_tb_profile_entry *e = value;
+
+    etrace_profile_account(data, e->vaddr, e->paddr, e->guest_code_len,
+                           e->icount, e->count);
+}
+
+static gint etrace_profile_cmp(gconstpointer a, gconstpointer b)
+{
+    const struct etrace_tb_profile_entry *ea = a, *eb = b;
+
+    /* Hottest first.  */
+    return ea->count < eb->count ? 1 : ea->count > eb->count ? -1 : 0;
+}
+
+static void etrace_profile_append(gpointer key, gpointer value, gpointer data)
+{
+    g_array_append_vals(data, value, 1);
+}
+
+/*
+ * Emit a TYPE_TB_PROFILE record with the cumulative execution count of
+ * every block seen so far, hottest first. Counts are totals since the
+ * start of the trace, consumers diff successive records for rates.
+ */
+void etrace_profile_dump(struct etracer *t)
+{
+    GHashTable *ht = etrace_profile_table_new();
+    GArray *entries;
+    struct etrace_tb_profile prof;
+    size_t len;
+
+    qemu_mutex_lock(&t->profile.lock);
+    g_hash_table_foreach(t->profile.retired, etrace_profile_copy, ht);
+    qemu_mutex_unlock(&t->profile.lock);
+    tcg_tb_foreach(etrace_profile_live_iter, ht);
+
+    entries = g_array_sized_new(false, false,
+                                sizeof(struct etrace_tb_profile_entry),
+                                g_hash_table_size(ht));
+    g_hash_table_foreach(ht, etrace_profile_append, entries);
+    g_array_sort(entries, etrace_profile_cmp);
+
+    memset(&prof, 0, sizeof prof);
+    prof.time = etrace_time();
+    prof.nr_entries = entries->len;
+    len = entries->len * sizeof(struct etrace_tb_profile_entry);
+
+    etrace_write_header(t, TYPE_TB_PROFILE, 0, sizeof prof + len);
+    etrace_write(t, &prof, sizeof prof);
+    etrace_write(t, entries->data, len);
+    etrace_write_done(t);
+
+    g_array_free(entries, true);
+    g_hash_table_destroy(ht);
+}
+
+static void *etrace_profile_thread(void *opaque)
+{
+    struct etracer *t = opaque;
+
+    while (qemu_sem_timedwait(&t->profile.stop, t->profile.period_ms)) {
+        etrace_profile_dump(t);
+    }
+    return NULL;
+}
+
+static void etrace_profile_start(struct etracer *t)
+{
+    qemu_mutex_init(&t->profile.lock);
+    t->profile.retired = etrace_profile_table_new();
+
+    if (t->profile.period_ms) {
+        qemu_sem_init(&t->profile.stop, 0);
+        qemu_thread_create(&t->profile.thread, "etrace-profile",
+                           etrace_profile_thread, t, QEMU_THREAD_JOINABLE);
+    }
+}
+
+static void etrace_profile_stop(struct etracer *t)
+{
+    if (t->profile.period_ms) {
+        qemu_sem_post(&t->profile.stop);
+        qemu_thread_join(&t->profile.thread);
+        qemu_sem_destroy(&t->profile.stop);
+    }
+
+    /* Final totals.  */
+    etrace_profile_dump(t);
+}
+
 /*
  * Initialize a tracing context.
  *
@@ -274,6 +1138,10 @@ bool etrace_init(struct etracer *t, const char *filename,
     struct etrace_arch arch;
 
     memset(t, 0, sizeof *t);
+    t->ring_size = ETRACE_RING_SIZE_DEFAULT;
+    t->chunk.size = ETRACE_CHUNK_SIZE_DEFAULT;
+    t->flags = qemu_etrace_opts2flags(t, opts);
+
     t->fp = etrace_open(filename);
     if (!t->fp) {
         return false;
@@ -286,8 +1154,10 @@ bool etrace_init(struct etracer *t, const char *filename,
     if (qemu_loglevel_mask(CPU_LOG_TB_NOCHAIN)) {
         id.attr |= ETRACE_INFO_F_TB_CHAINING;
     }
-    etrace_write_header(t, TYPE_INFO, 0, sizeof id);
-    etrace_write(t, &id, sizeof id);
+    if (t->chunk.enabled) {
+        id.attr |= ETRACE_INFO_F_CHUNKED;
+    }
+    etrace_write_preamble(t, TYPE_INFO, &id, sizeof id);
 
 
     /* FIXME: Pass info about host.  */
@@ -296,10 +1166,18 @@ bool etrace_init(struct etracer *t, const char *filename,
 #ifdef TARGET_WORDS_BIGENDIAN
     arch.guest.big_endian = 1;
 #endif
-    etrace_write_header(t, TYPE_ARCH, 0, sizeof arch);
-    etrace_write(t, &arch, sizeof arch);
+    etrace_write_preamble(t, TYPE_ARCH, &arch, sizeof arch);
 
-    t->flags = qemu_etrace_opts2flags(opts);
+    qemu_mutex_init(&t->fp_lock);
+    if (t->chunk.enabled) {
+        etrace_chunk_start(t);
+    }
+    if (t->policy != ETRACE_POLICY_SYNC) {
+        etrace_writer_start(t);
+    }
+    if (t->flags & ETRACE_F_PROFILE) {
+        etrace_profile_start(t);
+    }
     return true;
 }
 
@@ -319,12 +1197,14 @@ static void etrace_flush_exec_cache(struct etracer *t)
     etrace_write_header(t, TYPE_EXEC, t->exec_cache.unit_id, size + sizeof ex);
     etrace_write(t, &ex, sizeof ex);
     etrace_write(t, &t->exec_cache.t64[0], size);
+    etrace_write_done(t);
     t->exec_cache.pos = 0;
     memset(&t->exec_cache.t64[0], 0, sizeof t->exec_cache.t64);
 
     /* A barrier indicates that the other side can assume order across the
        the barrier.  */
     etrace_write_header(t, TYPE_BARRIER, t->exec_cache.unit_id, 0);
+    etrace_write_done(t);
 }
 
 #define PROXIMITY_MASK (~0xfff)
@@ -430,15 +1310,18 @@ void etrace_dump_exec(struct etracer *t, unsigned int unit_id,
     }
 }
 
-static void etrace_dump_guestmem(struct etracer *t, AddressSpace *as,
-                                 uint64_t guest_vaddr, uint64_t guest_paddr,
-                                 size_t guest_len)
+/*
+ * Fetch the guest code of a TB. This may hit MMIO, which can trace in
+ * turn, so it has to happen before the TB record is opened.
+ */
+static void *etrace_read_guestmem(AddressSpace *as, uint64_t guest_vaddr,
+                                  uint64_t guest_paddr, size_t guest_len)
 {
 #if defined(CONFIG_USER_ONLY)
     /* Currently, user mode address are directly addressable.  */
-    etrace_write(t, (void *) (uintptr_t) guest_vaddr, guest_len);
+    return g_memdup((void *) (uintptr_t) guest_vaddr, guest_len);
 #else
-    unsigned char buf[8 * 1024];
+    void *buf = g_malloc(guest_len);
 
     /* Once we have per-master address-space support, we can assert()
        as not beeing NULL. But for now, provide this fallback.  */
@@ -448,13 +1331,9 @@ static void etrace_dump_guestmem(struct etracer *t, AddressSpace *as,
 
     /* TODO: We know that tb guest mem is mapped in at this time, so we could
        dig out the host ram pointer and directly write from it.  */
-    while (guest_len) {
-        unsigned int copylen = guest_len > sizeof buf ? sizeof buf : guest_len;
-
-        address_space_rw(as, guest_paddr, MEMTXATTRS_UNSPECIFIED, buf, copylen, 0);
-        etrace_write(t, buf, copylen);
-        guest_len -= copylen;
-    }
+    address_space_rw(as, guest_paddr, MEMTXATTRS_UNSPECIFIED, buf, guest_len,
+                     0);
+    return buf;
 #endif
 }
 
@@ -472,32 +1351,31 @@ void etrace_dump_tb(struct etracer *t, AddressSpace *as, uint16_t unit_id,
                     size_t guest_len,
                     void *host_buf, size_t host_len)
 {
+    g_autofree void *guest_buf = NULL;
     struct etrace_tb tb;
     size_t size;
 
+    if (unlikely(!t->fp)) {
+        return;
+    }
+
     tb.vaddr = guest_vaddr;
     tb.paddr = guest_paddr;
     tb.host_addr = (intptr_t) host_buf;
     tb.guest_code_len = guest_len;
     tb.host_code_len = host_len;
 
+    guest_buf = etrace_read_guestmem(as, guest_vaddr, guest_paddr, guest_len);
+
     size = sizeof tb + guest_len + host_len;
     /* Write headers.  */
     etrace_write_header(t, TYPE_TB, unit_id, size);
     etrace_write(t, &tb, sizeof tb);
     /* Guest code.  */
-    etrace_dump_guestmem(t, as, guest_vaddr, guest_paddr, guest_len);
+    etrace_write(t, guest_buf, guest_len);
     /* Host/native code.  */
     etrace_write(t, host_buf, host_len);
-}
-
-static uint64_t etrace_time(void)
-{
-#if defined(CONFIG_USER_ONLY)
-    return 0;
-#else
-    return qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);;
-#endif
+    etrace_write_done(t);
 }
 
 void etrace_mem_access(struct etracer *t, uint16_t unit_id,
@@ -517,6 +1395,7 @@ void etrace_mem_access(struct etracer *t, uint16_t unit_id,
     /* Write headers.  */
     etrace_write_header(t, TYPE_MEM, unit_id, sizeof mem);
     etrace_write(t, &mem, sizeof mem);
+    etrace_write_done(t);
 }
 
 void etrace_dump_exec_start(struct etracer *t,
@@ -559,6 +1438,7 @@ void etrace_note_write(struct etracer *t, unsigned int unit_id,
     etrace_write_header(t, TYPE_NOTE, unit_id, sizeof nt + len);
     etrace_write(t, &nt, sizeof nt);
     etrace_write(t, buf, len);
+    etrace_write_done(t);
 }
 
 int etrace_note_fprintf(FILE *fp,
@@ -604,12 +1484,34 @@ void etrace_event_u64(struct etracer *t, uint16_t unit_id,
     etrace_write(t, &event, sizeof event);
     etrace_write(t, dev_name, dev_len);
     etrace_write(t, event_name, event_len);
+    etrace_write_done(t);
 }
 
 void etrace_close(struct etracer *t)
 {
-    if (t->fp) {
-        etrace_flush_exec_cache(t);
-        fclose(t->fp);
+    struct etrace_stats st;
+
+    if (!t->fp) {
+        return;
+    }
+
+    etrace_flush_exec_cache(t);
+    if (t->flags & ETRACE_F_PROFILE) {
+        etrace_profile_stop(t);
+    }
+    if (t->policy != ETRACE_POLICY_SYNC) {
+        etrace_get_stats(t, &st);
+        etrace_writer_stop(t);
+        if (st.dropped_records) {
+            fprintf(stderr, "etrace: dropped %" PRIu64 " records (%" PRIu64
+                    " bytes), increase buffer= or use policy=block\n",
+                    st.dropped_records, st.dropped_bytes);
+        }
+    }
+    if (t->chunk.active) {
+        etrace_chunk_finish(t);
     }
+    fclose(t->fp);
+    t->fp = NULL;
+    qemu_mutex_destroy(&t->fp_lock);
 }
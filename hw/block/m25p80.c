@@ -23,7 +23,9 @@
 
 #include "qemu/osdep.h"
 #include "qemu/units.h"
+#include "qemu/timer.h"
 #include "sysemu/block-backend.h"
+#include "sysemu/runstate.h"
 #include "hw/qdev-properties.h"
 #include "hw/ssi/ssi.h"
 #include "migration/vmstate.h"
@@ -434,6 +436,16 @@ typedef enum {
 } Manufacturer;
 
 #define M25P80_INTERNAL_DATA_BUFFER_SZ 16
+
+/*
+ * Write-back mode: granularity of the dirty bitmap and the amount of
+ * dirty data after which a CS deassert writes it out. How long the flash
+ * has to be left alone before the rest goes to the backing store is the
+ * write-back-idle-ms property.
+ */
+#define M25P80_WB_GRANULE (4 * KiB)
+#define M25P80_WB_BATCH (1 * MiB / M25P80_WB_GRANULE)
+
 #define MICRON_OCTAL_CFG_SIZE 256
 
 typedef struct Flash {
@@ -479,6 +491,15 @@ typedef struct Flash {
 
     int64_t dirty_page;
 
+    /* Write-back state, dirty is NULL in write-through mode.  */
+    bool write_back;
+    uint32_t wb_idle_ms;
+    unsigned long *dirty;
+    uint32_t dirty_count;
+    QEMUTimer *wb_timer;
+    VMChangeStateEntry *wb_vmstate;
+    Notifier wb_shutdown;
+
     const FlashPartInfo *pi;
 
 } Flash;
@@ -528,6 +549,70 @@ static void blk_sync_complete(void *opaque, int ret)
      */
 }
 
+static void flash_mark_dirty(Flash *s, int64_t off, int64_t len)
+{
+    unsigned long i;
+
+    for (i = off / M25P80_WB_GRANULE;
+         i <= (off + len - 1) / M25P80_WB_GRANULE; i++) {
+        if (!test_and_set_bit(i, s->dirty)) {
+            s->dirty_count++;
+        }
+    }
+    timer_mod(s->wb_timer, qemu_clock_get_ms(QEMU_CLOCK_REALTIME) +
+                           s->wb_idle_ms);
+}
+
+/* Writes the dirty parts of the storage back, one request per run.  */
+static void flash_write_back(Flash *s)
+{
+    unsigned long nbits = DIV_ROUND_UP(s->size, M25P80_WB_GRANULE);
+    unsigned long start, end;
+
+    if (!s->dirty_count) {
+        return;
+    }
+
+    start = find_first_bit(s->dirty, nbits);
+    while (start < nbits) {
+        int64_t off = (int64_t)start * M25P80_WB_GRANULE;
+        QEMUIOVector *iov;
+
+        end = find_next_zero_bit(s->dirty, nbits, start);
+        bitmap_clear(s->dirty, start, end - start);
+
+        iov = g_new(QEMUIOVector, 1);
+        qemu_iovec_init(iov, 1);
+        qemu_iovec_add(iov, s->storage + off,
+                       MIN((int64_t)end * M25P80_WB_GRANULE, s->size) - off);
+        blk_aio_pwritev(s->blk, off, iov, 0, blk_sync_complete, iov);
+
+        start = find_next_bit(s->dirty, nbits, end);
+    }
+    s->dirty_count = 0;
+    timer_del(s->wb_timer);
+}
+
+static void flash_wb_timer(void *opaque)
+{
+    flash_write_back(opaque);
+}
+
+static void flash_wb_vm_state_change(void *opaque, int running,
+                                     RunState state)
+{
+    if (!running) {
+        flash_write_back(opaque);
+    }
+}
+
+static void flash_wb_shutdown(Notifier *n, void *opaque)
+{
+    Flash *s = container_of(n, Flash, wb_shutdown);
+
+    flash_write_back(s);
+}
+
 static void flash_sync_page(Flash *s, int page)
 {
     QEMUIOVector *iov;
@@ -536,6 +621,11 @@ static void flash_sync_page(Flash *s, int page)
         return;
     }
 
+    if (s->dirty) {
+        flash_mark_dirty(s, page * s->pi->page_size, s->pi->page_size);
+        return;
+    }
+
     iov = g_new(QEMUIOVector, 1);
     qemu_iovec_init(iov, 1);
     qemu_iovec_add(iov, s->storage + page * s->pi->page_size,
@@ -552,6 +642,11 @@ static inline void flash_sync_area(Flash *s, int64_t off, int64_t len)
         return;
     }
 
+    if (s->dirty) {
+        flash_mark_dirty(s, off, len);
+        return;
+    }
+
     assert(!(len % BDRV_SECTOR_SIZE));
     iov = g_new(QEMUIOVector, 1);
     qemu_iovec_init(iov, 1);
@@ -1289,6 +1384,9 @@ static int m25p80_cs(SSISlave *ss, bool select)
         s->pos = 0;
         s->state = STATE_IDLE;
         flash_sync_dirty(s, -1);
+        if (s->dirty_count >= M25P80_WB_BATCH) {
+            flash_write_back(s);
+        }
         s->data_read_loop = false;
     }
 
@@ -1424,6 +1522,15 @@ static void m25p80_realize(SSISlave *ss, Error **errp)
             exit(1);
         }
 
+        if (s->write_back && !blk_is_read_only(s->blk)) {
+            s->dirty = bitmap_new(DIV_ROUND_UP(s->size, M25P80_WB_GRANULE));
+            s->wb_timer = timer_new_ms(QEMU_CLOCK_REALTIME, flash_wb_timer, s);
+            s->wb_vmstate = qemu_add_vm_change_state_handler(
+                                flash_wb_vm_state_change, s);
+            s->wb_shutdown.notify = flash_wb_shutdown;
+            qemu_register_shutdown_notifier(&s->wb_shutdown);
+        }
+
     } else {
         DB_PRINT_L(0, "No BDRV - binding to RAM\n");
         s->storage = blk_blockalign(NULL, s->size);
@@ -1440,7 +1547,10 @@ static void m25p80_reset(DeviceState *d)
 
 static int m25p80_pre_save(void *opaque)
 {
-    flash_sync_dirty((Flash *)opaque, -1);
+    Flash *s = opaque;
+
+    flash_sync_dirty(s, -1);
+    flash_write_back(s);
 
     return 0;
 }
@@ -1456,6 +1566,9 @@ static Property m25p80_properties[] = {
                       nv_cfg_large_stage,
                       qdev_prop_uint8, uint8_t),
     DEFINE_PROP_DRIVE("drive", Flash, blk),
+    /* Keep programmed data in memory and write it back in batches.  */
+    DEFINE_PROP_BOOL("write-back", Flash, write_back, false),
+    DEFINE_PROP_UINT32("write-back-idle-ms", Flash, wb_idle_ms, 100),
     DEFINE_PROP_END_OF_LIST(),
 };
 
@@ -1543,6 +1656,26 @@ static const VMStateDescription vmstate_m25p80 = {
     }
 };
 
+static uint32_t m25p80_read_bulk(SSISlave *ss, uint8_t *buf, uint32_t len)
+{
+    Flash *s = M25P80(ss);
+    uint32_t done = 0;
+
+    if (s->state != STATE_READ) {
+        return 0;
+    }
+
+    DB_PRINT_L(1, "READ 0x%" PRIx32 " len=%" PRIu32 "\n", s->cur_addr, len);
+    while (done < len) {
+        uint32_t n = MIN(len - done, s->size - s->cur_addr);
+
+        memcpy(buf + done, s->storage + s->cur_addr, n);
+        s->cur_addr = (s->cur_addr + n) & (s->size - 1);
+        done += n;
+    }
+    return len;
+}
+
 static void m25p80_class_init(ObjectClass *klass, void *data)
 {
     DeviceClass *dc = DEVICE_CLASS(klass);
@@ -1552,6 +1685,7 @@ static void m25p80_class_init(ObjectClass *klass, void *data)
     k->realize = m25p80_realize;
     k->transfer = m25p80_transfer8;
     k->set_cs = m25p80_cs;
+    k->read_bulk = m25p80_read_bulk;
     k->cs_polarity = SSI_CS_LOW;
     dc->vmsd = &vmstate_m25p80;
     dc->props = m25p80_properties;
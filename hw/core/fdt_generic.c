@@ -52,20 +52,47 @@ typedef struct TableListNode {
     void *opaque;
 } TableListNode;
 
-/* add a node to the table specified by *head_p */
+/*
+ * Registrations are kept in a list for dumping and indexed by key for
+ * lookups. The index is built on the first lookup, registrations
+ * normally all happen from constructors before that.
+ */
+typedef struct FDTInitTable {
+    TableListNode *head;
+    GHashTable *index;
+} FDTInitTable;
+
+/* add a node to the table specified by *table */
 
 static void add_to_table(
         FDTInitFn fdt_init,
         const char *key,
         void *opaque,
-        TableListNode **head_p)
+        FDTInitTable *table)
 {
     TableListNode *nn = malloc(sizeof(*nn));
-    nn->next = *head_p;
+    nn->next = table->head;
     strcpy(nn->key, key);
     nn->fdt_init = fdt_init;
     nn->opaque = opaque;
-    *head_p = nn;
+    table->head = nn;
+
+    /* Later registrations take precedence, like in the list.  */
+    if (table->index) {
+        g_hash_table_insert(table->index, nn->key, nn);
+    }
+}
+
+static void fdt_init_table_index(FDTInitTable *table)
+{
+    TableListNode *iter;
+
+    table->index = g_hash_table_new(g_str_hash, g_str_equal);
+    for (iter = table->head; iter != NULL; iter = iter->next) {
+        if (!g_hash_table_contains(table->index, iter->key)) {
+            g_hash_table_insert(table->index, iter->key, iter);
+        }
+    }
 }
 
 /* FIXME: add return codes that differentiate between not found and error */
@@ -78,45 +105,47 @@ static int fdt_init_search_table(
         char *node_path,
         FDTMachineInfo *fdti,
         const char *key, /* string to match */
-        TableListNode **head) /* head of the list to search */
+        FDTInitTable *table) /* table to search */
 {
     TableListNode *iter;
 
-    for (iter = *head; iter != NULL; iter = iter->next) {
-        if (!strcmp(key, iter->key)) {
-            if (iter->fdt_init) {
-                return iter->fdt_init(node_path, fdti, iter->opaque);
-            }
-            return 0;
-        }
+    if (!table->index) {
+        fdt_init_table_index(table);
     }
 
-    return 1;
+    iter = g_hash_table_lookup(table->index, key);
+    if (!iter) {
+        return 1;
+    }
+    if (iter->fdt_init) {
+        return iter->fdt_init(node_path, fdti, iter->opaque);
+    }
+    return 0;
 }
 
-TableListNode *compat_list_head;
+static FDTInitTable compat_table;
 
 void add_to_compat_table(FDTInitFn fdt_init, const char *compat, void *opaque)
 {
-    add_to_table(fdt_init, compat, opaque, &compat_list_head);
+    add_to_table(fdt_init, compat, opaque, &compat_table);
 }
 
 int fdt_init_compat(char *node_path, FDTMachineInfo *fdti, const char *compat)
 {
-    return fdt_init_search_table(node_path, fdti, compat, &compat_list_head);
+    return fdt_init_search_table(node_path, fdti, compat, &compat_table);
 }
 
-TableListNode *inst_bind_list_head;
+static FDTInitTable inst_bind_table;
 
 void add_to_inst_bind_table(FDTInitFn fdt_init, const char *name, void *opaque)
 {
-    add_to_table(fdt_init, name, opaque, &inst_bind_list_head);
+    add_to_table(fdt_init, name, opaque, &inst_bind_table);
 }
 
 int fdt_init_inst_bind(char *node_path, FDTMachineInfo *fdti,
         const char *name)
 {
-    return fdt_init_search_table(node_path, fdti, name, &inst_bind_list_head);
+    return fdt_init_search_table(node_path, fdti, name, &inst_bind_table);
 }
 
 static void dump_table(TableListNode *head)
@@ -131,13 +160,13 @@ static void dump_table(TableListNode *head)
 void dump_compat_table(void)
 {
     printf("FDT COMPATIBILITY TABLE:\n");
-    dump_table(compat_list_head);
+    dump_table(compat_table.head);
 }
 
 void dump_inst_bind_table(void)
 {
     printf("FDT INSTANCE BINDING TABLE:\n");
-    dump_table(inst_bind_list_head);
+    dump_table(inst_bind_table.head);
 }
 
 void fdt_init_yield(FDTMachineInfo *fdti)
@@ -152,25 +181,19 @@ void fdt_init_yield(FDTMachineInfo *fdti)
 
 void fdt_init_set_opaque(FDTMachineInfo *fdti, char *node_path, void *opaque)
 {
-    FDTDevOpaque *dp;
-    for (dp = fdti->dev_opaques;
-        dp->node_path && strcmp(dp->node_path, node_path);
-        dp++);
-    if (!dp->node_path) {
-        dp->node_path = strdup(node_path);
+    FDTDevOpaque *dp = g_hash_table_lookup(fdti->dev_opaque_index, node_path);
+
+    if (!dp) {
+        dp = &fdti->dev_opaques[fdti->nr_dev_opaques++];
+        dp->node_path = g_strdup(node_path);
+        g_hash_table_insert(fdti->dev_opaque_index, dp->node_path, dp);
     }
     dp->opaque = opaque;
 }
 
 int fdt_init_has_opaque(FDTMachineInfo *fdti, char *node_path)
 {
-    FDTDevOpaque *dp;
-    for (dp = fdti->dev_opaques; dp->node_path; dp++) {
-        if (!strcmp(dp->node_path, node_path)) {
-            return 1;
-         }
-    }
-    return 0;
+    return g_hash_table_contains(fdti->dev_opaque_index, node_path);
 }
 
 static void *fdt_init_add_cpu_cluster(FDTMachineInfo *fdti, char *compat)
@@ -212,13 +235,9 @@ void *fdt_init_get_cpu_cluster(FDTMachineInfo *fdti, char *compat)
 
 void *fdt_init_get_opaque(FDTMachineInfo *fdti, char *node_path)
 {
-    FDTDevOpaque *dp;
-    for (dp = fdti->dev_opaques; dp->node_path; dp++) {
-        if (!strcmp(dp->node_path, node_path)) {
-            return dp->opaque;
-        }
-    }
-    return NULL;
+    FDTDevOpaque *dp = g_hash_table_lookup(fdti->dev_opaque_index, node_path);
+
+    return dp ? dp->opaque : NULL;
 }
 
 FDTMachineInfo *fdt_init_new_fdti(void *fdt)
@@ -229,6 +248,7 @@ FDTMachineInfo *fdt_init_new_fdti(void *fdt)
     qemu_co_queue_init(fdti->cq);
     fdti->dev_opaques = g_malloc0(sizeof(*(fdti->dev_opaques)) *
         (devtree_get_num_nodes(fdt) + 1));
+    fdti->dev_opaque_index = g_hash_table_new(g_str_hash, g_str_equal);
     return fdti;
 }
 
@@ -246,6 +266,7 @@ void fdt_init_destroy_fdti(FDTMachineInfo *fdti)
     for (dp = fdti->dev_opaques; dp->node_path; dp++) {
         g_free(dp->node_path);
     }
+    g_hash_table_destroy(fdti->dev_opaque_index);
     g_free(fdti->dev_opaques);
     g_free(fdti);
 }
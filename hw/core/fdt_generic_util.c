@@ -47,6 +47,7 @@
 #include "hw/boards.h"
 #include "qemu/option.h"
 #include "hw/qdev-properties.h"
+#include "qemu-version.h"
 
 #ifndef FDT_GENERIC_UTIL_ERR_DEBUG
 #define FDT_GENERIC_UTIL_ERR_DEBUG 3
@@ -75,7 +76,7 @@
 
 int fdt_serial_ports;
 
-static int simple_bus_fdt_init(char *bus_node_path, FDTMachineInfo *fdti);
+static void fdt_init_all_nodes(FDTMachineInfo *fdti);
 
 static void fdt_get_irq_info_from_intc(FDTMachineInfo *fdti, qemu_irq *ret,
                                        char *intc_node_path,
@@ -202,8 +203,7 @@ FDTMachineInfo *fdt_generic_create_machine(void *fdt, qemu_irq *cpu_irq)
     if (!qemu_devtree_get_root_node(fdt, node_path)) {
         memory_region_transaction_begin();
         fdt_init_set_opaque(fdti, node_path, NULL);
-        simple_bus_fdt_init(node_path, fdti);
-        while (qemu_co_enter_next(fdti->cq, NULL));
+        fdt_init_all_nodes(fdti);
         fdt_init_cpu_clusters(fdti);
         fdt_init_all_irqs(fdti);
         memory_region_transaction_commit();
@@ -246,8 +246,6 @@ static void fdt_init_node(void *args)
     FDTMachineInfo *fdti = a->fdti;
     g_free(a);
 
-    simple_bus_fdt_init(node_path, fdti);
-
     char *all_compats = NULL, *node_name;
     char *device_type = NULL;
     int compat_len;
@@ -330,31 +328,6 @@ exit:
     return;
 }
 
-static int simple_bus_fdt_init(char *node_path, FDTMachineInfo *fdti)
-{
-    int i;
-    int num_children = qemu_devtree_get_num_children(fdti->fdt, node_path,
-                                                        1);
-    char **children;
-
-    if (num_children == 0) {
-        return 0;
-    }
-    children = qemu_devtree_get_children(fdti->fdt, node_path, 1);
-
-    DB_PRINT_NP(num_children ? 0 : 1, "num child devices: %d\n", num_children);
-
-    for (i = 0; i < num_children; i++) {
-        struct FDTInitNodeArgs *init_args = g_malloc0(sizeof(*init_args));
-        init_args->node_path = children[i];
-        init_args->fdti = fdti;
-        qemu_coroutine_enter(qemu_coroutine_create(fdt_init_node, init_args));
-    }
-
-    g_free(children);
-    return 0;
-}
-
 static qemu_irq fdt_get_gpio(FDTMachineInfo *fdti, char *node_path,
                              int* cur_cell, qemu_irq input,
                              const FDTGenericGPIOSet *gpio_set,
@@ -929,49 +902,83 @@ static void fdt_attach_drive(FDTMachineInfo *fdti, char *node_path,
     return;
 }
 
-static Object *fdt_create_from_compat(const char *compat, char **dev_type)
+static char *fdt_compat_resolve_type(const char *compat)
 {
-    Object *ret = NULL;
     char *c = g_strdup(compat);
+    const char *no_vendor;
 
-    /* Try to create the object */
-    ret = object_new(c);
+    /* Try the string as is */
+    if (object_class_by_name(c)) {
+        return c;
+    }
 
-    if (!ret) {
-        /* Trim the version off the end and try again */
-        trim_version(c);
-        ret = object_new(c);
+    /* Trim the version off the end and try again */
+    trim_version(c);
+    if (object_class_by_name(c)) {
+        return c;
+    }
 
-        if (!ret) {
-            /* Replace commas with full stops */
-            substitute_char(c, ',', '.');
-            ret = object_new(c);
-        }
+    /* Replace commas with full stops */
+    substitute_char(c, ',', '.');
+    if (object_class_by_name(c)) {
+        return c;
     }
 
-    if (!ret) {
-        /* Restart with the orginal string and now replace commas with full stops
-         * and try again. This means that versions are still included.
-         */
-        g_free(c);
-        c = g_strdup(compat);
-        substitute_char(c, ',', '.');
-        ret = object_new(c);
+    /* Restart with the orginal string and now replace commas with full stops
+     * and try again. This means that versions are still included.
+     */
+    g_free(c);
+    c = g_strdup(compat);
+    substitute_char(c, ',', '.');
+    if (object_class_by_name(c)) {
+        return c;
+    }
+    g_free(c);
+
+    no_vendor = trim_vendor(compat);
+    if (no_vendor != compat) {
+        return fdt_compat_resolve_type(no_vendor);
     }
+    return NULL;
+}
+
+/*
+ * compatible string -> QOM type name, NULL for strings that don't map
+ * onto any type. Large DTBs use a handful of distinct compatibles over
+ * thousands of nodes, so resolve each one only once.
+ */
+static GHashTable *fdt_compat_types;
+
+/*
+ * Map a compatible string onto the name of the QOM type it instantiates,
+ * or NULL if there is none. The caller frees the result.
+ */
+static char *fdt_compat_type_name(const char *compat)
+{
+    gpointer type;
+
+    if (!fdt_compat_types) {
+        fdt_compat_types = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                                 g_free, g_free);
+    }
+
+    if (!g_hash_table_lookup_extended(fdt_compat_types, compat, NULL, &type)) {
+        type = fdt_compat_resolve_type(compat);
+        g_hash_table_insert(fdt_compat_types, g_strdup(compat), type);
+    }
+    return g_strdup(type);
+}
+
+static Object *fdt_create_from_compat(const char *compat, char **dev_type)
+{
+    char *c = fdt_compat_type_name(compat);
+    Object *ret = c ? object_new(c) : NULL;
 
     if (dev_type) {
         *dev_type = c;
     } else {
         g_free(c);
     }
-
-    if (!ret) {
-        const char *no_vendor = trim_vendor(compat);
-
-        if (no_vendor != compat) {
-            return fdt_create_from_compat(no_vendor, dev_type);
-        }
-    }
     return ret;
 }
 
@@ -1010,6 +1017,595 @@ static const int fdt_generic_reg_cells_defaults[] = {
     0,
 };
 
+/*
+ * Instantiation order.
+ *
+ * Rather than starting every node and letting those with unmet
+ * dependencies yield and get polled over and over, build the dependency
+ * graph up front from the properties that reference other nodes and
+ * start the nodes in topological order. Ties are broken by DT order, so
+ * independent nodes (UARTs picking up serial_hd() etc) keep their order.
+ * CPUs and what they depend on go first so fdt_generic_num_cpus is final
+ * before interrupt controllers get realized.
+ *
+ * References we don't know about (link properties etc) still work, the
+ * node just yields in fdt_init_yield until its dependency shows up.
+ */
+typedef struct FDTGraphNode {
+    char *node_path;
+    int offset;
+    int parent;
+    uint32_t irq_parent;
+    GArray *deps;
+    GArray *dependents;
+    unsigned int pending;
+    bool early;
+} FDTGraphNode;
+
+typedef struct FDTGraph {
+    void *fdt;
+    FDTGraphNode *nodes;
+    int nr_nodes;
+    /* phandle -> node index + 1 */
+    GHashTable *phandles;
+} FDTGraph;
+
+static int fdt_graph_lookup(FDTGraph *g, uint32_t phandle)
+{
+    return GPOINTER_TO_INT(g_hash_table_lookup(g->phandles,
+                                               GUINT_TO_POINTER(phandle))) - 1;
+}
+
+static uint32_t fdt_graph_cell(FDTGraph *g, int idx, const char *name,
+                               int cell, uint32_t dflt)
+{
+    const fdt32_t *v;
+    int len;
+
+    v = fdt_getprop(g->fdt, g->nodes[idx].offset, name, &len);
+    if (!v || len < (cell + 1) * 4) {
+        return dflt;
+    }
+    return fdt32_to_cpu(v[cell]);
+}
+
+static void fdt_graph_add_dep(FDTGraph *g, int idx, int dep)
+{
+    if (dep < 0 || dep == idx) {
+        return;
+    }
+    g_array_append_val(g->nodes[idx].deps, dep);
+    g_array_append_val(g->nodes[dep].dependents, idx);
+    g->nodes[idx].pending++;
+}
+
+/*
+ * Add a dependency for every phandle in a <phandle cells...> list. The
+ * number of cells following each phandle is taken from the target.
+ */
+static void fdt_graph_add_phandle_list(FDTGraph *g, int idx, const char *name,
+                                       const char * const *cells_names,
+                                       const int *cells_defaults,
+                                       int nr_cells_names)
+{
+    const fdt32_t *v;
+    int len, cell, i;
+
+    v = fdt_getprop(g->fdt, g->nodes[idx].offset, name, &len);
+    if (!v) {
+        return;
+    }
+    len /= 4;
+
+    for (cell = 0; cell < len;) {
+        int target = fdt_graph_lookup(g, fdt32_to_cpu(v[cell++]));
+
+        if (target < 0) {
+            return;
+        }
+        fdt_graph_add_dep(g, idx, target);
+        for (i = 0; i < nr_cells_names; i++) {
+            cell += fdt_graph_cell(g, target, cells_names[i], 0,
+                                   cells_defaults[i]);
+        }
+    }
+}
+
+static bool fdt_graph_is_cpu(FDTGraph *g, int idx)
+{
+    const char *props[] = { "compatible", "device_type" };
+    bool is_cpu = false;
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(props); i++) {
+        const char *compat, *end;
+        int len;
+
+        compat = fdt_getprop(g->fdt, g->nodes[idx].offset, props[i], &len);
+        if (!compat) {
+            continue;
+        }
+        for (end = compat + len; compat < end; compat += strlen(compat) + 1) {
+            char *type = fdt_compat_type_name(compat);
+
+            if (type) {
+                is_cpu = object_class_dynamic_cast(object_class_by_name(type),
+                                                   TYPE_CPU);
+                g_free(type);
+                return is_cpu;
+            }
+        }
+    }
+    return false;
+}
+
+static void fdt_graph_mark_early(FDTGraph *g, int idx)
+{
+    FDTGraphNode *n = &g->nodes[idx];
+    int i;
+
+    if (n->early) {
+        return;
+    }
+    n->early = true;
+    for (i = 0; i < n->deps->len; i++) {
+        fdt_graph_mark_early(g, g_array_index(n->deps, int, i));
+    }
+}
+
+static void fdt_graph_build(FDTGraph *g, void *fdt)
+{
+    static const char * const irq_cells[] = { "#interrupt-cells" };
+    static const int irq_cells_defaults[] = { 1 };
+    GArray *nodes = g_array_new(false, true, sizeof(FDTGraphNode));
+    GArray *stack = g_array_new(false, false, sizeof(int));
+    const fdt32_t *root_irq_parent;
+    int offset, depth = 0;
+    uint32_t ph;
+    int i, j;
+
+    g->fdt = fdt;
+    g->phandles = g_hash_table_new(NULL, NULL);
+    root_irq_parent = fdt_getprop(fdt, 0, "interrupt-parent", NULL);
+
+    /* Pre-order walk of everything below the root.  */
+    for (offset = fdt_next_node(fdt, 0, &depth); offset >= 0 && depth > 0;
+         offset = fdt_next_node(fdt, offset, &depth)) {
+        FDTGraphNode n = {
+            .offset = offset,
+            .parent = depth > 1 ? g_array_index(stack, int, depth - 2) : -1,
+            .deps = g_array_new(false, false, sizeof(int)),
+            .dependents = g_array_new(false, false, sizeof(int)),
+        };
+        const fdt32_t *irq_parent;
+        uint32_t phandle;
+        int idx = nodes->len;
+
+        g_array_set_size(stack, depth);
+        g_array_index(stack, int, depth - 1) = idx;
+
+        n.node_path = g_malloc0(DT_PATH_LENGTH);
+        fdt_get_path(fdt, offset, n.node_path, DT_PATH_LENGTH);
+
+        irq_parent = fdt_getprop(fdt, offset, "interrupt-parent", NULL);
+        if (irq_parent) {
+            n.irq_parent = fdt32_to_cpu(*irq_parent);
+        } else if (n.parent >= 0) {
+            n.irq_parent = g_array_index(nodes, FDTGraphNode,
+                                         n.parent).irq_parent;
+        } else if (root_irq_parent) {
+            n.irq_parent = fdt32_to_cpu(*root_irq_parent);
+        }
+
+        phandle = fdt_get_phandle(fdt, offset);
+        if (phandle) {
+            g_hash_table_insert(g->phandles, GUINT_TO_POINTER(phandle),
+                                GINT_TO_POINTER(idx + 1));
+        }
+        g_array_append_val(nodes, n);
+    }
+    g_array_free(stack, true);
+
+    g->nr_nodes = nodes->len;
+    g->nodes = (FDTGraphNode *) g_array_free(nodes, false);
+
+    for (i = 0; i < g->nr_nodes; i++) {
+        FDTGraphNode *n = &g->nodes[i];
+
+        fdt_graph_add_dep(g, i, n->parent);
+        if (n->irq_parent && fdt_getprop(fdt, n->offset, "interrupts", NULL)) {
+            fdt_graph_add_dep(g, i, fdt_graph_lookup(g, n->irq_parent));
+        }
+        fdt_graph_add_phandle_list(g, i, "interrupts-extended", irq_cells,
+                                   irq_cells_defaults, 1);
+        fdt_graph_add_phandle_list(g, i, "reg-extended",
+                                   fdt_generic_reg_size_prop_names,
+                                   fdt_generic_reg_cells_defaults,
+                                   FDT_GENERIC_REG_TUPLE_LENGTH);
+        /* <adaptor-phandle channel> pairs.  */
+        for (j = 0; (ph = fdt_graph_cell(g, i, "remote-ports", j, 0)); j += 2) {
+            fdt_graph_add_dep(g, i, fdt_graph_lookup(g, ph));
+        }
+    }
+
+    for (i = 0; i < g->nr_nodes; i++) {
+        if (fdt_graph_is_cpu(g, i)) {
+            fdt_graph_mark_early(g, i);
+        }
+    }
+}
+
+static void fdt_graph_free(FDTGraph *g)
+{
+    int i;
+
+    for (i = 0; i < g->nr_nodes; i++) {
+        g_array_free(g->nodes[i].deps, true);
+        g_array_free(g->nodes[i].dependents, true);
+    }
+    g_free(g->nodes);
+    g_hash_table_destroy(g->phandles);
+}
+
+/* Binary min-heap of node indexes, keyed on (!early, DT order).  */
+static inline int fdt_graph_key(FDTGraph *g, int idx)
+{
+    return g->nodes[idx].early ? idx : idx + g->nr_nodes;
+}
+
+static void fdt_graph_heap_push(FDTGraph *g, int *heap, int *len, int idx)
+{
+    int key = fdt_graph_key(g, idx);
+    int pos = (*len)++;
+
+    while (pos && fdt_graph_key(g, heap[(pos - 1) / 2]) > key) {
+        heap[pos] = heap[(pos - 1) / 2];
+        pos = (pos - 1) / 2;
+    }
+    heap[pos] = idx;
+}
+
+static int fdt_graph_heap_pop(FDTGraph *g, int *heap, int *len)
+{
+    int top = heap[0];
+    int last = heap[--(*len)];
+    int key = fdt_graph_key(g, last);
+    int pos = 0;
+
+    for (;;) {
+        int child = 2 * pos + 1;
+
+        if (child >= *len) {
+            break;
+        }
+        if (child + 1 < *len && fdt_graph_key(g, heap[child + 1])
+                                < fdt_graph_key(g, heap[child])) {
+            child++;
+        }
+        if (key <= fdt_graph_key(g, heap[child])) {
+            break;
+        }
+        heap[pos] = heap[child];
+        pos = child;
+    }
+    heap[pos] = last;
+    return top;
+}
+
+/*
+ * Fill order[] with a topological order of the graph. Nodes caught in
+ * dependency cycles are appended in DT order, they'll sort themselves
+ * out by yielding.
+ */
+static void fdt_graph_sort(FDTGraph *g, int *order)
+{
+    int *heap = g_new(int, g->nr_nodes);
+    bool *done = g_new0(bool, g->nr_nodes);
+    int heap_len = 0, nr = 0;
+    int i;
+
+    for (i = 0; i < g->nr_nodes; i++) {
+        if (!g->nodes[i].pending) {
+            fdt_graph_heap_push(g, heap, &heap_len, i);
+        }
+    }
+
+    while (heap_len) {
+        int idx = fdt_graph_heap_pop(g, heap, &heap_len);
+        GArray *dependents = g->nodes[idx].dependents;
+
+        order[nr++] = idx;
+        done[idx] = true;
+        for (i = 0; i < dependents->len; i++) {
+            int d = g_array_index(dependents, int, i);
+
+            if (!--g->nodes[d].pending) {
+                fdt_graph_heap_push(g, heap, &heap_len, d);
+            }
+        }
+    }
+
+    if (nr < g->nr_nodes) {
+        DB_PRINT(0, "%d nodes in dependency cycles\n", g->nr_nodes - nr);
+        for (i = 0; i < g->nr_nodes; i++) {
+            if (!done[i]) {
+                order[nr++] = i;
+            }
+        }
+    }
+
+    g_free(done);
+    g_free(heap);
+}
+
+/*
+ * Topological order of all nodes below the root, as a NULL terminated
+ * vector of node paths.
+ */
+static char **fdt_init_order(void *fdt)
+{
+    FDTGraph g;
+    char **paths;
+    int *order;
+    int i;
+
+    fdt_graph_build(&g, fdt);
+    order = g_new(int, g.nr_nodes);
+    fdt_graph_sort(&g, order);
+
+    paths = g_new0(char *, g.nr_nodes + 1);
+    for (i = 0; i < g.nr_nodes; i++) {
+        paths[i] = g.nodes[order[i]].node_path;
+    }
+
+    g_free(order);
+    fdt_graph_free(&g);
+    return paths;
+}
+
+/*
+ * Machine cache.
+ *
+ * What we work out before instantiating anything, the instantiation
+ * order and the compatible -> QOM type mapping, only depends on the DTB
+ * and on the QEMU binary. With -machine hw-dtb-cache=DIR it gets saved
+ * to DIR/<sha256>.fdtc after the first boot of a DTB and loaded back on
+ * the following ones, skipping the graph walk and type resolution.
+ * Creating, configuring and wiring the devices still runs off the DTB,
+ * the init handlers have side effects that can't be replayed from a file.
+ *
+ * The file is host endian, it's a local cache and not an interchange
+ * format. Anything that doesn't parse is ignored and gets rewritten.
+ */
+#define FDT_CACHE_MAGIC     0x43544446 /* "FDTC" */
+#define FDT_CACHE_VERSION   2
+
+/*
+ * Followed by nr_nodes node paths in instantiation order and nr_compats
+ * (compatible, type) pairs. Strings are a u32 length followed by the
+ * bytes. Only compatibles that resolved to a type are stored, a miss
+ * gets looked up again on the next boot.
+ */
+typedef struct FDTCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t nr_nodes;
+    uint32_t nr_compats;
+} FDTCacheHeader;
+
+static char *fdt_cache_file(void *fdt)
+{
+    const char *dir = current_machine->hw_dtb_cache;
+    GChecksum *sum;
+    struct stat st;
+    uint64_t id[2];
+    char *file;
+
+    if (!dir) {
+        return NULL;
+    }
+
+    /*
+     * Type names depend on the binary as much as on the DTB. A rebuild
+     * doesn't have to bump the version, so go by the executable itself.
+     */
+    if (stat("/proc/self/exe", &st) < 0) {
+        warn_report_once("FDT: can't identify the QEMU binary, "
+                         "machine cache disabled");
+        return NULL;
+    }
+    id[0] = st.st_size;
+    id[1] = st.st_mtime;
+
+    sum = g_checksum_new(G_CHECKSUM_SHA256);
+    g_checksum_update(sum, (const guchar *) QEMU_FULL_VERSION, -1);
+    g_checksum_update(sum, (const guchar *) id, sizeof(id));
+    g_checksum_update(sum, fdt, fdt_totalsize(fdt));
+    file = g_strdup_printf("%s/%s.fdtc", dir, g_checksum_get_string(sum));
+    g_checksum_free(sum);
+    return file;
+}
+
+static void fdt_cache_put_str(GByteArray *b, const char *s)
+{
+    uint32_t len = s ? strlen(s) : 0;
+
+    g_byte_array_append(b, (const guint8 *) &len, sizeof(len));
+    if (len) {
+        g_byte_array_append(b, (const guint8 *) s, len);
+    }
+}
+
+static bool fdt_cache_get_str(const char **p, const char *end, char **s)
+{
+    uint32_t len;
+
+    if (end - *p < sizeof(len)) {
+        return false;
+    }
+    memcpy(&len, *p, sizeof(len));
+    *p += sizeof(len);
+    if (len > end - *p) {
+        return false;
+    }
+    *s = len ? g_strndup(*p, len) : NULL;
+    *p += len;
+    return true;
+}
+
+/*
+ * Load the instantiation order from a cache file and seed the compatible
+ * type mapping with its entries. Returns NULL on a miss.
+ */
+static char **fdt_cache_load(const char *file)
+{
+    FDTCacheHeader hdr;
+    GHashTable *types = NULL;
+    GHashTableIter iter;
+    gpointer compat, type;
+    char **paths = NULL;
+    const char *p, *end;
+    char *buf;
+    gsize len;
+    int i;
+
+    if (!g_file_get_contents(file, &buf, &len, NULL)) {
+        return NULL;
+    }
+
+    if (len < sizeof(hdr)) {
+        goto bad;
+    }
+    memcpy(&hdr, buf, sizeof(hdr));
+    p = buf + sizeof(hdr);
+    end = buf + len;
+    /* Every entry takes at least one length word.  */
+    if (hdr.magic != FDT_CACHE_MAGIC || hdr.version != FDT_CACHE_VERSION ||
+        hdr.nr_nodes > (end - p) / sizeof(uint32_t) ||
+        hdr.nr_compats > (end - p) / sizeof(uint32_t)) {
+        goto bad;
+    }
+
+    paths = g_new0(char *, hdr.nr_nodes + 1);
+    for (i = 0; i < hdr.nr_nodes; i++) {
+        if (!fdt_cache_get_str(&p, end, &paths[i]) || !paths[i]) {
+            goto bad;
+        }
+    }
+
+    types = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+    for (i = 0; i < hdr.nr_compats; i++) {
+        char *c, *t;
+
+        if (!fdt_cache_get_str(&p, end, &c) || !c) {
+            goto bad;
+        }
+        if (!fdt_cache_get_str(&p, end, &t)) {
+            g_free(c);
+            goto bad;
+        }
+        g_hash_table_insert(types, c, t);
+        /* Be careful with builds that dropped a type.  */
+        if (!t || !object_class_by_name(t)) {
+            goto bad;
+        }
+    }
+    if (p != end) {
+        goto bad;
+    }
+
+    if (!fdt_compat_types) {
+        fdt_compat_types = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                                 g_free, g_free);
+    }
+    g_hash_table_iter_init(&iter, types);
+    while (g_hash_table_iter_next(&iter, &compat, &type)) {
+        g_hash_table_iter_steal(&iter);
+        g_hash_table_replace(fdt_compat_types, compat, type);
+    }
+    g_hash_table_destroy(types);
+    g_free(buf);
+    DB_PRINT(0, "FDT: machine cache hit %s\n", file);
+    return paths;
+
+bad:
+    warn_report("FDT: ignoring stale machine cache %s", file);
+    if (types) {
+        g_hash_table_destroy(types);
+    }
+    g_strfreev(paths);
+    g_free(buf);
+    return NULL;
+}
+
+static void fdt_cache_save(const char *file, char **paths)
+{
+    FDTCacheHeader hdr = {
+        .magic = FDT_CACHE_MAGIC,
+        .version = FDT_CACHE_VERSION,
+        .nr_nodes = g_strv_length(paths),
+    };
+    GByteArray *b = g_byte_array_new();
+    GHashTableIter iter;
+    gpointer compat, type;
+    GError *err = NULL;
+    int i;
+
+    g_byte_array_append(b, (const guint8 *) &hdr, sizeof(hdr));
+    for (i = 0; paths[i]; i++) {
+        fdt_cache_put_str(b, paths[i]);
+    }
+    if (fdt_compat_types) {
+        g_hash_table_iter_init(&iter, fdt_compat_types);
+        while (g_hash_table_iter_next(&iter, &compat, &type)) {
+            /* Don't pin misses, a later build may have the type.  */
+            if (!type) {
+                continue;
+            }
+            fdt_cache_put_str(b, compat);
+            fdt_cache_put_str(b, type);
+            hdr.nr_compats++;
+        }
+    }
+    memcpy(b->data, &hdr, sizeof(hdr));
+
+    /* Goes through a temporary file, concurrent boots are fine.  */
+    if (!g_file_set_contents(file, (const gchar *) b->data, b->len, &err)) {
+        warn_report("FDT: unable to write machine cache: %s", err->message);
+        g_error_free(err);
+    }
+    g_byte_array_free(b, true);
+}
+
+static void fdt_init_all_nodes(FDTMachineInfo *fdti)
+{
+    /* Hash the DTB before the init handlers start editing it.  */
+    char *cache = fdt_cache_file(fdti->fdt);
+    char **order = cache ? fdt_cache_load(cache) : NULL;
+    bool cached = order != NULL;
+    int i;
+
+    if (!order) {
+        order = fdt_init_order(fdti->fdt);
+    }
+
+    for (i = 0; order[i]; i++) {
+        struct FDTInitNodeArgs *init_args = g_malloc0(sizeof(*init_args));
+
+        /* fdt_init_node takes ownership of the path.  */
+        init_args->node_path = g_strdup(order[i]);
+        init_args->fdti = fdti;
+        qemu_coroutine_enter(qemu_coroutine_create(fdt_init_node, init_args));
+    }
+    while (qemu_co_enter_next(fdti->cq, NULL));
+
+    if (cache && !cached) {
+        fdt_cache_save(cache, order);
+    }
+    g_strfreev(order);
+    g_free(cache);
+}
+
 /*
  * Error handler for device creation failure.
  *
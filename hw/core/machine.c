@@ -327,6 +327,22 @@ static void machine_set_hw_dtb(Object *obj, const char *value, Error **errp)
     ms->hw_dtb = g_strdup(value);
 }
 
+static char *machine_get_hw_dtb_cache(Object *obj, Error **errp)
+{
+    MachineState *ms = MACHINE(obj);
+
+    return g_strdup(ms->hw_dtb_cache);
+}
+
+static void machine_set_hw_dtb_cache(Object *obj, const char *value,
+                                     Error **errp)
+{
+    MachineState *ms = MACHINE(obj);
+
+    g_free(ms->hw_dtb_cache);
+    ms->hw_dtb_cache = g_strdup(value);
+}
+
 static char *machine_get_dumpdtb(Object *obj, Error **errp)
 {
     MachineState *ms = MACHINE(obj);
@@ -971,6 +987,12 @@ static void machine_initfn(Object *obj)
     object_property_set_description(obj, "hw-dtb",
                                     "A device tree used to describe the hardware to QEMU.",
                                     NULL);
+    object_property_add_str(obj, "hw-dtb-cache",
+                            machine_get_hw_dtb_cache, machine_set_hw_dtb_cache,
+                            NULL);
+    object_property_set_description(obj, "hw-dtb-cache",
+                                    "Directory caching what was derived from the hw-dtb",
+                                    NULL);
     object_property_add_bool(obj, "linux",
                              machine_get_linux, machine_set_linux, NULL);
     object_property_set_description(obj, "linux",
@@ -1015,6 +1037,7 @@ static void machine_finalize(Object *obj)
     g_free(ms->initrd_filename);
     g_free(ms->kernel_cmdline);
     g_free(ms->dtb);
+    g_free(ms->hw_dtb_cache);
     g_free(ms->dumpdtb);
     g_free(ms->dt_compatible);
     g_free(ms->firmware);
@@ -0,0 +1,134 @@
+/*
+ * QEMU remote port packet log for record and replay.
+ *
+ * Copyright (c) 2020 Xilinx Inc.
+ *
+ * This code is licensed under the GNU GPL.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/thread.h"
+#include "qemu/bswap.h"
+#include "qemu/iov.h"
+#include "qapi/error.h"
+
+#include "hw/remote-port-log.h"
+
+RemotePortLog *rp_log_open(const char *path, bool replay,
+                           uint32_t nr_channels, Error **errp)
+{
+    struct rp_log_hdr hdr;
+    RemotePortLog *log;
+    FILE *f;
+
+    f = fopen(path, replay ? "rb" : "wb");
+    if (!f) {
+        error_setg_errno(errp, errno, "Unable to open %s", path);
+        return NULL;
+    }
+
+    if (replay) {
+        if (fread(&hdr, sizeof hdr, 1, f) != 1
+            || le32_to_cpu(hdr.magic) != RP_LOG_MAGIC
+            || le32_to_cpu(hdr.version) != RP_LOG_VERSION) {
+            error_setg(errp, "%s is not a remote-port log (v%u)", path,
+                       RP_LOG_VERSION);
+            fclose(f);
+            return NULL;
+        }
+        if (le32_to_cpu(hdr.nr_channels) != nr_channels) {
+            error_setg(errp, "%s was recorded with %u channels, not %u",
+                       path, le32_to_cpu(hdr.nr_channels), nr_channels);
+            fclose(f);
+            return NULL;
+        }
+    } else {
+        memset(&hdr, 0, sizeof hdr);
+        hdr.magic = cpu_to_le32(RP_LOG_MAGIC);
+        hdr.version = cpu_to_le32(RP_LOG_VERSION);
+        hdr.nr_channels = cpu_to_le32(nr_channels);
+        if (fwrite(&hdr, sizeof hdr, 1, f) != 1) {
+            error_setg_errno(errp, errno, "Unable to write %s", path);
+            fclose(f);
+            return NULL;
+        }
+    }
+
+    log = g_new0(RemotePortLog, 1);
+    log->f = f;
+    log->path = g_strdup(path);
+    log->replay = replay;
+    log->nr_channels = nr_channels;
+    qemu_mutex_init(&log->lock);
+    return log;
+}
+
+void rp_log_write(RemotePortLog *log, int64_t clk, uint32_t channel,
+                  const struct iovec *iov, int iovcnt)
+{
+    struct rp_log_rec rec;
+    int i;
+
+    assert(!log->replay);
+
+    rec.clk = cpu_to_le64(clk);
+    rec.channel = cpu_to_le32(channel);
+    rec.len = cpu_to_le32(iov_size(iov, iovcnt));
+
+    /*
+     * stdio gathers the pieces, flush once per record so that the log
+     * survives a crash or kill of QEMU up to the last packet.
+     */
+    qemu_mutex_lock(&log->lock);
+    if (!log->f) {
+        /* Closed at exit while a channel thread was still running.  */
+        qemu_mutex_unlock(&log->lock);
+        return;
+    }
+    fwrite(&rec, sizeof rec, 1, log->f);
+    for (i = 0; i < iovcnt; i++) {
+        if (iov[i].iov_len) {
+            fwrite(iov[i].iov_base, iov[i].iov_len, 1, log->f);
+        }
+    }
+    fflush(log->f);
+    qemu_mutex_unlock(&log->lock);
+}
+
+bool rp_log_next(RemotePortLog *log, int64_t *clk, uint32_t *channel)
+{
+    struct rp_log_rec rec;
+
+    assert(log->replay);
+
+    if (fread(&rec, sizeof rec, 1, log->f) != 1) {
+        return false;
+    }
+
+    *clk = le64_to_cpu(rec.clk);
+    *channel = le32_to_cpu(rec.channel);
+    if (*channel >= log->nr_channels) {
+        return false;
+    }
+    return true;
+}
+
+ssize_t rp_log_read(RemotePortLog *log, void *buf, size_t count)
+{
+    assert(log->replay);
+
+    if (fread(buf, count, 1, log->f) != 1) {
+        return 0;
+    }
+    return count;
+}
+
+void rp_log_close(RemotePortLog *log)
+{
+    qemu_mutex_lock(&log->lock);
+    if (log->f) {
+        fclose(log->f);
+        log->f = NULL;
+    }
+    qemu_mutex_unlock(&log->lock);
+}
@@ -15,6 +15,7 @@
 #include "hw/sysbus.h"
 #include "migration/vmstate.h"
 #include "hw/qdev-properties.h"
+#include "sysemu/hostmem.h"
 
 #include "hw/remote-port-proto.h"
 #include "hw/remote-port.h"
@@ -50,6 +51,8 @@ typedef struct RemotePortMap {
     RemotePortMemoryMaster *parent;
     MemoryRegion iomem;
     uint64_t offset;
+    /* Offset into the shared memdev, if any.  */
+    uint64_t ram_offset;
 } RemotePortMap;
 
 struct RemotePortMemoryMaster {
@@ -58,6 +61,9 @@ struct RemotePortMemoryMaster {
 
     MemoryRegionOps *rp_ops;
     RemotePortMap *mmaps;
+    unsigned int nr_mmaps;
+    /* Amount of the shared memdev handed out to maps.  */
+    uint64_t memdev_used;
 
     /* public */
     uint32_t map_num;
@@ -66,6 +72,14 @@ struct RemotePortMemoryMaster {
     uint32_t rp_dev;
     bool relative;
     uint32_t max_access_size;
+    /* Max number of writes in flight without waiting. 0 to disable.  */
+    uint32_t posted_writes;
+    /*
+     * Optional memory backend shared with the peer. When set, the maps
+     * are plain RAM carved out of it and remote-port only carries
+     * coherence notifications for them.
+     */
+    HostMemoryBackend *memdev;
     struct RemotePort *rp;
     struct rp_peer_state *peer;
 };
@@ -118,12 +132,26 @@ static void rp_io_access(MemoryTransaction *tr)
     len += tr->rw ? tr->size : 0;
 
     rp_rsp_mutex_lock(s->rp);
+
+    if (tr->rw && s->posted_writes) {
+        /*
+         * Posted write. Make room in the window and let the response be
+         * retired by the protocol thread whenever it arrives.
+         */
+        rp_dev_drain_posted(s->rp, in.dev, s->posted_writes - 1);
+        rp_dev_post_resp(s->rp, in.dev, in.id);
+        rp_write(s->rp, (void *) &pay, len);
+        rp_rsp_mutex_unlock(s->rp);
+        rp_leave_iothread(s->rp);
+        return;
+    }
+
     rp_write(s->rp, (void *) &pay, len);
 
     rsp_slot = rp_dev_wait_resp(s->rp, in.dev, in.id);
     rsp = &rsp_slot->rsp;
 
-    /* We dont support out of order answers yet.  */
+    /* Slots are matched by id, so responses may come back in any order.  */
     assert(rsp->pkt->hdr.id == in.id);
 
     if (!tr->rw) {
@@ -140,6 +168,11 @@ static void rp_io_access(MemoryTransaction *tr)
 
     rclk = rsp->pkt->busaccess.timestamp;
     rp_resp_slot_done(s->rp, rsp_slot);
+    /*
+     * Non-posted accesses are ordering points. The peer handles our
+     * packets in order so by now most posted writes have been answered.
+     */
+    rp_dev_drain_posted(s->rp, in.dev, 0);
     rp_rsp_mutex_unlock(s->rp);
     rp_sync_vmclock(s->rp, in.clk, rclk);
     /* Reads are sync-points, roll the sync timer.  */
@@ -155,9 +188,83 @@ static const MemoryRegionOps rp_ops_template = {
     .endianness = DEVICE_LITTLE_ENDIAN,
 };
 
+static void rp_memory_master_init_map(RemotePortMemoryMaster *s,
+                                      RemotePortMap *map, uint64_t offset,
+                                      uint64_t size, Error **errp)
+{
+    char *name = g_strdup_printf("rp-%td", map - s->mmaps);
+
+    map->parent = s;
+    map->offset = offset;
+
+    if (s->memdev) {
+        MemoryRegion *ram = host_memory_backend_get_memory(s->memdev);
+
+        if (size > memory_region_size(ram) - s->memdev_used) {
+            error_setg(errp, "%s: memdev too small for %s",
+                       TYPE_REMOTE_PORT_MEMORY_MASTER, name);
+            g_free(name);
+            return;
+        }
+        /* Direct RAM for TCG, no round-trips to the peer.  */
+        map->ram_offset = s->memdev_used;
+        memory_region_init_alias(&map->iomem, OBJECT(s), name, ram,
+                                 map->ram_offset, size);
+        s->memdev_used += size;
+    } else {
+        memory_region_init_io(&map->iomem, OBJECT(s), s->rp_ops, map, name,
+                              size);
+    }
+    sysbus_init_mmio(SYS_BUS_DEVICE(s), &map->iomem);
+    g_free(name);
+}
+
+/* Coherence notification from the peer, see CAP_SHARED_MEMORY.  */
+static void rp_memory_master_notify(RemotePortDevice *dev, struct rp_pkt *pkt)
+{
+    RemotePortMemoryMaster *s = REMOTE_PORT_MEMORY_MASTER(dev);
+    struct rp_encode_busaccess_in in;
+    struct rp_pkt_busaccess_ext_base rsp;
+    uint64_t addr = pkt->busaccess.addr;
+    uint64_t len = pkt->busaccess.len;
+    size_t enclen;
+    int i;
+
+    if (!(pkt->busaccess.attributes & RP_BUS_ATTR_NOTIFY) || !s->memdev) {
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: unexpected write from peer\n",
+                      TYPE_REMOTE_PORT_MEMORY_MASTER);
+    } else {
+        for (i = 0; i < s->nr_mmaps; i++) {
+            RemotePortMap *map = &s->mmaps[i];
+            uint64_t base = s->relative ? 0 : map->offset;
+            uint64_t size = memory_region_size(&map->iomem);
+
+            if (addr >= base && addr - base < size) {
+                DB_PRINT_L(0, "notify addr: %" PRIx64 " len: %" PRIx64 "\n",
+                           addr, len);
+                memory_region_flush_ram(
+                    host_memory_backend_get_memory(s->memdev),
+                    map->ram_offset + addr - base,
+                    MIN(len, size - (addr - base)));
+                break;
+            }
+        }
+    }
+
+    if (pkt->hdr.flags & RP_PKT_FLAGS_posted) {
+        return;
+    }
+
+    rp_encode_busaccess_in_rsp_init(&in, pkt);
+    in.clk = pkt->busaccess.timestamp;
+    enclen = rp_encode_busaccess(s->peer, &rsp, &in);
+    rp_write(s->rp, (void *) &rsp, enclen);
+}
+
 static void rp_memory_master_realize(DeviceState *dev, Error **errp)
 {
     RemotePortMemoryMaster *s = REMOTE_PORT_MEMORY_MASTER(dev);
+    Error *err = NULL;
     int i;
 
     /* Sanity check max access size.  */
@@ -174,9 +281,40 @@ static void rp_memory_master_realize(DeviceState *dev, Error **errp)
         return;
     }
 
+    /* Always leave one response slot free for non-posted accesses.  */
+    if (s->posted_writes >= RP_MAX_OUTSTANDING_TRANSACTIONS) {
+        error_setg(errp, "%s: posted-writes %d too large! MAX is %d",
+                   TYPE_REMOTE_PORT_MEMORY_MASTER, s->posted_writes,
+                   RP_MAX_OUTSTANDING_TRANSACTIONS - 1);
+        return;
+    }
+
     assert(s->rp);
     s->peer = rp_get_peer(s->rp);
 
+    if (s->memdev) {
+        if (!s->memdev->share) {
+            error_setg(errp, "%s: memdev must be created with share=on",
+                       TYPE_REMOTE_PORT_MEMORY_MASTER);
+            return;
+        }
+        if (host_memory_backend_is_mapped(s->memdev)) {
+            error_setg(errp, "%s: memdev is already in use",
+                       TYPE_REMOTE_PORT_MEMORY_MASTER);
+            return;
+        }
+        /*
+         * The peer must know to notify us about its stores. The adaptor
+         * checks for that at hello time, which may already have passed.
+         */
+        if (!s->rp->shared_memory) {
+            error_setg(errp, "%s: memdev needs shared-memory=on on the"
+                       " remote-port adaptor", TYPE_REMOTE_PORT_MEMORY_MASTER);
+            return;
+        }
+        host_memory_backend_set_mapped(s->memdev, true);
+    }
+
     /* Create a single static region if configuration says so.  */
     if (s->map_num) {
         /* Initialize rp_ops from template.  */
@@ -185,15 +323,14 @@ static void rp_memory_master_realize(DeviceState *dev, Error **errp)
         s->rp_ops->valid.max_access_size = s->max_access_size;
 
         s->mmaps = g_new0(typeof(*s->mmaps), s->map_num);
+        s->nr_mmaps = s->map_num;
         for (i = 0; i < s->map_num; ++i) {
-            char *name = g_strdup_printf("rp-%d", i);
-
-            s->mmaps[i].offset = s->map_offset;
-            memory_region_init_io(&s->mmaps[i].iomem, OBJECT(dev), s->rp_ops,
-                                  &s->mmaps[i], name, s->map_size);
-            sysbus_init_mmio(SYS_BUS_DEVICE(dev), &s->mmaps[i].iomem);
-            s->mmaps[i].parent = s;
-            g_free(name);
+            rp_memory_master_init_map(s, &s->mmaps[i], s->map_offset,
+                                      s->map_size, &err);
+            if (err) {
+                error_propagate(errp, err);
+                return;
+            }
         }
     }
 }
@@ -206,6 +343,11 @@ static void rp_memory_master_init(Object *obj)
                              qdev_prop_allow_set_link_before_realize,
                              OBJ_PROP_LINK_STRONG,
                              &error_abort);
+    object_property_add_link(obj, "memdev", TYPE_MEMORY_BACKEND,
+                             (Object **)&rpms->memdev,
+                             qdev_prop_allow_set_link_before_realize,
+                             OBJ_PROP_LINK_STRONG,
+                             &error_abort);
 }
 
 static bool rp_parse_reg(FDTGenericMMap *obj, FDTGenericRegPropInfo reg,
@@ -222,15 +364,15 @@ static bool rp_parse_reg(FDTGenericMMap *obj, FDTGenericRegPropInfo reg,
     s->rp_ops->valid.max_access_size = s->max_access_size;
 
     s->mmaps = g_new0(typeof(*s->mmaps), reg.n);
+    s->nr_mmaps = reg.n;
     for (i = 0; i < reg.n; ++i) {
-        char *name = g_strdup_printf("rp-%d", i);
-
-        s->mmaps[i].offset = reg.a[i];
-        memory_region_init_io(&s->mmaps[i].iomem, OBJECT(obj), s->rp_ops,
-                              &s->mmaps[i], name, reg.s[i]);
-        sysbus_init_mmio(SYS_BUS_DEVICE(obj), &s->mmaps[i].iomem);
-        s->mmaps[i].parent = s;
-        g_free(name);
+        Error *err = NULL;
+
+        rp_memory_master_init_map(s, &s->mmaps[i], reg.a[i], reg.s[i], &err);
+        if (err) {
+            error_propagate(errp, err);
+            return false;
+        }
     }
 
     return parent_fmc ? parent_fmc->parse_reg(obj, reg, errp) : false;
@@ -244,14 +386,18 @@ static Property rp_properties[] = {
     DEFINE_PROP_BOOL("relative", RemotePortMemoryMaster, relative, false),
     DEFINE_PROP_UINT32("max-access-size", RemotePortMemoryMaster,
                        max_access_size, RP_MAX_ACCESS_SIZE),
+    DEFINE_PROP_UINT32("posted-writes", RemotePortMemoryMaster,
+                       posted_writes, 0),
     DEFINE_PROP_END_OF_LIST()
 };
 
 static void rp_memory_master_class_init(ObjectClass *oc, void *data)
 {
     FDTGenericMMapClass *fmc = FDT_GENERIC_MMAP_CLASS(oc);
+    RemotePortDeviceClass *rpdc = REMOTE_PORT_DEVICE_CLASS(oc);
     DeviceClass *dc = DEVICE_CLASS(oc);
     dc->props = rp_properties;
+    rpdc->ops[RP_CMD_write] = rp_memory_master_notify;
     dc->realize = rp_memory_master_realize;
     fmc->parse_reg = rp_parse_reg;
 }
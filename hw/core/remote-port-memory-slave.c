@@ -36,22 +36,47 @@
     } \
 } while (0);
 
+/* Map a MemTxResult to the RP_RESP_* status we send back.  */
+static unsigned int rp_memtx_to_resp(MemTxResult r)
+{
+    if (r == MEMTX_OK) {
+        return RP_RESP_OK;
+    }
+    if (r & MEMTX_DECODE_ERROR) {
+        return RP_RESP_ADDR_ERROR;
+    }
+    return RP_RESP_BUS_GENERIC_ERROR;
+}
+
+/*
+ * Like dma_memory_rw_attr() but keeps the MemTxResult, which the former
+ * squashes into a bool, so that we can report it back to the peer.
+ */
+static MemTxResult rp_slave_rw(RemotePortMemorySlave *s, uint64_t addr,
+                               void *buf, uint32_t len, DMADirection dir)
+{
+    dma_barrier(s->as, dir);
+    return address_space_rw(s->as, addr, s->attr, buf, len,
+                            dir == DMA_DIRECTION_FROM_DEVICE);
+}
+
 /* Slow path dealing with odd stuff like byte-enables.  */
-static void process_data_slow(RemotePortMemorySlave *s,
-                              struct rp_pkt *pkt,
-                              DMADirection dir,
-                              uint8_t *data, uint8_t *byte_en)
+static MemTxResult process_data_slow(RemotePortMemorySlave *s,
+                                     struct rp_pkt *pkt,
+                                     DMADirection dir,
+                                     uint8_t *data, uint8_t *byte_en)
 {
     unsigned int i;
     unsigned int byte_en_len = pkt->busaccess_ext_base.byte_enable_len;
+    MemTxResult r = MEMTX_OK;
 
     for (i = 0; i < pkt->busaccess.len; i++) {
         if (byte_en && !byte_en[i % byte_en_len]) {
             continue;
         }
-        dma_memory_rw_attr(s->as, pkt->busaccess.addr + i, data + i,
-                           1, dir, s->attr);
+        r |= rp_slave_rw(s, pkt->busaccess.addr + i, data + i, 1, dir);
     }
+    return r;
 }
 
 static void rp_cmd_rw(RemotePortMemorySlave *s, struct rp_pkt *pkt,
@@ -63,6 +88,7 @@ static void rp_cmd_rw(RemotePortMemorySlave *s, struct rp_pkt *pkt,
     int64_t delay;
     uint8_t *data = NULL;
     uint8_t *byte_en;
+    MemTxResult r;
 
     byte_en = rp_busaccess_byte_en_ptr(s->peer, &pkt->busaccess_ext_base);
 
@@ -90,10 +116,10 @@ static void rp_cmd_rw(RemotePortMemorySlave *s, struct rp_pkt *pkt,
     s->attr.requester_id = pkt->busaccess.master_id;
 
     if (byte_en) {
-        process_data_slow(s, pkt, dir, data, byte_en);
+        r = process_data_slow(s, pkt, dir, data, byte_en);
     } else {
-        dma_memory_rw_attr(s->as, pkt->busaccess.addr, data,
-                           pkt->busaccess.len, dir, s->attr);
+        r = rp_slave_rw(s, pkt->busaccess.addr, data, pkt->busaccess.len,
+                        dir);
     }
     if (dir == DMA_DIRECTION_TO_DEVICE && REMOTE_PORT_DEBUG_LEVEL > 0) {
         DB_PRINT_L(0, "address: %" PRIx64 "\n", pkt->busaccess.addr);
@@ -107,6 +133,7 @@ static void rp_cmd_rw(RemotePortMemorySlave *s, struct rp_pkt *pkt,
 
     rp_encode_busaccess_in_rsp_init(&in, pkt);
     in.clk = pkt->busaccess.timestamp + delay;
+    in.attr |= rp_memtx_to_resp(r) << RP_BUS_RESP_SHIFT;
     enclen = rp_encode_busaccess(s->peer, &s->rsp.pkt->busaccess_ext_base,
                                  &in);
     assert(enclen <= pktlen);
@@ -114,6 +141,118 @@ static void rp_cmd_rw(RemotePortMemorySlave *s, struct rp_pkt *pkt,
     rp_write(s->rp, (void *)s->rsp.pkt, enclen);
 }
 
+static void rp_cmd_batch(RemotePortMemorySlave *s, struct rp_pkt *pkt)
+{
+    struct rp_pkt_batch *batch = &pkt->batch;
+    struct rp_batch_entry *entry = rp_batch_entries(batch);
+    struct rp_batch_entry *rsp_entry;
+    uint8_t *wdata = rp_batch_dataptr(batch);
+    uint8_t *rdata;
+    uint64_t wlen = 0;
+    uint64_t rlen = 0;
+    uint64_t rsplen;
+    unsigned int status = RP_RESP_OK;
+    bool posted = pkt->hdr.flags & RP_PKT_FLAGS_posted;
+    size_t enclen;
+    unsigned int i, j, k;
+
+    assert(!(pkt->hdr.flags & RP_PKT_FLAGS_response));
+    assert(batch->entries_offset);
+
+    for (i = 0; i < batch->nr_entries; i++) {
+        if (entry[i].flags & RP_BATCH_ENTRY_WRITE) {
+            wlen += entry[i].len;
+        } else {
+            rlen += entry[i].len;
+        }
+    }
+    assert(wlen == batch->data_len);
+
+    /* The response echoes the entries, the read data follows them.  */
+    rsplen = sizeof(struct rp_pkt_batch)
+             + (uint64_t) batch->nr_entries * sizeof *entry + rlen;
+    if (rsplen > UINT32_MAX) {
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: batch reads %" PRIu64 " bytes,"
+                      " too large for a response\n",
+                      TYPE_REMOTE_PORT_MEMORY_SLAVE, rlen);
+        if (!posted) {
+            rp_dpkt_alloc(&s->rsp, sizeof(struct rp_pkt_batch));
+            enclen = rp_encode_batch(pkt->hdr.id, pkt->hdr.dev,
+                                     &s->rsp.pkt->batch, batch->timestamp,
+                                     batch->master_id,
+                                     (batch->attributes & ~RP_BUS_RESP_MASK)
+                                     | (RP_RESP_BUS_GENERIC_ERROR
+                                        << RP_BUS_RESP_SHIFT),
+                                     0, 0,
+                                     pkt->hdr.flags | RP_PKT_FLAGS_response);
+            rp_write(s->rp, (void *)s->rsp.pkt, enclen);
+        }
+        return;
+    }
+
+    rp_dpkt_alloc(&s->rsp, rsplen);
+    rsp_entry = (void *) ((uint8_t *) s->rsp.pkt + sizeof(struct rp_pkt_batch));
+    rdata = (uint8_t *) (rsp_entry + batch->nr_entries);
+
+    s->attr.secure = !!(batch->attributes & RP_BUS_ATTR_SECURE);
+    s->attr.requester_id = batch->master_id;
+
+    for (i = 0; i < batch->nr_entries; i = j) {
+        bool write = entry[i].flags & RP_BATCH_ENTRY_WRITE;
+        uint64_t addr = entry[i].addr;
+        uint32_t len = entry[i].len;
+        unsigned int resp;
+        MemTxResult r;
+
+        /*
+         * Coalesce runs of contiguous accesses in the same direction.
+         * Their data is contiguous in the packet as well, so each run
+         * becomes a single pass through the address space. A failing
+         * run reports its status on every one of its entries.
+         */
+        for (j = i + 1; j < batch->nr_entries; j++) {
+            if (!!(entry[j].flags & RP_BATCH_ENTRY_WRITE) != write
+                || entry[j].addr != addr + len
+                || (uint64_t) len + entry[j].len > UINT32_MAX) {
+                break;
+            }
+            len += entry[j].len;
+        }
+
+        DB_PRINT_L(0, "%s run address: %" PRIx64 " len: %u entries: %u\n",
+                   write ? "write" : "read", addr, len, j - i);
+        if (write) {
+            r = rp_slave_rw(s, addr, wdata, len, DMA_DIRECTION_FROM_DEVICE);
+            wdata += len;
+        } else {
+            r = rp_slave_rw(s, addr, rdata, len, DMA_DIRECTION_TO_DEVICE);
+            rdata += len;
+        }
+
+        resp = rp_memtx_to_resp(r);
+        if (status == RP_RESP_OK) {
+            status = resp;
+        }
+        for (k = i; k < j; k++) {
+            rp_encode_batch_entry(&rsp_entry[k], entry[k].addr, entry[k].len,
+                                  (entry[k].flags & ~RP_BATCH_ENTRY_RESP_MASK)
+                                  | (resp << RP_BATCH_ENTRY_RESP_SHIFT));
+        }
+    }
+
+    if (posted) {
+        return;
+    }
+
+    enclen = rp_encode_batch(pkt->hdr.id, pkt->hdr.dev, &s->rsp.pkt->batch,
+                             batch->timestamp, batch->master_id,
+                             (batch->attributes & ~RP_BUS_RESP_MASK)
+                             | (status << RP_BUS_RESP_SHIFT),
+                             batch->nr_entries, rlen,
+                             pkt->hdr.flags | RP_PKT_FLAGS_response);
+    rp_write(s->rp, (void *)s->rsp.pkt, rsplen);
+}
+
 static void rp_memory_slave_realize(DeviceState *dev, Error **errp)
 {
     RemotePortMemorySlave *s = REMOTE_PORT_MEMORY_SLAVE(dev);
@@ -141,6 +280,11 @@ static void rp_memory_slave_read(RemotePortDevice *s, struct rp_pkt *pkt)
                      DMA_DIRECTION_TO_DEVICE);
 }
 
+static void rp_memory_slave_batch(RemotePortDevice *s, struct rp_pkt *pkt)
+{
+    return rp_cmd_batch(REMOTE_PORT_MEMORY_SLAVE(s), pkt);
+}
+
 static void rp_memory_slave_init(Object *obj)
 {
     RemotePortMemorySlave *rpms = REMOTE_PORT_MEMORY_SLAVE(obj);
@@ -164,6 +308,7 @@ static void rp_memory_slave_class_init(ObjectClass *oc, void *data)
 
     rpdc->ops[RP_CMD_write] = rp_memory_slave_write;
     rpdc->ops[RP_CMD_read] = rp_memory_slave_read;
+    rpdc->ops[RP_CMD_batch] = rp_memory_slave_batch;
     dc->realize = rp_memory_slave_realize;
 }
 
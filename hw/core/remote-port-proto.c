@@ -87,6 +87,7 @@ static const char *rp_cmd_names[RP_CMD_max + 1] = {
     [RP_CMD_write] = "write",
     [RP_CMD_interrupt] = "interrupt",
     [RP_CMD_sync] = "sync",
+    [RP_CMD_batch] = "batch",
 };
 
 const char *rp_cmd_to_string(enum rp_cmd cmd)
@@ -188,6 +189,34 @@ int rp_decode_payload(struct rp_pkt *pkt)
         pkt->sync.timestamp = be64toh(pkt->interrupt.timestamp);
         used += pkt->hdr.len;
         break;
+    case RP_CMD_batch:
+        assert(pkt->hdr.len >= sizeof pkt->batch - sizeof pkt->hdr);
+        pkt->batch.timestamp = be64toh(pkt->batch.timestamp);
+        pkt->batch.attributes = be64toh(pkt->batch.attributes);
+        pkt->batch.master_id = be64toh(pkt->batch.master_id);
+        pkt->batch.nr_entries = be32toh(pkt->batch.nr_entries);
+        pkt->batch.entries_offset = be32toh(pkt->batch.entries_offset);
+        pkt->batch.data_offset = be32toh(pkt->batch.data_offset);
+        pkt->batch.data_len = be32toh(pkt->batch.data_len);
+
+        /* Do the bounds checks in 64-bit so the sums cannot wrap.  */
+        assert((uint64_t) pkt->batch.data_offset + pkt->batch.data_len
+               <= (uint64_t) pkt->hdr.len + sizeof pkt->hdr);
+        if (pkt->batch.entries_offset) {
+            struct rp_batch_entry *entry = rp_batch_entries(&pkt->batch);
+            uint32_t i;
+
+            assert((uint64_t) pkt->batch.entries_offset
+                   + (uint64_t) pkt->batch.nr_entries * sizeof *entry
+                   <= (uint64_t) pkt->hdr.len + sizeof pkt->hdr);
+            for (i = 0; i < pkt->batch.nr_entries; i++) {
+                entry[i].addr = be64toh(entry[i].addr);
+                entry[i].len = be32toh(entry[i].len);
+                entry[i].flags = be32toh(entry[i].flags);
+            }
+        }
+        used += pkt->hdr.len;
+        break;
     default:
         break;
     }
@@ -350,6 +379,30 @@ size_t rp_encode_busaccess(struct rp_peer_state *peer,
     return sizeof *pkt + ret_size;
 }
 
+size_t rp_encode_mem_notify(struct rp_peer_state *peer,
+                            struct rp_pkt_busaccess_ext_base *pkt,
+                            uint32_t id, uint32_t dev, uint32_t flags,
+                            int64_t clk, uint64_t addr, uint32_t size)
+{
+    struct rp_encode_busaccess_in in = {0};
+    size_t len;
+
+    in.cmd = RP_CMD_write;
+    in.id = id;
+    in.dev = dev;
+    in.flags = flags;
+    in.clk = clk;
+    in.addr = addr;
+    in.attr = RP_BUS_ATTR_NOTIFY;
+    in.size = size;
+    in.stream_width = size;
+    len = rp_encode_busaccess(peer, pkt, &in);
+
+    /* Unlike a write, no data follows.  */
+    pkt->hdr.len = htobe32(len - sizeof pkt->hdr);
+    return len;
+}
+
 size_t rp_encode_interrupt_f(uint32_t id, uint32_t dev,
                              struct rp_pkt_interrupt *pkt,
                              int64_t clk,
@@ -397,6 +450,36 @@ size_t rp_encode_sync_resp(uint32_t id, uint32_t dev,
     return rp_encode_sync_common(id, dev, pkt, clk, RP_PKT_FLAGS_response);
 }
 
+size_t rp_encode_batch(uint32_t id, uint32_t dev,
+                       struct rp_pkt_batch *pkt,
+                       int64_t clk, uint64_t master_id, uint64_t attr,
+                       uint32_t nr_entries, uint32_t data_len,
+                       uint32_t flags)
+{
+    uint32_t entries_offset = sizeof *pkt;
+    uint32_t data_offset = entries_offset
+                           + nr_entries * sizeof(struct rp_batch_entry);
+
+    rp_encode_hdr(&pkt->hdr, RP_CMD_batch, id, dev,
+                  data_offset + data_len - sizeof pkt->hdr, flags);
+    pkt->timestamp = htobe64(clk);
+    pkt->attributes = htobe64(attr);
+    pkt->master_id = htobe64(master_id);
+    pkt->nr_entries = htobe32(nr_entries);
+    pkt->entries_offset = htobe32(entries_offset);
+    pkt->data_offset = htobe32(data_offset);
+    pkt->data_len = htobe32(data_len);
+    return sizeof *pkt;
+}
+
+void rp_encode_batch_entry(struct rp_batch_entry *entry,
+                           uint64_t addr, uint32_t len, uint32_t flags)
+{
+    entry->addr = htobe64(addr);
+    entry->len = htobe32(len);
+    entry->flags = htobe32(flags);
+}
+
 void rp_process_caps(struct rp_peer_state *peer,
                      void *caps, size_t caps_len)
 {
@@ -419,6 +502,15 @@ void rp_process_caps(struct rp_peer_state *peer,
         case CAP_WIRE_POSTED_UPDATES:
             peer->caps.wire_posted_updates = true;
             break;
+        case CAP_BUSACCESS_BATCH:
+            peer->caps.busaccess_batch = true;
+            break;
+        case CAP_MULTI_CHANNEL:
+            peer->caps.multi_channel = true;
+            break;
+        case CAP_SHARED_MEMORY:
+            peer->caps.shared_memory = true;
+            break;
         }
     }
 }
@@ -0,0 +1,406 @@
+/*
+ * QEMU remote port shared-memory ring transport.
+ *
+ * Copyright (c) 2020 Xilinx Inc.
+ *
+ * This code is licensed under the GNU GPL.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/atomic.h"
+#include "qemu/host-utils.h"
+#include "qemu/processor.h"
+#include "qemu/iov.h"
+#include "qapi/error.h"
+
+#include "hw/remote-port-shm.h"
+
+#ifndef _WIN32
+#include <sys/mman.h>
+
+/* How often sleepers wake up to check that the other side is alive.  */
+#define RP_SHM_LIVENESS_MS      100
+
+/* Bytes of the file locked by each side while it has the rings mapped.  */
+#define RP_SHM_LOCK_CREATOR     0
+#define RP_SHM_LOCK_ATTACHER    1
+
+#ifdef CONFIG_LINUX
+#include "qemu/futex.h"
+
+static void rp_shm_futex_wait(uint32_t *f, uint32_t val, int ms)
+{
+    struct timespec ts = {
+        .tv_sec = ms / 1000,
+        .tv_nsec = (ms % 1000) * 1000000,
+    };
+
+    /* Timeouts, spurious wakeups and EINTR are all handled by the caller.  */
+    qemu_futex(f, FUTEX_WAIT, (int) val, &ts, NULL, 0);
+}
+#else
+/* Without futexes we degrade into sleepy polling.  */
+static inline void qemu_futex_wake(void *f, int n)
+{
+}
+
+static void rp_shm_futex_wait(uint32_t *f, uint32_t val, int ms)
+{
+    g_usleep(10);
+}
+#endif
+
+QEMU_BUILD_BUG_ON(sizeof(struct rp_shm_ring) != 128);
+QEMU_BUILD_BUG_ON(sizeof(struct rp_shm_hdr) > RP_SHM_HDR_SIZE);
+
+static RemotePortShm *rp_shm_map(const char *path, int fd, bool creator,
+                                 uint32_t ring_size, uint32_t poll,
+                                 Error **errp)
+{
+    RemotePortShm *shm;
+    size_t map_size = RP_SHM_HDR_SIZE + 2 * (size_t) ring_size;
+    void *p;
+
+    p = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+        error_setg_errno(errp, errno, "Unable to mmap %s", path);
+        return NULL;
+    }
+
+    shm = g_new0(RemotePortShm, 1);
+    shm->fd = fd;
+    shm->creator = creator;
+    shm->path = g_strdup(path);
+    shm->map_size = map_size;
+    shm->hdr = p;
+    shm->ring_size = ring_size;
+    shm->poll = poll;
+
+    /* ring[0] flows from the creator towards the attacher.  */
+    shm->tx = &shm->hdr->ring[creator ? 0 : 1];
+    shm->rx = &shm->hdr->ring[creator ? 1 : 0];
+    shm->tx_data = (uint8_t *) p + RP_SHM_HDR_SIZE
+                   + (creator ? 0 : ring_size);
+    shm->rx_data = (uint8_t *) p + RP_SHM_HDR_SIZE
+                   + (creator ? ring_size : 0);
+    return shm;
+}
+
+RemotePortShm *rp_shm_create(const char *path, uint32_t ring_size,
+                             uint32_t poll, Error **errp)
+{
+    RemotePortShm *shm;
+    int fd;
+
+    if (!is_power_of_2(ring_size) || ring_size < RP_SHM_MIN_RING_SIZE) {
+        error_setg(errp, "shm ring size %u must be a power of 2 and >= 4K",
+                   ring_size);
+        return NULL;
+    }
+
+    fd = qemu_open(path, O_RDWR | O_CREAT, 0600);
+    if (fd < 0) {
+        error_setg_errno(errp, errno, "Unable to create %s", path);
+        return NULL;
+    }
+
+    if (qemu_lock_fd(fd, RP_SHM_LOCK_CREATOR, 1, true) < 0) {
+        error_setg(errp, "%s is in use by another creator", path);
+        qemu_close(fd);
+        return NULL;
+    }
+
+    /* Clear any state left behind by a previous session.  */
+    if (ftruncate(fd, 0) < 0
+        || ftruncate(fd, RP_SHM_HDR_SIZE + 2 * (off_t) ring_size) < 0) {
+        error_setg_errno(errp, errno, "Unable to size %s", path);
+        qemu_close(fd);
+        return NULL;
+    }
+
+    shm = rp_shm_map(path, fd, true, ring_size, poll, errp);
+    if (!shm) {
+        qemu_close(fd);
+        return NULL;
+    }
+
+    shm->hdr->magic = RP_SHM_MAGIC;
+    shm->hdr->version = RP_SHM_VERSION;
+    shm->hdr->ring_size = ring_size;
+    /* Publish the header last, attachers spin on ready.  */
+    atomic_store_release(&shm->hdr->ready, 1);
+    return shm;
+}
+
+RemotePortShm *rp_shm_attach(const char *path, uint32_t poll, Error **errp)
+{
+    int64_t deadline = g_get_monotonic_time()
+                       + RP_SHM_ATTACH_TIMEOUT_MS * 1000;
+    struct rp_shm_hdr hdr;
+    RemotePortShm *shm;
+    struct stat st;
+    int fd;
+
+    fd = qemu_open(path, O_RDWR);
+    if (fd < 0) {
+        error_setg_errno(errp, errno, "Unable to open %s", path);
+        return NULL;
+    }
+
+    /* Wait for the creator to size and initialize the file.  */
+    for (;;) {
+        ssize_t r = pread(fd, &hdr, sizeof hdr, 0);
+
+        if (r == sizeof hdr && hdr.ready) {
+            break;
+        }
+        if (g_get_monotonic_time() > deadline) {
+            error_setg(errp, "Timed out waiting for %s to be initialized",
+                       path);
+            qemu_close(fd);
+            return NULL;
+        }
+        g_usleep(1000);
+    }
+
+    if (hdr.magic != RP_SHM_MAGIC || hdr.version != RP_SHM_VERSION) {
+        error_setg(errp, "%s is not a remote-port shm ring (v%u)", path,
+                   RP_SHM_VERSION);
+        qemu_close(fd);
+        return NULL;
+    }
+
+    /* The header comes from another process, don't trust it.  */
+    if (!is_power_of_2(hdr.ring_size) || hdr.ring_size < RP_SHM_MIN_RING_SIZE
+        || fstat(fd, &st) < 0
+        || st.st_size < RP_SHM_HDR_SIZE + 2 * (off_t) hdr.ring_size) {
+        error_setg(errp, "%s has a bad ring size %u", path, hdr.ring_size);
+        qemu_close(fd);
+        return NULL;
+    }
+
+    if (qemu_lock_fd(fd, RP_SHM_LOCK_ATTACHER, 1, true) < 0) {
+        error_setg(errp, "%s already has a peer attached", path);
+        qemu_close(fd);
+        return NULL;
+    }
+
+    shm = rp_shm_map(path, fd, false, hdr.ring_size, poll, errp);
+    if (!shm) {
+        qemu_close(fd);
+        return NULL;
+    }
+    atomic_store_release(&shm->hdr->attached, 1);
+    return shm;
+}
+
+/*
+ * Whether the other side still has the file open. Without OFD locks the
+ * check cannot tell two users within one process apart, so it is skipped.
+ */
+static bool rp_shm_peer_alive(RemotePortShm *shm)
+{
+    int byte = shm->creator ? RP_SHM_LOCK_ATTACHER : RP_SHM_LOCK_CREATOR;
+
+    if (!qemu_has_ofd_lock()) {
+        return true;
+    }
+    /* The creator may be waiting for a peer that has not shown up yet.  */
+    if (shm->creator && !atomic_load_acquire(&shm->hdr->attached)) {
+        return true;
+    }
+    return qemu_lock_fd_test(shm->fd, byte, 1, true) != 0;
+}
+
+/*
+ * Wait until *idx differs from old. waiters is the flag the other side
+ * checks before deciding to issue a futex wake, closed the flag it sets
+ * when it goes away. Returns false if the other side is gone.
+ */
+static bool rp_shm_wait(RemotePortShm *shm, uint32_t *idx, uint32_t old,
+                        uint32_t *waiters, uint32_t *closed)
+{
+    int64_t next_check = 0;
+    bool alive = true;
+    uint32_t i;
+
+    for (i = 0; i < shm->poll; i++) {
+        if (atomic_read(idx) != old) {
+            return true;
+        }
+        cpu_relax();
+    }
+
+    atomic_set(waiters, 1);
+    /* Order the waiters store against the index re-read.  */
+    smp_mb();
+    while (atomic_read(idx) == old) {
+        int64_t now = g_get_monotonic_time();
+
+        if (atomic_read(closed)) {
+            alive = false;
+            break;
+        }
+        if (now >= next_check) {
+            if (!rp_shm_peer_alive(shm)) {
+                alive = false;
+                break;
+            }
+            next_check = now + RP_SHM_LIVENESS_MS * 1000;
+        }
+        rp_shm_futex_wait(idx, old, RP_SHM_LIVENESS_MS);
+    }
+    atomic_set(waiters, 0);
+    return alive;
+}
+
+static void rp_shm_kick(uint32_t *idx, uint32_t *waiters)
+{
+    /* Order the index update against the waiters check.  */
+    smp_mb();
+    if (atomic_read(waiters)) {
+        qemu_futex_wake(idx, INT_MAX);
+    }
+}
+
+ssize_t rp_shm_read(RemotePortShm *shm, void *buf, size_t count)
+{
+    struct rp_shm_ring *r = shm->rx;
+    uint32_t mask = shm->ring_size - 1;
+    uint8_t *p = buf;
+    size_t done = 0;
+
+    while (done < count) {
+        uint32_t tail = atomic_read(&r->tail);
+        uint32_t head = atomic_load_acquire(&r->head);
+        uint32_t avail = head - tail;
+        uint32_t pos, chunk;
+
+        if (!avail) {
+            if (!rp_shm_wait(shm, &r->head, head, &r->data_waiters,
+                             &r->closed)
+                && atomic_load_acquire(&r->head) == head) {
+                return 0;
+            }
+            continue;
+        }
+
+        avail = MIN(avail, count - done);
+        pos = tail & mask;
+        chunk = MIN(avail, shm->ring_size - pos);
+        memcpy(p + done, shm->rx_data + pos, chunk);
+        memcpy(p + done + chunk, shm->rx_data, avail - chunk);
+        done += avail;
+
+        atomic_store_release(&r->tail, tail + avail);
+        rp_shm_kick(&r->tail, &r->space_waiters);
+    }
+    return count;
+}
+
+ssize_t rp_shm_writev(RemotePortShm *shm, const struct iovec *iov,
+                      int iovcnt)
+{
+    struct rp_shm_ring *r = shm->tx;
+    uint32_t mask = shm->ring_size - 1;
+    uint32_t head = atomic_read(&r->head);
+    size_t count = iov_size(iov, iovcnt);
+    size_t done = 0;
+    size_t iov_off = 0;
+
+    /*
+     * Gather the vector straight into the ring and only publish head
+     * when the ring fills up or everything has been copied, so the
+     * consumer sees (and gets woken for) whole packets.
+     */
+    while (done < count) {
+        uint32_t tail = atomic_load_acquire(&r->tail);
+        uint32_t space = shm->ring_size - (head - tail);
+
+        if (!space) {
+            atomic_store_release(&r->head, head);
+            rp_shm_kick(&r->head, &r->data_waiters);
+            if (!rp_shm_wait(shm, &r->tail, tail, &r->space_waiters,
+                             &r->consumer_closed)) {
+                return 0;
+            }
+            continue;
+        }
+
+        while (space && done < count) {
+            const uint8_t *p = (const uint8_t *) iov->iov_base + iov_off;
+            uint32_t len = MIN(space, iov->iov_len - iov_off);
+            uint32_t pos = head & mask;
+            uint32_t chunk = MIN(len, shm->ring_size - pos);
+
+            memcpy(shm->tx_data + pos, p, chunk);
+            memcpy(shm->tx_data, p + chunk, len - chunk);
+            head += len;
+            space -= len;
+            done += len;
+            iov_off += len;
+            if (iov_off == iov->iov_len) {
+                iov++;
+                iov_off = 0;
+            }
+        }
+    }
+
+    atomic_store_release(&r->head, head);
+    rp_shm_kick(&r->head, &r->data_waiters);
+    return count;
+}
+
+ssize_t rp_shm_write(RemotePortShm *shm, const void *buf, size_t count)
+{
+    struct iovec iov = { .iov_base = (void *) buf, .iov_len = count };
+
+    return rp_shm_writev(shm, &iov, 1);
+}
+
+void rp_shm_close(RemotePortShm *shm)
+{
+    atomic_set(&shm->tx->closed, 1);
+    rp_shm_kick(&shm->tx->head, &shm->tx->data_waiters);
+    atomic_set(&shm->rx->consumer_closed, 1);
+    rp_shm_kick(&shm->rx->tail, &shm->rx->space_waiters);
+    munmap(shm->hdr, shm->map_size);
+    qemu_close(shm->fd);
+    g_free(shm->path);
+    g_free(shm);
+}
+#else
+RemotePortShm *rp_shm_create(const char *path, uint32_t ring_size,
+                             uint32_t poll, Error **errp)
+{
+    error_setg(errp, "remote-port shm transport is not supported on Windows");
+    return NULL;
+}
+
+RemotePortShm *rp_shm_attach(const char *path, uint32_t poll, Error **errp)
+{
+    error_setg(errp, "remote-port shm transport is not supported on Windows");
+    return NULL;
+}
+
+ssize_t rp_shm_read(RemotePortShm *shm, void *buf, size_t count)
+{
+    g_assert_not_reached();
+}
+
+ssize_t rp_shm_writev(RemotePortShm *shm, const struct iovec *iov,
+                      int iovcnt)
+{
+    g_assert_not_reached();
+}
+
+ssize_t rp_shm_write(RemotePortShm *shm, const void *buf, size_t count)
+{
+    g_assert_not_reached();
+}
+
+void rp_shm_close(RemotePortShm *shm)
+{
+    g_assert_not_reached();
+}
+#endif
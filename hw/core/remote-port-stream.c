@@ -57,45 +57,54 @@ struct RemotePortStream {
     StreamCanPushNotifyFn notify;
     void *notify_opaque;
 
+    /* Payload held back while the StreamSlave is busy.  */
     uint8_t *buf;
+    size_t buf_len;
+    uint32_t buf_attr;
     struct rp_pkt pkt;
+    RemotePortDynPkt rsp;
 
     bool rsp_pending;
     uint32_t current_id;
 };
 
+static void rp_stream_respond(RemotePortStream *s)
+{
+    struct rp_encode_busaccess_in in = {0};
+    size_t pktlen = sizeof(struct rp_pkt_busaccess_ext_base);
+    size_t enclen;
+    int64_t delay = 0; /* FIXME - Implement */
+
+    rp_dpkt_alloc(&s->rsp, pktlen);
+    rp_encode_busaccess_in_rsp_init(&in, &s->pkt);
+    in.clk = s->pkt.busaccess.timestamp + delay;
+    enclen = rp_encode_busaccess(rp_get_peer(s->rp),
+                                 &s->rsp.pkt->busaccess_ext_base,
+                                 &in);
+    assert(enclen <= pktlen);
+
+    rp_write(s->rp, (void *)s->rsp.pkt, enclen);
+}
+
 static void rp_stream_notify(void *opaque)
 {
     RemotePortStream *s = REMOTE_PORT_STREAM(opaque);
 
-    /* FIXME: This is completely bogus.  */
     if (s->buf && stream_can_push(s->tx_dev, rp_stream_notify, s)) {
-        RemotePortDynPkt rsp;
-        struct rp_encode_busaccess_in in = {0};
-        size_t pktlen = sizeof(struct rp_pkt_busaccess_ext_base);
-        size_t enclen;
-        int64_t delay = 0; /* FIXME - Implement */
-
-        size_t ret = stream_push(s->tx_dev, s->buf, 4, 0);
-        assert(ret == 4);
-        s->buf = NULL;
-
-        memset(&rsp, 0, sizeof(rsp));
-        rp_dpkt_alloc(&rsp, pktlen);
-        rp_encode_busaccess_in_rsp_init(&in, &s->pkt);
-        in.clk = s->pkt.busaccess.timestamp + delay;
-        enclen = rp_encode_busaccess(rp_get_peer(s->rp),
-                                     &rsp.pkt->busaccess_ext_base,
-                                     &in);
-        assert(enclen <= pktlen);
+        size_t ret = stream_push(s->tx_dev, s->buf, s->buf_len, s->buf_attr);
 
-        rp_write(s->rp, (void *)rsp.pkt, pktlen);
+        assert(ret == s->buf_len);
+        g_free(s->buf);
+        s->buf = NULL;
+        rp_stream_respond(s);
     }
 }
 
 static void rp_stream_write(RemotePortDevice *obj, struct rp_pkt *pkt)
 {
     RemotePortStream *s = REMOTE_PORT_STREAM(obj);
+    uint32_t attr;
+    uint8_t *data;
 
     assert(pkt->busaccess.width == 0);
     assert(pkt->busaccess.stream_width == pkt->busaccess.len);
@@ -112,9 +121,28 @@ static void rp_stream_write(RemotePortDevice *obj, struct rp_pkt *pkt)
         }
     } else {
         assert(!s->buf);
-        s->buf = g_memdup(pkt + 1, 4);
         s->pkt = *pkt;
-        rp_stream_notify(s);
+        data = rp_busaccess_rx_dataptr(rp_get_peer(s->rp),
+                                       &pkt->busaccess_ext_base);
+        attr = pkt->busaccess.attributes & RP_BUS_ATTR_EOP ?
+               STREAM_ATTR_EOP : 0;
+
+        if (stream_can_push(s->tx_dev, rp_stream_notify, s)) {
+            /* Hand the payload over straight from the receive buffer.  */
+            size_t ret = stream_push(s->tx_dev, data, pkt->busaccess.len,
+                                     attr);
+
+            assert(ret == pkt->busaccess.len);
+            rp_stream_respond(s);
+        } else {
+            /*
+             * The receive buffer gets recycled once we return, so keep a
+             * copy until the slave calls us back.
+             */
+            s->buf = g_memdup(data, pkt->busaccess.len);
+            s->buf_len = pkt->busaccess.len;
+            s->buf_attr = attr;
+        }
     }
 }
 
@@ -140,8 +168,12 @@ static size_t rp_stream_stream_push(StreamSlave *obj, uint8_t *buf,
     struct rp_pkt_busaccess_ext_base pkt;
     struct rp_encode_busaccess_in in = {0};
     uint64_t rp_attr = stream_attr_has_eop(attr) ? RP_BUS_ATTR_EOP : 0;
+    /* Header and payload go out as one packet, the payload is not copied. */
+    struct iovec iov[] = {
+        { .iov_base = &pkt },
+        { .iov_base = buf, .iov_len = len },
+    };
     int64_t clk;
-    int enclen;
 
     clk = rp_normalized_vmclk(s->rp);
 
@@ -152,11 +184,10 @@ static size_t rp_stream_stream_push(StreamSlave *obj, uint8_t *buf,
     in.attr = rp_attr;
     in.size = len;
     in.stream_width = s->stream_width;
-    enclen = rp_encode_busaccess(rp_get_peer(s->rp), &pkt, &in);
+    iov[0].iov_len = rp_encode_busaccess(rp_get_peer(s->rp), &pkt, &in);
 
     rp_rsp_mutex_lock(s->rp);
-    rp_write(s->rp, (void *) &pkt, enclen);
-    rp_write(s->rp, buf, len);
+    rp_writev(s->rp, iov, ARRAY_SIZE(iov));
     rsp = rp_wait_resp(s->rp);
     assert(rsp.pkt->hdr.id == be32_to_cpu(pkt.hdr.id));
     rp_dpkt_invalidate(&rsp);
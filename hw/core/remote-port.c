@@ -18,7 +18,12 @@
 #include "qemu/sockets.h"
 #include "qemu/thread.h"
 #include "qemu/log.h"
+#include "qemu/units.h"
+#include "qemu/host-utils.h"
+#include "qemu/iov.h"
 #include "qapi/error.h"
+#include "qapi/visitor.h"
+#include "qapi/qapi-commands-remote-port.h"
 #include "qemu/error-report.h"
 #include "migration/vmstate.h"
 #include "hw/qdev-properties.h"
@@ -31,6 +36,7 @@
 #include "hw/remote-port-proto.h"
 #include "hw/remote-port-device.h"
 #include "hw/remote-port.h"
+#include "trace.h"
 
 #define D(x)
 #define SYNCD(x)
@@ -71,11 +77,29 @@ static void rp_pkt_dump(const char *prefix, const char *buf, size_t len)
     qemu_hexdump(buf, stdout, prefix, len);
 }
 
-uint32_t rp_new_id(RemotePort *s)
+/* Note that transactions have crossed the boundary since the last sync.  */
+static void rp_note_activity(RemotePort *s)
+{
+    atomic_set(&s->sync.activity, true);
+}
+
+/*
+ * Ids are allocated from every protocol thread as well as the vCPUs, so
+ * they must come from here. Hellos and syncs use this directly since
+ * they don't count as activity for the adaptive sync.
+ */
+static uint32_t rp_alloc_id(RemotePort *s)
 {
     return atomic_fetch_inc(&s->current_id);
 }
 
+uint32_t rp_new_id(RemotePort *s)
+{
+    /* Every device originated transaction allocates an id.  */
+    rp_note_activity(s);
+    return rp_alloc_id(s);
+}
+
 void rp_rsp_mutex_lock(RemotePort *s)
 {
     qemu_mutex_lock(&s->rsp_mutex);
@@ -95,6 +119,21 @@ int64_t rp_normalized_vmclk(RemotePort *s)
     return clk;
 }
 
+static void rp_adapt_sync_quantum(RemotePort *s)
+{
+    if (!s->sync.adaptive) {
+        return;
+    }
+
+    if (atomic_xchg(&s->sync.activity, false)) {
+        /* Traffic crossed the boundary, tighten the window.  */
+        s->sync.quantum = MAX(s->sync.quantum / 2, s->sync.quantum_min);
+    } else {
+        /* Idle, widen the window to save round-trips.  */
+        s->sync.quantum = MIN(s->sync.quantum * 2, s->sync.quantum_max);
+    }
+}
+
 static void rp_restart_sync_timer_bare(RemotePort *s)
 {
     if (!s->do_sync) {
@@ -122,11 +161,18 @@ static void rp_fatal_error(RemotePort *s, const char *reason)
     exit(EXIT_FAILURE);
 }
 
-static ssize_t rp_recv(RemotePort *s, void *buf, size_t count)
+static ssize_t rp_recv(RemotePortChannel *ch, void *buf, size_t count)
 {
+    RemotePort *s = ch->rp;
     ssize_t r;
 
-    r = qemu_chr_fe_read_all(&s->chr, buf, count);
+    if (s->replay.log) {
+        r = rp_log_read(s->replay.log, buf, count);
+    } else if (ch->shm) {
+        r = rp_shm_read(ch->shm, buf, count);
+    } else {
+        r = qemu_chr_fe_read_all(ch->chr, buf, count);
+    }
     if (r <= 0) {
         rp_fatal_error(s, "Disconnected");
     }
@@ -136,28 +182,111 @@ static ssize_t rp_recv(RemotePort *s, void *buf, size_t count)
         rp_fatal_error(s, "Bad read");
     }
 
+    ch->stats.rx_bytes += r;
     return r;
 }
 
-ssize_t rp_write(RemotePort *s, const void *buf, size_t count)
+/* Let the replay thread know that we have sent a request.  */
+static void rp_replay_note_tx(RemotePort *s, const struct iovec *iov)
 {
-    ssize_t r;
+    const struct rp_pkt_hdr *hdr = iov[0].iov_base;
+    uint32_t id;
 
-    qemu_mutex_lock(&s->write_mutex);
-    r = qemu_chr_fe_write_all(&s->chr, buf, count);
-    qemu_mutex_unlock(&s->write_mutex);
-    assert(r == count);
+    assert(iov[0].iov_len >= sizeof *hdr);
+    if (be32_to_cpu(hdr->flags) & RP_PKT_FLAGS_response) {
+        return;
+    }
+
+    id = be32_to_cpu(hdr->id);
+    qemu_mutex_lock(&s->replay.lock);
+    s->replay.tx_id[id % ARRAY_SIZE(s->replay.tx_id)] = id;
+    qemu_cond_broadcast(&s->replay.cond);
+    qemu_mutex_unlock(&s->replay.lock);
+}
+
+static ssize_t rp_chan_writev(RemotePortChannel *ch, const struct iovec *iov,
+                              int iovcnt)
+{
+    RemotePort *s = ch->rp;
+    size_t count = iov_size(iov, iovcnt);
+    ssize_t r = 0;
+    int i;
+
+    qemu_mutex_lock(&ch->write_mutex);
+    if (s->replay.log) {
+        /* There is no peer, the log already holds its reactions.  */
+        rp_replay_note_tx(s, iov);
+        r = count;
+    } else if (ch->shm) {
+        r = rp_shm_writev(ch->shm, iov, iovcnt);
+    } else {
+        /*
+         * Chardevs have no vectored write, but holding the lock across
+         * the elements keeps the packet contiguous on the wire.
+         */
+        for (i = 0; i < iovcnt; i++) {
+            ssize_t rv;
+
+            if (!iov[i].iov_len) {
+                continue;
+            }
+            rv = qemu_chr_fe_write_all(ch->chr, iov[i].iov_base,
+                                       iov[i].iov_len);
+            if (rv <= 0) {
+                r = rv;
+                break;
+            }
+            r += rv;
+        }
+    }
+    ch->stats.tx_bytes += count;
+    qemu_mutex_unlock(&ch->write_mutex);
+    trace_remote_port_tx(s->prefix, count);
     if (r <= 0) {
-        error_report("%s: Disconnected r=%zd buf=%p count=%zd\n",
-                     s->prefix, r, buf, count);
+        error_report("%s: Disconnected r=%zd count=%zd\n",
+                     s->prefix, r, count);
         rp_fatal_error(s, "Bad write");
     }
+    assert(r == count);
     return r;
 }
 
+ssize_t rp_writev(RemotePort *s, const struct iovec *iov, int iovcnt)
+{
+    const struct rp_pkt_hdr *hdr = iov[0].iov_base;
+    uint32_t dev;
+
+    if (s->nr_channels == 1) {
+        return rp_chan_writev(&s->chan[0], iov, iovcnt);
+    }
+
+    /* Every write starts with an encoded header, route it by device.  */
+    assert(iov[0].iov_len >= sizeof *hdr);
+    dev = be32_to_cpu(hdr->dev);
+    return rp_chan_writev(&s->chan[dev % s->nr_channels], iov, iovcnt);
+}
+
+ssize_t rp_write(RemotePort *s, const void *buf, size_t count)
+{
+    struct iovec iov = { .iov_base = (void *) buf, .iov_len = count };
+
+    return rp_writev(s, &iov, 1);
+}
+
+static unsigned int rp_chan_has_work(RemotePortChannel *ch)
+{
+    unsigned int work = ch->rx_queue.wpos - ch->rx_queue.rpos;
+    return work;
+}
+
 static unsigned int rp_has_work(RemotePort *s)
 {
-    unsigned int work = s->rx_queue.wpos - s->rx_queue.rpos;
+    unsigned int work = 0;
+    unsigned int i;
+
+    for (i = 0; i < s->nr_channels; i++) {
+        work += rp_chan_has_work(&s->chan[i]);
+    }
     return work;
 }
 
@@ -165,9 +294,41 @@ void rp_leave_iothread(RemotePort *s)
 {
 }
 
+static unsigned int rp_dev_outstanding(RemotePort *s, uint32_t dev)
+{
+    unsigned int n = 0;
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(s->dev_state[dev].rsp_queue); i++) {
+        n += s->dev_state[dev].rsp_queue[i].used;
+    }
+    return n;
+}
+
+/* Account time spent blocked on the peer. dev is -1 for adaptor waits.  */
+static void rp_account_wait(RemotePort *s, int dev, uint32_t id,
+                            int64_t start)
+{
+    uint64_t ns = get_clock() - start;
+    unsigned int bucket;
+
+    s->stats.wait_ns += ns;
+    bucket = ns < 2000 ? 0 : 63 - clz64(ns / 1000);
+    bucket = MIN(bucket, RP_LAT_HIST_BUCKETS - 1);
+    s->stats.lat_hist[bucket]++;
+
+    if (dev >= 0) {
+        s->dev_state[dev].stats.transactions++;
+        s->dev_state[dev].stats.wait_ns += ns;
+    }
+    trace_remote_port_wait_resp(s->prefix, dev, id, ns);
+}
+
 /* Response handling.  */
-RemotePortRespSlot *rp_dev_wait_resp(RemotePort *s, uint32_t dev, uint32_t id)
+static RemotePortRespSlot *rp_dev_alloc_slot(RemotePort *s, uint32_t dev,
+                                             uint32_t id)
 {
+    unsigned int outstanding;
     int i;
 
     assert(s->devs[dev]);
@@ -179,7 +340,7 @@ RemotePortRespSlot *rp_dev_wait_resp(RemotePort *s, uint32_t dev, uint32_t id)
         }
     }
 
-    if (s->dev_state[dev].rsp_queue[i].used == true) {
+    if (i == ARRAY_SIZE(s->dev_state[dev].rsp_queue)) {
         error_report("Number of outstanding transactions exceeded! %d",
                       RP_MAX_OUTSTANDING_TRANSACTIONS);
         rp_fatal_error(s, "Internal error");
@@ -188,24 +349,88 @@ RemotePortRespSlot *rp_dev_wait_resp(RemotePort *s, uint32_t dev, uint32_t id)
     /* Got a slot, fill it in.  */
     s->dev_state[dev].rsp_queue[i].id = id;
     s->dev_state[dev].rsp_queue[i].valid = false;
+    s->dev_state[dev].rsp_queue[i].posted = false;
     s->dev_state[dev].rsp_queue[i].used = true;
 
-    while (!s->dev_state[dev].rsp_queue[i].valid) {
+    outstanding = rp_dev_outstanding(s, dev);
+    s->dev_state[dev].stats.max_outstanding =
+        MAX(s->dev_state[dev].stats.max_outstanding, outstanding);
+    return &s->dev_state[dev].rsp_queue[i];
+}
+
+RemotePortRespSlot *rp_dev_wait_resp(RemotePort *s, uint32_t dev, uint32_t id)
+{
+    RemotePortRespSlot *slot = rp_dev_alloc_slot(s, dev, id);
+    int64_t start = get_clock();
+
+    while (!slot->valid) {
         rp_rsp_mutex_unlock(s);
         rp_event_read(s);
         rp_rsp_mutex_lock(s);
-        if (s->dev_state[dev].rsp_queue[i].valid) {
+        if (slot->valid) {
+            break;
+        }
+        if (!rp_has_work(s)) {
+            qemu_cond_wait(&s->progress_cond, &s->rsp_mutex);
+        }
+    }
+    rp_account_wait(s, dev, id, start);
+    return slot;
+}
+
+void rp_dev_post_resp(RemotePort *s, uint32_t dev, uint32_t id)
+{
+    RemotePortRespSlot *slot = rp_dev_alloc_slot(s, dev, id);
+
+    slot->posted = true;
+    s->dev_state[dev].posted_outstanding++;
+    s->posted_outstanding++;
+}
+
+void rp_dev_drain_posted(RemotePort *s, uint32_t dev, unsigned int max)
+{
+    int64_t start = get_clock();
+
+    if (s->dev_state[dev].posted_outstanding <= max) {
+        return;
+    }
+
+    while (s->dev_state[dev].posted_outstanding > max) {
+        rp_rsp_mutex_unlock(s);
+        rp_event_read(s);
+        rp_rsp_mutex_lock(s);
+        if (s->dev_state[dev].posted_outstanding <= max) {
+            break;
+        }
+        if (!rp_has_work(s)) {
+            qemu_cond_wait(&s->progress_cond, &s->rsp_mutex);
+        }
+    }
+    start = get_clock() - start;
+    s->stats.wait_ns += start;
+    s->dev_state[dev].stats.wait_ns += start;
+}
+
+/* Wait for all posted transactions on all devices to complete.  */
+static void rp_drain_posted(RemotePort *s)
+{
+    while (s->posted_outstanding) {
+        rp_rsp_mutex_unlock(s);
+        rp_event_read(s);
+        rp_rsp_mutex_lock(s);
+        if (!s->posted_outstanding) {
             break;
         }
         if (!rp_has_work(s)) {
             qemu_cond_wait(&s->progress_cond, &s->rsp_mutex);
         }
     }
-    return &s->dev_state[dev].rsp_queue[i];
 }
 
 RemotePortDynPkt rp_wait_resp(RemotePort *s)
 {
+    int64_t start = get_clock();
+
     while (!rp_dpkt_is_valid(&s->rspqueue)) {
         rp_rsp_mutex_unlock(s);
         rp_event_read(s);
@@ -219,6 +444,7 @@ RemotePortDynPkt rp_wait_resp(RemotePort *s)
             qemu_cond_wait(&s->progress_cond, &s->rsp_mutex);
         }
     }
+    rp_account_wait(s, -1, s->rspqueue.pkt->hdr.id, start);
     return s->rspqueue;
 }
 
@@ -226,9 +452,10 @@ void rp_sync_vmclock(RemotePort *s, int64_t lclk, int64_t rclk)
 {
 }
 
-static void rp_cmd_hello(RemotePort *s, struct rp_pkt *pkt)
+static void rp_cmd_hello(RemotePortChannel *ch, struct rp_pkt *pkt)
 {
-    s->peer.version = pkt->hello.version;
+    RemotePort *s = ch->rp;
+
     if (pkt->hello.version.major != RP_VERSION_MAJOR) {
         error_report("remote-port version missmatch remote=%d.%d local=%d.%d\n",
                       pkt->hello.version.major, pkt->hello.version.minor,
@@ -236,10 +463,34 @@ static void rp_cmd_hello(RemotePort *s, struct rp_pkt *pkt)
         rp_fatal_error(s, "Bad version");
     }
 
-    if (pkt->hello.caps.len) {
-        void *caps = (char *) pkt + pkt->hello.caps.offset;
+    /* Capabilities are negotiated once, on the first channel.  */
+    if (!ch->nr) {
+        s->peer.version = pkt->hello.version;
+        if (pkt->hello.caps.len) {
+            void *caps = (char *) pkt + pkt->hello.caps.offset;
+
+            rp_process_caps(&s->peer, caps, pkt->hello.caps.len);
+        }
+
+        if (s->shared_memory && !s->peer.caps.shared_memory) {
+            rp_fatal_error(s, "Peer does not support shared memory");
+        }
+    }
+
+    if (s->nr_channels == 1) {
+        return;
+    }
 
-        rp_process_caps(&s->peer, caps, pkt->hello.caps.len);
+    if (!ch->nr && !s->peer.caps.multi_channel) {
+        rp_fatal_error(s, "Peer does not support multiple channels");
+    }
+    if (RP_HELLO_CHANNEL_NR(pkt->hdr.dev) != ch->nr
+        || RP_HELLO_CHANNEL_COUNT(pkt->hdr.dev) != s->nr_channels) {
+        error_report("%s: channel %u/%u got hello for channel %u/%u",
+                     s->prefix, ch->nr, s->nr_channels,
+                     RP_HELLO_CHANNEL_NR(pkt->hdr.dev),
+                     RP_HELLO_CHANNEL_COUNT(pkt->hdr.dev));
+        rp_fatal_error(s, "Channel mismatch");
     }
 }
 
@@ -276,24 +527,31 @@ static void rp_cmd_sync(RemotePort *s, struct rp_pkt *pkt)
     ptimer_transaction_commit(s->sync.ptimer_resp);
 }
 
-static void rp_say_hello(RemotePort *s)
+static void rp_say_hello(RemotePortChannel *ch)
 {
+    RemotePort *s = ch->rp;
     struct rp_pkt_hello pkt;
     uint32_t caps[] = {
         CAP_BUSACCESS_EXT_BASE,
         CAP_BUSACCESS_EXT_BYTE_EN,
         CAP_WIRE_POSTED_UPDATES,
+        CAP_BUSACCESS_BATCH,
+        CAP_MULTI_CHANNEL,
+        CAP_SHARED_MEMORY,
+    };
+    struct iovec iov[] = {
+        { .iov_base = &pkt },
+        { .iov_base = caps, .iov_len = sizeof caps },
     };
-    size_t len;
-
-    len = rp_encode_hello_caps(s->current_id++, 0, &pkt, RP_VERSION_MAJOR,
-                               RP_VERSION_MINOR,
-                               caps, caps, sizeof caps / sizeof caps[0]);
-    rp_write(s, (void *) &pkt, len);
 
-    if (sizeof caps) {
-        rp_write(s, caps, sizeof caps);
-    }
+    iov[0].iov_len = rp_encode_hello_caps(rp_alloc_id(s),
+                                          RP_HELLO_CHANNEL(ch->nr,
+                                                           s->nr_channels),
+                                          &pkt,
+                                          RP_VERSION_MAJOR, RP_VERSION_MINOR,
+                                          caps, caps,
+                                          sizeof caps / sizeof caps[0]);
+    rp_chan_writev(ch, iov, ARRAY_SIZE(iov));
 }
 
 static void rp_say_sync(RemotePort *s, int64_t clk)
@@ -301,7 +559,7 @@ static void rp_say_sync(RemotePort *s, int64_t clk)
     struct rp_pkt_sync pkt;
     size_t len;
 
-    len = rp_encode_sync(s->current_id++, 0, &pkt, clk);
+    len = rp_encode_sync(rp_alloc_id(s), 0, &pkt, clk);
     rp_write(s, (void *) &pkt, len);
 }
 
@@ -322,6 +580,7 @@ static void sync_timer_hit(void *opaque)
     RemotePort *s = REMOTE_PORT(opaque);
     int64_t clk;
     int64_t rclk;
+    int64_t stall;
     RemotePortDynPkt rsp;
 
     clk = rp_normalized_vmclk(s);
@@ -336,7 +595,10 @@ static void sync_timer_hit(void *opaque)
 
     /* Sync.  */
     s->sync.need_sync = false;
+    stall = get_clock();
     qemu_mutex_lock(&s->rsp_mutex);
+    /* Syncs are ordering points for posted transactions.  */
+    rp_drain_posted(s);
     /* Send the sync.  */
     rp_say_sync(s, clk);
 
@@ -346,7 +608,13 @@ static void sync_timer_hit(void *opaque)
     rp_dpkt_invalidate(&rsp);
     qemu_mutex_unlock(&s->rsp_mutex);
 
+    stall = get_clock() - stall;
+    s->sync.stats.stall_ns += stall;
+    s->sync.stats.count++;
+    trace_remote_port_sync(s->prefix, clk, rclk, stall);
+
     rp_sync_vmclock(s, clk, rclk);
+    rp_adapt_sync_quantum(s);
     rp_restart_sync_timer_bare(s);
 }
 
@@ -363,82 +631,163 @@ static char *rp_sanitize_prefix(RemotePort *s)
     return sanitized_name;
 }
 
-static char *rp_autocreate_chardesc(RemotePort *s, bool server)
+/* Channel 0 keeps the historical name, the others get a -ch<N> suffix.  */
+static char *rp_chan_suffix(RemotePortChannel *ch)
+{
+    return ch->nr ? g_strdup_printf("-ch%u", ch->nr) : g_strdup("");
+}
+
+static char *rp_autocreate_chardesc(RemotePortChannel *ch, bool server)
 {
+    RemotePort *s = ch->rp;
     char *prefix;
+    char *suffix;
     char *chardesc;
     int r;
 
     prefix = rp_sanitize_prefix(s);
-    r = asprintf(&chardesc, "unix:%s/qemu-rport-%s%s",
-                 machine_path, prefix, server ? ",wait,server" : "");
+    suffix = rp_chan_suffix(ch);
+    r = asprintf(&chardesc, "unix:%s/qemu-rport-%s%s%s",
+                 machine_path, prefix, suffix, server ? ",wait,server" : "");
     assert(r > 0);
     free(prefix);
+    g_free(suffix);
     return chardesc;
 }
 
-static Chardev *rp_autocreate_chardev(RemotePort *s, char *name)
+static Chardev *rp_autocreate_chardev(RemotePortChannel *ch, char *name)
 {
     Chardev *chr;
     char *chardesc;
 
-    chardesc = rp_autocreate_chardesc(s, false);
+    chardesc = rp_autocreate_chardesc(ch, false);
     chr = qemu_chr_new_noreplay(name, chardesc, false, NULL);
     free(chardesc);
 
     if (!chr) {
-        chardesc = rp_autocreate_chardesc(s, true);
+        chardesc = rp_autocreate_chardesc(ch, true);
         chr = qemu_chr_new_noreplay(name, chardesc, false, NULL);
         free(chardesc);
     }
     return chr;
 }
 
-static void rp_process(RemotePort *s)
+static void rp_open_shm(RemotePortChannel *ch, Error **errp)
 {
-    while (true) {
-        struct rp_pkt *pkt;
-        unsigned int rpos;
-        bool actioned = false;
-        RemotePortDevice *dev;
-        RemotePortDeviceClass *rpdc;
-
-        qemu_mutex_lock(&s->rsp_mutex);
-        if (!rp_has_work(s)) {
-            qemu_mutex_unlock(&s->rsp_mutex);
-            break;
+    RemotePort *s = ch->rp;
+    char *suffix = rp_chan_suffix(ch);
+    char *path;
+
+    if (s->shm.path) {
+        path = g_strdup_printf("%s%s", s->shm.path, suffix);
+    } else {
+        char *prefix;
+
+        if (!machine_path) {
+            error_setg(errp, "%s: Missing shm-path prop."
+                       " Forgot -machine-path?", s->prefix);
+            g_free(suffix);
+            return;
         }
-        rpos = s->rx_queue.rpos;
-        rpos &= ARRAY_SIZE(s->rx_queue.pkt) - 1;
+        prefix = rp_sanitize_prefix(s);
+        path = g_strdup_printf("%s/qemu-rport-shm-%s%s", machine_path, prefix,
+                               suffix);
+        g_free(prefix);
+    }
+
+    ch->shm = rp_shm_create(path, s->shm.size, s->shm.poll, errp);
+    g_free(suffix);
+    g_free(path);
+}
 
-        pkt = s->rx_queue.pkt[rpos].pkt;
-        D(qemu_log("%s: io-thread rpos=%d wpos=%d cmd=%d dev=%d\n",
-                 s->prefix, s->rx_queue.rpos, s->rx_queue.wpos,
-                 pkt->hdr.cmd, pkt->hdr.dev));
+/* Open the chardev of one of the extra channels.  */
+static void rp_open_chardev(RemotePortChannel *ch, Error **errp)
+{
+    RemotePort *s = ch->rp;
+    Chardev *chr;
+    char *name;
+    static int nr = 0;
 
-        /* To handle recursiveness, we need to advance the index
-         * index before processing the packet.  */
-        s->rx_queue.rpos++;
+    name = g_strdup_printf("rport-ch%d", nr++);
+    chr = rp_autocreate_chardev(ch, name);
+    g_free(name);
+    if (!chr) {
+        error_setg(errp, "%s: Unable to create remote-port channel %u",
+                   s->prefix, ch->nr);
+        return;
+    }
+
+    if (!qemu_chr_fe_init(&ch->chr_be, chr, errp)) {
+        return;
+    }
+    ch->chr = &ch->chr_be;
+    qemu_chr_fe_set_blocking(ch->chr, true);
+}
+
+/* Process one packet from a channel. Returns false if it had none.  */
+static bool rp_process_chan(RemotePortChannel *ch)
+{
+    RemotePort *s = ch->rp;
+    struct rp_pkt *pkt;
+    unsigned int rpos;
+    bool actioned = false;
+    RemotePortDevice *dev;
+    RemotePortDeviceClass *rpdc;
+
+    qemu_mutex_lock(&s->rsp_mutex);
+    if (!rp_chan_has_work(ch)) {
         qemu_mutex_unlock(&s->rsp_mutex);
-        qemu_sem_post(&s->rx_queue.sem);
-
-        dev = s->devs[pkt->hdr.dev];
-        if (dev) {
-            rpdc = REMOTE_PORT_DEVICE_GET_CLASS(dev);
-            if (rpdc->ops[pkt->hdr.cmd]) {
-                rpdc->ops[pkt->hdr.cmd](dev, pkt);
-                actioned = true;
-            }
-        }
+        return false;
+    }
+    rpos = ch->rx_queue.rpos;
+    rpos &= ARRAY_SIZE(ch->rx_queue.pkt) - 1;
 
-        switch (pkt->hdr.cmd) {
-        case RP_CMD_sync:
-            rp_cmd_sync(s, pkt);
-            break;
-        default:
-            assert(actioned);
+    pkt = ch->rx_queue.pkt[rpos].pkt;
+    D(qemu_log("%s: io-thread ch=%u rpos=%d wpos=%d cmd=%d dev=%d\n",
+             s->prefix, ch->nr, ch->rx_queue.rpos, ch->rx_queue.wpos,
+             pkt->hdr.cmd, pkt->hdr.dev));
+
+    /* To handle recursiveness, we need to advance the index
+     * index before processing the packet.  */
+    ch->rx_queue.rpos++;
+    qemu_mutex_unlock(&s->rsp_mutex);
+    qemu_sem_post(&ch->rx_queue.sem);
+
+    dev = s->devs[pkt->hdr.dev];
+    if (dev) {
+        rpdc = REMOTE_PORT_DEVICE_GET_CLASS(dev);
+        if (rpdc->ops[pkt->hdr.cmd]) {
+            rpdc->ops[pkt->hdr.cmd](dev, pkt);
+            actioned = true;
         }
     }
+
+    switch (pkt->hdr.cmd) {
+    case RP_CMD_sync:
+        rp_cmd_sync(s, pkt);
+        break;
+    default:
+        assert(actioned);
+    }
+    return true;
+}
+
+static void rp_process(RemotePort *s)
+{
+    bool progress;
+    unsigned int i;
+
+    /*
+     * Round-robin over the channels, one packet at a time, so that a
+     * long burst on one channel does not starve the others. Packets
+     * within a channel are still processed in order.
+     */
+    do {
+        progress = false;
+        for (i = 0; i < s->nr_channels; i++) {
+            progress |= rp_process_chan(&s->chan[i]);
+        }
+    } while (progress);
 }
 
 static void rp_event_read(void *opaque)
@@ -480,26 +829,28 @@ static void rp_event_notify(RemotePort *s)
 }
 
 /* Handover a pkt to CPU or IO-thread context.  */
-static void rp_pt_handover_pkt(RemotePort *s, RemotePortDynPkt *dpkt)
+static void rp_pt_handover_pkt(RemotePortChannel *ch, RemotePortDynPkt *dpkt)
 {
+    RemotePort *s = ch->rp;
+
     /* Take the rsp lock around the wpos update, otherwise
        rp_wait_resp will race with us.  */
     qemu_mutex_lock(&s->rsp_mutex);
-    s->rx_queue.wpos++;
+    ch->rx_queue.wpos++;
     smp_mb();
     rp_event_notify(s);
     qemu_cond_signal(&s->progress_cond);
     qemu_mutex_unlock(&s->rsp_mutex);
     while (1) {
-        if (qemu_sem_timedwait(&s->rx_queue.sem, 2 * 1000) == 0) {
+        if (qemu_sem_timedwait(&ch->rx_queue.sem, 2 * 1000) == 0) {
             break;
         }
 #ifndef _WIN32
         {
             int sval;
-            sem_getvalue(&s->rx_queue.sem.sem, &sval);
-            printf("semwait: %d rpos=%u wpos=%u\n", sval,
-                   s->rx_queue.rpos, s->rx_queue.wpos);
+            sem_getvalue(&ch->rx_queue.sem.sem, &sval);
+            printf("semwait: ch=%u %d rpos=%u wpos=%u\n", ch->nr, sval,
+                   ch->rx_queue.rpos, ch->rx_queue.wpos);
         }
 #endif
     }
@@ -532,14 +883,21 @@ static bool rp_pt_cmd_sync(RemotePort *s, struct rp_pkt *pkt)
     return false;
 }
 
-static void rp_pt_process_pkt(RemotePort *s, RemotePortDynPkt *dpkt)
+static void rp_pt_process_pkt(RemotePortChannel *ch, RemotePortDynPkt *dpkt)
 {
+    RemotePort *s = ch->rp;
     struct rp_pkt *pkt = dpkt->pkt;
 
     D(qemu_log("%s: cmd=%x id=%d dev=%d rsp=%d\n", __func__, pkt->hdr.cmd,
              pkt->hdr.id, pkt->hdr.dev,
              pkt->hdr.flags & RP_PKT_FLAGS_response));
 
+    if (pkt->hdr.cmd == RP_CMD_hello) {
+        /* The hello carries the channel layout in hdr.dev.  */
+        rp_cmd_hello(ch, pkt);
+        return;
+    }
+
     if (pkt->hdr.dev >= ARRAY_SIZE(s->devs)) {
         /* FIXME: Respond with an error.  */
         return;
@@ -551,7 +909,7 @@ static void rp_pt_process_pkt(RemotePort *s, RemotePortDynPkt *dpkt)
         int i;
 
         if (pkt->hdr.flags & RP_PKT_FLAGS_posted) {
-            printf("Drop response for posted packets\n");
+            /* Nobody waits for these, remote_port_rx_pkt traces them.  */
             return;
         }
 
@@ -565,7 +923,29 @@ static void rp_pt_process_pkt(RemotePort *s, RemotePortDynPkt *dpkt)
             }
         }
 
-        if (i < ARRAY_SIZE(s->dev_state[dev].rsp_queue)) {
+        if (i < ARRAY_SIZE(s->dev_state[dev].rsp_queue)
+            && s->dev_state[dev].rsp_queue[i].posted) {
+            /*
+             * Nobody is waiting for this one, retire it right away. The
+             * guest has long moved on, so all we can do about an error
+             * is to report it.
+             */
+            if (pkt->hdr.cmd == RP_CMD_write
+                && rp_busaccess_resp(&pkt->busaccess) != RP_RESP_OK) {
+                qemu_log_mask(LOG_GUEST_ERROR, "%s: posted write to dev %u"
+                              " addr 0x%" PRIx64 " len %u failed: resp %u\n",
+                              s->prefix, dev, pkt->busaccess.addr,
+                              pkt->busaccess.len,
+                              rp_busaccess_resp(&pkt->busaccess));
+            }
+            s->dev_state[dev].rsp_queue[i].id = ~0;
+            s->dev_state[dev].rsp_queue[i].posted = false;
+            s->dev_state[dev].rsp_queue[i].used = false;
+            s->dev_state[dev].posted_outstanding--;
+            s->posted_outstanding--;
+
+            qemu_cond_broadcast(&s->progress_cond);
+        } else if (i < ARRAY_SIZE(s->dev_state[dev].rsp_queue)) {
             /* Found a per device one.  */
             assert(s->dev_state[dev].rsp_queue[i].valid == false);
 
@@ -583,9 +963,6 @@ static void rp_pt_process_pkt(RemotePort *s, RemotePortDynPkt *dpkt)
     }
 
     switch (pkt->hdr.cmd) {
-    case RP_CMD_hello:
-        rp_cmd_hello(s, pkt);
-        break;
     case RP_CMD_sync:
         if (rp_pt_cmd_sync(s, pkt)) {
             return;
@@ -594,7 +971,9 @@ static void rp_pt_process_pkt(RemotePort *s, RemotePortDynPkt *dpkt)
     case RP_CMD_read:
     case RP_CMD_write:
     case RP_CMD_interrupt:
-        rp_pt_handover_pkt(s, dpkt);
+    case RP_CMD_batch:
+        rp_note_activity(s);
+        rp_pt_handover_pkt(ch, dpkt);
         break;
     default:
         assert(0);
@@ -602,12 +981,15 @@ static void rp_pt_process_pkt(RemotePort *s, RemotePortDynPkt *dpkt)
     }
 }
 
-static void rp_read_pkt(RemotePort *s, RemotePortDynPkt *dpkt)
+static void rp_read_pkt(RemotePortChannel *ch, RemotePortDynPkt *dpkt)
 {
+    RemotePort *s = ch->rp;
     struct rp_pkt *pkt = dpkt->pkt;
+    struct rp_pkt_hdr raw_hdr;
     int used;
 
-    rp_recv(s, pkt, sizeof pkt->hdr);
+    rp_recv(ch, pkt, sizeof pkt->hdr);
+    raw_hdr = pkt->hdr;
     used = rp_decode_hdr((void *) &pkt->hdr);
     assert(used == sizeof pkt->hdr);
 
@@ -615,57 +997,198 @@ static void rp_read_pkt(RemotePort *s, RemotePortDynPkt *dpkt)
         rp_dpkt_alloc(dpkt, sizeof pkt->hdr + pkt->hdr.len);
         /* pkt may move due to realloc.  */
         pkt = dpkt->pkt;
-        rp_recv(s, &pkt->hdr + 1, pkt->hdr.len);
+        rp_recv(ch, &pkt->hdr + 1, pkt->hdr.len);
+    }
+
+    if (s->record.log) {
+        /* Record the packet as it was on the wire.  */
+        struct iovec iov[] = {
+            { .iov_base = &raw_hdr, .iov_len = sizeof raw_hdr },
+            { .iov_base = &pkt->hdr + 1, .iov_len = pkt->hdr.len },
+        };
+
+        rp_log_write(s->record.log, rp_normalized_vmclk(s), ch->nr,
+                     iov, ARRAY_SIZE(iov));
+    }
+
+    if (pkt->hdr.len) {
         rp_decode_payload(pkt);
     }
+
+    if (pkt->hdr.cmd <= RP_CMD_max) {
+        if (pkt->hdr.flags & RP_PKT_FLAGS_response) {
+            ch->stats.rx_rsp[pkt->hdr.cmd]++;
+        } else {
+            ch->stats.rx_req[pkt->hdr.cmd]++;
+        }
+        trace_remote_port_rx_pkt(s->prefix, rp_cmd_to_string(pkt->hdr.cmd),
+                                 pkt->hdr.dev, pkt->hdr.id, pkt->hdr.flags,
+                                 pkt->hdr.len);
+    }
 }
 
-static void *rp_protocol_thread(void *arg)
+static void rp_chan_alloc_rx(RemotePortChannel *ch)
 {
-    RemotePort *s = REMOTE_PORT(arg);
     unsigned int i;
 
     /* Make sure we have a decent bufsize to start with.  */
-    rp_dpkt_alloc(&s->rsp, sizeof s->rsp.pkt->busaccess + 1024);
-    rp_dpkt_alloc(&s->rspqueue, sizeof s->rspqueue.pkt->busaccess + 1024);
-    for (i = 0; i < ARRAY_SIZE(s->rx_queue.pkt); i++) {
-        rp_dpkt_alloc(&s->rx_queue.pkt[i],
-                      sizeof s->rx_queue.pkt[i].pkt->busaccess + 1024);
+    for (i = 0; i < ARRAY_SIZE(ch->rx_queue.pkt); i++) {
+        rp_dpkt_alloc(&ch->rx_queue.pkt[i],
+                      sizeof ch->rx_queue.pkt[i].pkt->busaccess + 1024);
     }
+}
+
+static void *rp_protocol_thread(void *arg)
+{
+    RemotePortChannel *ch = arg;
 
-    rp_say_hello(s);
+    rp_chan_alloc_rx(ch);
+    rp_say_hello(ch);
 
     while (1) {
         RemotePortDynPkt *dpkt;
-        unsigned int wpos = s->rx_queue.wpos;
+        unsigned int wpos = ch->rx_queue.wpos;
 
-        wpos &= ARRAY_SIZE(s->rx_queue.pkt) - 1;
-        dpkt = &s->rx_queue.pkt[wpos];
+        wpos &= ARRAY_SIZE(ch->rx_queue.pkt) - 1;
+        dpkt = &ch->rx_queue.pkt[wpos];
 
-        rp_read_pkt(s, dpkt);
+        rp_read_pkt(ch, dpkt);
         if (0) {
             rp_pkt_dump("rport-pkt", (void *) dpkt->pkt,
                         sizeof dpkt->pkt->hdr + dpkt->pkt->hdr.len);
         }
-        rp_pt_process_pkt(s, dpkt);
+        rp_pt_process_pkt(ch, dpkt);
     }
     return NULL;
 }
 
+static void rp_replay_timer_hit(void *opaque)
+{
+    RemotePort *s = REMOTE_PORT(opaque);
+
+    qemu_sem_post(&s->replay.sem);
+}
+
+/* Hold back a replayed packet until the peer would have sent it.  */
+static void rp_replay_wait(RemotePort *s, int64_t clk, struct rp_pkt *pkt)
+{
+    if (pkt->hdr.flags & RP_PKT_FLAGS_response) {
+        uint32_t id = pkt->hdr.id;
+        unsigned int i = id % ARRAY_SIZE(s->replay.tx_id);
+
+        qemu_mutex_lock(&s->replay.lock);
+        while (s->replay.tx_id[i] != id) {
+            qemu_cond_wait(&s->replay.cond, &s->replay.lock);
+        }
+        qemu_mutex_unlock(&s->replay.lock);
+        return;
+    }
+
+    if (clk > rp_normalized_vmclk(s)) {
+        timer_mod(s->replay.timer, s->peer.clk_base + clk);
+        qemu_sem_wait(&s->replay.sem);
+    }
+}
+
+/* Stand-in for the protocol threads of all channels when replaying.  */
+static void *rp_replay_thread(void *arg)
+{
+    RemotePort *s = REMOTE_PORT(arg);
+    uint32_t nr;
+    int64_t clk;
+
+    for (nr = 0; nr < s->nr_channels; nr++) {
+        rp_chan_alloc_rx(&s->chan[nr]);
+    }
+
+    while (rp_log_next(s->replay.log, &clk, &nr)) {
+        RemotePortChannel *ch = &s->chan[nr];
+        RemotePortDynPkt *dpkt;
+        unsigned int wpos = ch->rx_queue.wpos;
+
+        wpos &= ARRAY_SIZE(ch->rx_queue.pkt) - 1;
+        dpkt = &ch->rx_queue.pkt[wpos];
+
+        rp_read_pkt(ch, dpkt);
+        rp_replay_wait(s, clk, dpkt->pkt);
+        rp_pt_process_pkt(ch, dpkt);
+    }
+
+    warn_report("%s: end of replay log %s", s->prefix, s->replay.path);
+    return NULL;
+}
+
+static void rp_record_exit(Notifier *n, void *data)
+{
+    RemotePort *s = container_of(n, RemotePort, record.exit);
+
+    rp_log_close(s->record.log);
+}
+
 static void rp_realize(DeviceState *dev, Error **errp)
 {
     RemotePort *s = REMOTE_PORT(dev);
+    Error *err = NULL;
+    bool use_shm = s->shm.enable || s->shm.path;
+    unsigned int i;
     int r;
 
     s->prefix = object_get_canonical_path(OBJECT(dev));
 
+    if (s->nr_channels < 1 || s->nr_channels > RP_MAX_CHANNELS) {
+        error_setg(errp, "%s: channels must be between 1 and %d", s->prefix,
+                   RP_MAX_CHANNELS);
+        return;
+    }
+
+    if (s->sync.adaptive
+        && (s->sync.quantum_min > s->sync.quantum_max
+            || !s->sync.quantum_min)) {
+        error_setg(errp, "%s: Bad adaptive sync range [%" PRIu64
+                   ", %" PRIu64 "]", s->prefix, s->sync.quantum_min,
+                   s->sync.quantum_max);
+        return;
+    }
+
     s->peer.clk_base = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
 
-    qemu_mutex_init(&s->write_mutex);
     qemu_mutex_init(&s->rsp_mutex);
     qemu_cond_init(&s->progress_cond);
 
-    if (!qemu_chr_fe_get_driver(&s->chr)) {
+    if (s->record.path && s->replay.path) {
+        error_setg(errp, "%s: record and replay are mutually exclusive",
+                   s->prefix);
+        return;
+    }
+
+    /* Extra channels derive their transport from the autocreated one.  */
+    if (s->nr_channels > 1 && !use_shm && !s->replay.path
+        && (!machine_path || s->chardesc || s->chrdev_id
+            || qemu_chr_fe_get_driver(&s->chr))) {
+        error_setg(errp, "%s: Multiple channels need -machine-path or the"
+                   " shm transport", s->prefix);
+        return;
+    }
+
+    for (i = 0; i < s->nr_channels; i++) {
+        s->chan[i].rp = s;
+        s->chan[i].nr = i;
+        qemu_mutex_init(&s->chan[i].write_mutex);
+    }
+
+    if (s->replay.path) {
+        /* No transports, the log plays the peer.  */
+        s->replay.log = rp_log_open(s->replay.path, true, s->nr_channels,
+                                    errp);
+        if (!s->replay.log) {
+            return;
+        }
+    } else if (use_shm) {
+        rp_open_shm(&s->chan[0], errp);
+        if (!s->chan[0].shm) {
+            return;
+        }
+    } else if (!qemu_chr_fe_get_driver(&s->chr)) {
         char *name;
         Chardev *chr = NULL;
         static int nr = 0;
@@ -689,7 +1212,7 @@ static void rp_realize(DeviceState *dev, Error **errp)
                              s->prefix);
                 exit(EXIT_FAILURE);
             }
-            chr = rp_autocreate_chardev(s, name);
+            chr = rp_autocreate_chardev(&s->chan[0], name);
         }
 
         free(name);
@@ -702,10 +1225,35 @@ static void rp_realize(DeviceState *dev, Error **errp)
         qdev_prop_set_chr(dev, "chardev", chr);
     }
 
-    /* Force RP sockets into blocking mode since our RP-thread will deal
-     * with the IO and bypassing QEMUs main-loop.
-     */
-    qemu_chr_fe_set_blocking(&s->chr, true);
+    if (!use_shm && !s->replay.log) {
+        /* Force RP sockets into blocking mode since our RP-thread will deal
+         * with the IO and bypassing QEMUs main-loop.
+         */
+        s->chan[0].chr = &s->chr;
+        qemu_chr_fe_set_blocking(&s->chr, true);
+    }
+
+    for (i = 1; i < s->nr_channels && !s->replay.log; i++) {
+        if (use_shm) {
+            rp_open_shm(&s->chan[i], &err);
+        } else {
+            rp_open_chardev(&s->chan[i], &err);
+        }
+        if (err) {
+            error_propagate(errp, err);
+            return;
+        }
+    }
+
+    if (s->record.path) {
+        s->record.log = rp_log_open(s->record.path, false, s->nr_channels,
+                                    errp);
+        if (!s->record.log) {
+            return;
+        }
+        s->record.exit.notify = rp_record_exit;
+        qemu_add_exit_notifier(&s->record.exit);
+    }
 
 #ifdef _WIN32
     /* Create a socket connection between two sockets. We auto-bind
@@ -782,6 +1330,11 @@ static void rp_realize(DeviceState *dev, Error **errp)
        After config negotiation with the peer, sync.quantum value might
        change.  */
     s->sync.quantum = s->peer.local_cfg.quantum;
+    if (s->sync.adaptive) {
+        s->sync.quantum = MIN(MAX(s->sync.quantum, s->sync.quantum_min),
+                              s->sync.quantum_max);
+    }
+    s->sync.stats.start_ns = get_clock();
 
     s->sync.ptimer = ptimer_init(sync_timer_hit, s, PTIMER_POLICY_DEFAULT);
     s->sync.ptimer_resp = ptimer_init(syncresp_timer_hit, s,
@@ -796,9 +1349,41 @@ static void rp_realize(DeviceState *dev, Error **errp)
     ptimer_set_freq(s->sync.ptimer_resp, 1000 * 1000 * 1000);
     ptimer_transaction_commit(s->sync.ptimer_resp);
 
-    qemu_sem_init(&s->rx_queue.sem, ARRAY_SIZE(s->rx_queue.pkt) - 1);
-    qemu_thread_create(&s->thread, "remote-port", rp_protocol_thread, s,
-                       QEMU_THREAD_JOINABLE);
+    /* Make sure we have a decent bufsize to start with.  */
+    rp_dpkt_alloc(&s->rsp, sizeof s->rsp.pkt->busaccess + 1024);
+    rp_dpkt_alloc(&s->rspqueue, sizeof s->rspqueue.pkt->busaccess + 1024);
+
+    for (i = 0; i < s->nr_channels; i++) {
+        RemotePortChannel *ch = &s->chan[i];
+        char *name;
+
+        qemu_sem_init(&ch->rx_queue.sem, ARRAY_SIZE(ch->rx_queue.pkt) - 1);
+        if (s->replay.log) {
+            /*
+             * The recording spent an id on the hello of every channel,
+             * skip them or our requests won't match the logged responses.
+             */
+            rp_alloc_id(s);
+            continue;
+        }
+
+        name = i ? g_strdup_printf("remote-port-ch%u", i)
+                 : g_strdup("remote-port");
+        qemu_thread_create(&ch->thread, name, rp_protocol_thread, ch,
+                           QEMU_THREAD_JOINABLE);
+        g_free(name);
+    }
+
+    if (s->replay.log) {
+        s->replay.timer = timer_new_ns(QEMU_CLOCK_VIRTUAL,
+                                       rp_replay_timer_hit, s);
+        qemu_sem_init(&s->replay.sem, 0);
+        qemu_mutex_init(&s->replay.lock);
+        qemu_cond_init(&s->replay.cond);
+        memset(s->replay.tx_id, 0xff, sizeof s->replay.tx_id);
+        qemu_thread_create(&s->replay.thread, "remote-port-replay",
+                           rp_replay_thread, s, QEMU_THREAD_JOINABLE);
+    }
 
     rp_restart_sync_timer(s);
 }
@@ -817,18 +1402,71 @@ static Property rp_properties[] = {
     DEFINE_PROP_CHR("chardev", RemotePort, chr),
     DEFINE_PROP_STRING("chardesc", RemotePort, chardesc),
     DEFINE_PROP_STRING("chrdev-id", RemotePort, chrdev_id),
+    DEFINE_PROP_UINT32("channels", RemotePort, nr_channels, 1),
+    DEFINE_PROP_STRING("record", RemotePort, record.path),
+    DEFINE_PROP_STRING("replay", RemotePort, replay.path),
+    DEFINE_PROP_BOOL("shm", RemotePort, shm.enable, false),
+    DEFINE_PROP_STRING("shm-path", RemotePort, shm.path),
+    DEFINE_PROP_UINT32("shm-size", RemotePort, shm.size, 1 * MiB),
+    DEFINE_PROP_UINT32("shm-poll", RemotePort, shm.poll, 0),
     DEFINE_PROP_BOOL("sync", RemotePort, do_sync, false),
     DEFINE_PROP_UINT64("sync-quantum", RemotePort, peer.local_cfg.quantum,
                        1000000),
+    DEFINE_PROP_BOOL("shared-memory", RemotePort, shared_memory, false),
+    DEFINE_PROP_BOOL("sync-adaptive", RemotePort, sync.adaptive, false),
+    DEFINE_PROP_UINT64("sync-quantum-min", RemotePort, sync.quantum_min,
+                       10000),
+    DEFINE_PROP_UINT64("sync-quantum-max", RemotePort, sync.quantum_max,
+                       100000000),
     DEFINE_PROP_END_OF_LIST(),
 };
 
+static void rp_get_sync_rate(Object *obj, Visitor *v, const char *name,
+                             void *opaque, Error **errp)
+{
+    RemotePort *s = REMOTE_PORT(obj);
+    int64_t elapsed = get_clock() - s->sync.stats.start_ns;
+    uint64_t rate = 0;
+
+    /* Syncs per second of host time since realize.  */
+    if (s->sync.stats.start_ns && elapsed > 0) {
+        rate = (double) s->sync.stats.count * NANOSECONDS_PER_SECOND
+               / elapsed;
+    }
+    visit_type_uint64(v, name, &rate, errp);
+}
+
+static void rp_get_sync_avg_stall(Object *obj, Visitor *v, const char *name,
+                                  void *opaque, Error **errp)
+{
+    RemotePort *s = REMOTE_PORT(obj);
+    uint64_t avg = 0;
+
+    if (s->sync.stats.count) {
+        avg = s->sync.stats.stall_ns / s->sync.stats.count;
+    }
+    visit_type_uint64(v, name, &avg, errp);
+}
+
 static void rp_init(Object *obj)
 {
     RemotePort *s = REMOTE_PORT(obj);
     int t;
     int i;
 
+    /* Sync statistics, readable with qom-get.  */
+    object_property_add_uint64_ptr(obj, "sync-count", &s->sync.stats.count,
+                                   &error_abort);
+    object_property_add_uint64_ptr(obj, "sync-stall-ns",
+                                   &s->sync.stats.stall_ns, &error_abort);
+    object_property_add_uint64_ptr(obj, "sync-quantum-current",
+                                   &s->sync.quantum, &error_abort);
+    object_property_add(obj, "sync-rate", "uint64", rp_get_sync_rate,
+                        NULL, NULL, NULL, &error_abort);
+    object_property_add(obj, "sync-avg-stall-ns", "uint64",
+                        rp_get_sync_avg_stall, NULL, NULL, NULL,
+                        &error_abort);
+
     for (i = 0; i < REMOTE_PORT_MAX_DEVS; ++i) {
         char *name = g_strdup_printf("remote-port-dev%d", i);
         object_property_add_link(obj, name, TYPE_REMOTE_PORT_DEVICE,
@@ -853,6 +1491,95 @@ struct rp_peer_state *rp_get_peer(RemotePort *s)
     return &s->peer;
 }
 
+static RemotePortStats *rp_get_stats(RemotePort *s)
+{
+    RemotePortStats *info = g_new0(RemotePortStats, 1);
+    uint64_t rx_req[RP_CMD_max + 1] = { 0 };
+    uint64_t rx_rsp[RP_CMD_max + 1] = { 0 };
+    unsigned int c;
+    int i;
+
+    info->path = object_get_canonical_path(OBJECT(s));
+    for (c = 0; c < s->nr_channels; c++) {
+        RemotePortChannel *ch = &s->chan[c];
+
+        info->tx_bytes += ch->stats.tx_bytes;
+        info->rx_bytes += ch->stats.rx_bytes;
+        for (i = 0; i <= RP_CMD_max; i++) {
+            rx_req[i] += ch->stats.rx_req[i];
+            rx_rsp[i] += ch->stats.rx_rsp[i];
+        }
+    }
+    info->wait_ns = s->stats.wait_ns;
+    info->sync_count = s->sync.stats.count;
+    info->sync_stall_ns = s->sync.stats.stall_ns;
+
+    for (i = RP_LAT_HIST_BUCKETS - 1; i >= 0; i--) {
+        intList *bucket = g_new0(intList, 1);
+
+        bucket->value = s->stats.lat_hist[i];
+        bucket->next = info->latency_histogram;
+        info->latency_histogram = bucket;
+    }
+
+    for (i = RP_CMD_max; i > RP_CMD_nop; i--) {
+        RemotePortCmdStatsList *cmd = g_new0(RemotePortCmdStatsList, 1);
+
+        cmd->value = g_new0(RemotePortCmdStats, 1);
+        cmd->value->cmd = g_strdup(rp_cmd_to_string(i));
+        cmd->value->rx_requests = rx_req[i];
+        cmd->value->rx_responses = rx_rsp[i];
+        cmd->next = info->commands;
+        info->commands = cmd;
+    }
+
+    qemu_mutex_lock(&s->rsp_mutex);
+    for (i = REMOTE_PORT_MAX_DEVS - 1; i >= 0; i--) {
+        RemotePortDevStatsList *dev;
+
+        if (!s->devs[i]) {
+            continue;
+        }
+
+        dev = g_new0(RemotePortDevStatsList, 1);
+        dev->value = g_new0(RemotePortDevStats, 1);
+        dev->value->dev = i;
+        dev->value->path = object_get_canonical_path(OBJECT(s->devs[i]));
+        dev->value->transactions = s->dev_state[i].stats.transactions;
+        dev->value->outstanding = rp_dev_outstanding(s, i);
+        dev->value->max_outstanding = s->dev_state[i].stats.max_outstanding;
+        dev->value->wait_ns = s->dev_state[i].stats.wait_ns;
+        dev->next = info->devices;
+        info->devices = dev;
+    }
+    qemu_mutex_unlock(&s->rsp_mutex);
+    return info;
+}
+
+static int rp_query_one(Object *obj, void *opaque)
+{
+    RemotePortStatsList **list = opaque;
+    RemotePortStatsList *entry;
+
+    if (!object_dynamic_cast(obj, TYPE_REMOTE_PORT)) {
+        return 0;
+    }
+
+    entry = g_new0(RemotePortStatsList, 1);
+    entry->value = rp_get_stats(REMOTE_PORT(obj));
+    entry->next = *list;
+    *list = entry;
+    return 0;
+}
+
+RemotePortStatsList *qmp_query_remote_port(Error **errp)
+{
+    RemotePortStatsList *list = NULL;
+
+    object_child_foreach_recursive(object_get_root(), rp_query_one, &list);
+    return list;
+}
+
 static void rp_class_init(ObjectClass *klass, void *data)
 {
     DeviceClass *dc = DEVICE_CLASS(klass);
@@ -31,6 +31,7 @@
 #include "hw/stream.h"
 #include "hw/dma-ctrl.h"
 #include "hw/ptimer.h"
+#include "hw/dma/dma-engine.h"
 #include "qemu/bitops.h"
 #include "sysemu/dma.h"
 #include "hw/register.h"
@@ -149,6 +150,7 @@ typedef struct ZynqMPCSUDMA {
     StreamSlave *tx_dev0; /* Used for pmc dma0 */
     StreamSlave *tx_dev1; /* Used for pmc dma1 */
     ptimer_state *src_timer;
+    DMAEngine engine;
 
     bool is_dst;
     uint16_t width;
@@ -284,6 +286,24 @@ static void dmach_data_process(ZynqMPCSUDMA *s, uint8_t *buf, unsigned int len)
     }
 }
 
+/* Same checksum as dmach_data_process but leaves buf untouched.  */
+static void dmach_crc(ZynqMPCSUDMA *s, const uint8_t *buf, unsigned int len)
+{
+    uint32_t crc = s->regs[R_CRC0];
+    unsigned int i;
+
+    assert((len & 3) == 0);
+    for (i = 0; i < len; i += 4) {
+        crc += ldl_he_p(buf + i);
+    }
+    s->regs[R_CRC0] = crc;
+}
+
+static bool dmach_is_bswap(ZynqMPCSUDMA *s)
+{
+    return s->regs[R_CTRL] & R_CTRL_ENDIANNESS_MASK;
+}
+
 static inline uint64_t dmach_addr(ZynqMPCSUDMA *s)
 {
     uint64_t addr;
@@ -293,23 +313,47 @@ static inline uint64_t dmach_addr(ZynqMPCSUDMA *s)
     return addr;
 }
 
-/* len is in bytes.  */
-static void dmach_write(ZynqMPCSUDMA *s, uint8_t *buf, unsigned int len)
+static void dmach_write_burst(ZynqMPCSUDMA *s, uint64_t addr,
+                              const uint8_t *buf, unsigned int len)
 {
-    uint64_t addr = dmach_addr(s);
-
-    dmach_data_process(s, buf, len);
     if (dmach_burst_is_fixed(s)) {
         unsigned int i;
 
         for (i = 0; i < len; i += s->width) {
             unsigned int wlen = MIN(len - i, s->width);
 
-            address_space_rw(s->dma_as, addr, *s->attr, buf, wlen, true);
-            buf += wlen;
+            address_space_write(s->dma_as, addr, *s->attr, buf + i, wlen);
         }
     } else {
-        address_space_rw(s->dma_as, addr, *s->attr, buf, len, true);
+        address_space_write(s->dma_as, addr, *s->attr, buf, len);
+    }
+}
+
+/* len is in bytes.  */
+static void dmach_write(ZynqMPCSUDMA *s, const uint8_t *buf, unsigned int len)
+{
+    uint64_t addr = dmach_addr(s);
+    uint8_t tmp[4 * 1024];
+    unsigned int i;
+
+    if (!dmach_is_bswap(s)) {
+        dmach_write_burst(s, addr, buf, len);
+        return;
+    }
+
+    /*
+     * buf belongs to the stream master and may well be mapped guest
+     * memory, so swap a copy rather than buf itself.
+     */
+    for (i = 0; i < len; i += sizeof tmp) {
+        unsigned int wlen = MIN(len - i, sizeof tmp);
+
+        memcpy(tmp, buf + i, wlen);
+        dmach_data_process(s, tmp, wlen);
+        dmach_write_burst(s, addr, tmp, wlen);
+        if (!dmach_burst_is_fixed(s)) {
+            addr += wlen;
+        }
     }
 }
 
@@ -332,6 +376,64 @@ static inline void dmach_read(ZynqMPCSUDMA *s, uint8_t *buf, unsigned int len)
     dmach_data_process(s, buf, len);
 }
 
+/*
+ * Bulk path for incrementing bursts out of RAM without byte swapping,
+ * which is how bitstreams and boot images get fed to PCAP, AES and
+ * SHA3. Map as much of the descriptor as is contiguous in host memory
+ * and push it downstream in one go, up to the engine budget. Returns
+ * false if the caller has to go through the bounce buffer instead, i.e
+ * for fixed bursts (FIFOs), MMIO and byte swapped transfers.
+ */
+static bool dmach_src_push_mapped(ZynqMPCSUDMA *s, int64_t *budget)
+{
+    uint32_t size = dmach_get_size(s);
+    uint64_t addr = dmach_addr(s);
+    hwaddr mlen = size;
+    hwaddr xlat;
+    MemoryRegion *mr;
+    uint32_t attr = 0;
+    uint8_t *buf;
+    size_t ret;
+
+    if (dmach_burst_is_fixed(s) || dmach_is_bswap(s)) {
+        return false;
+    }
+
+    WITH_RCU_READ_LOCK_GUARD() {
+        mr = address_space_translate(s->dma_as, addr, &xlat, &mlen, false,
+                                     *s->attr);
+        if (!memory_access_is_direct(mr, false)) {
+            return false;
+        }
+    }
+
+    mlen = MIN(size, *budget);
+    buf = address_space_map(s->dma_as, addr, &mlen, false, *s->attr);
+    if (!buf) {
+        return false;
+    }
+    if (mlen < 4) {
+        address_space_unmap(s->dma_as, buf, mlen, false, 0);
+        return false;
+    }
+
+    mlen &= ~3;
+    if (mlen == size && dmach_get_eop(s)) {
+        attr |= STREAM_ATTR_EOP;
+    }
+
+    /*
+     * Like dmach_read, checksum what was fetched rather than what the
+     * sink took, a short push can stop at any byte.
+     */
+    dmach_crc(s, buf, mlen);
+    ret = stream_push(s->tx_dev, buf, mlen, attr);
+    address_space_unmap(s->dma_as, buf, mlen, false, ret);
+    dmach_advance(s, ret);
+    *budget -= ret;
+    return true;
+}
+
 static void ronaldu_csu_dma_update_irq(ZynqMPCSUDMA *s)
 {
     qemu_set_irq(s->irq, !!(s->regs[R_INT_STATUS] & ~s->regs[R_INT_MASK]));
@@ -345,6 +447,7 @@ static void zynqmp_csu_dma_reset(DeviceState *dev)
     for (i = 0; i < R_MAX; i++) {
         register_reset(&s->regs_info[i]);
     }
+    dma_engine_cancel(&s->engine);
 }
 
 static size_t zynqmp_csu_dma_stream_push(StreamSlave *obj, uint8_t *buf,
@@ -389,9 +492,17 @@ static bool zynqmp_csu_dma_stream_can_push(StreamSlave *obj,
 }
 
 static void zynqmp_csu_dma_src_notify(void *opaque)
+{
+    ZynqMPCSUDMA *s = ZYNQMP_CSU_DMA(opaque);
+
+    dma_engine_kick(&s->engine);
+}
+
+static bool zynqmp_csu_dma_src_run(void *opaque, int64_t *budget)
 {
     ZynqMPCSUDMA *s = ZYNQMP_CSU_DMA(opaque);
     unsigned char buf[4 * 1024];
+    bool more = false;
 
     ptimer_transaction_begin(s->src_timer);
     /* Stop the backpreassure timer.  */
@@ -404,6 +515,15 @@ static void zynqmp_csu_dma_src_notify(void *opaque)
         uint32_t attr = 0;
         size_t ret;
 
+        if (*budget <= 0) {
+            more = true;
+            break;
+        }
+
+        if (dmach_src_push_mapped(s, budget)) {
+            continue;
+        }
+
         /* Did we fit it all?  */
         if (size == plen && dmach_get_eop(s)) {
             attr |= STREAM_ATTR_EOP;
@@ -413,11 +533,12 @@ static void zynqmp_csu_dma_src_notify(void *opaque)
         dmach_read(s, buf, plen);
         ret = stream_push(s->tx_dev, buf, plen, attr);
         dmach_advance(s, ret);
+        *budget -= ret;
     }
 
     /* REMOVE-ME?: Check for flow-control timeout. This is all theoretical as
        we currently never see backpreassure.  */
-    if (dmach_timeout_enabled(s) && dmach_get_size(s)
+    if (!more && dmach_timeout_enabled(s) && dmach_get_size(s)
         && !stream_can_push(s->tx_dev, zynqmp_csu_dma_src_notify, s)) {
         unsigned int timeout = ARRAY_FIELD_EX32(s->regs, CTRL, TIMEOUT_VAL);
         unsigned int div = extract32(s->regs[R_CTRL2], 4, 12) + 1;
@@ -430,6 +551,13 @@ static void zynqmp_csu_dma_src_notify(void *opaque)
     }
 
     ptimer_transaction_commit(s->src_timer);
+    return more;
+}
+
+static void zynqmp_csu_dma_src_done(void *opaque)
+{
+    ZynqMPCSUDMA *s = ZYNQMP_CSU_DMA(opaque);
+
     ronaldu_csu_dma_update_irq(s);
 }
 
@@ -551,6 +679,8 @@ zynqmp_csu_dma_dma_ctrl_read(DmaCtrl *dma_ctrl, hwaddr addr, uint32_t len,
     if (start_dma) {
         register_write(reg, len, we, object_get_typename(OBJECT(s)),
                        ZYNQMP_CSU_DMA_ERR_DEBUG);
+        /* The controller driving us expects the data to have moved.  */
+        dma_engine_flush(&s->engine);
     } else {
         dmach_set_size(s, len);
     }
@@ -643,6 +773,9 @@ static void zynqmp_csu_dma_realize(DeviceState *dev, Error **errp)
         s->attr = MEMORY_TRANSACTION_ATTR(
                       object_new(TYPE_MEMORY_TRANSACTION_ATTR));
     }
+
+    dma_engine_init(&s->engine, zynqmp_csu_dma_src_run,
+                    zynqmp_csu_dma_src_done, s);
 }
 
 static void zynqmp_csu_dma_init(Object *obj)
@@ -698,6 +831,7 @@ static const VMStateDescription vmstate_zynqmp_csu_dma = {
 static Property zynqmp_csu_dma_properties [] = {
     DEFINE_PROP_BOOL("is-dst", ZynqMPCSUDMA, is_dst, false),
     DEFINE_PROP_UINT16("dma-width", ZynqMPCSUDMA, width, 4),
+    DEFINE_DMA_ENGINE_PROPERTIES(ZynqMPCSUDMA, engine),
     DEFINE_PROP_END_OF_LIST(),
 };
 
@@ -0,0 +1,144 @@
+/*
+ * Deferred execution of DMA descriptor chains.
+ *
+ * Copyright (c) 2020 Xilinx Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/host-utils.h"
+#include "qemu/main-loop.h"
+#include "qemu/units.h"
+#include "sysemu/runstate.h"
+#include "hw/dma/dma-engine.h"
+
+/*
+ * Amount of data moved per bottom half invocation. Large enough to keep
+ * the per slice overhead out of the picture, small enough to let timers,
+ * chardevs and the monitor through while a big chain is running.
+ */
+#define DMA_ENGINE_SLICE    (1 * MiB)
+
+static void dma_engine_start(DMAEngine *e)
+{
+    if (e->busy) {
+        return;
+    }
+
+    e->busy = true;
+    e->bytes = 0;
+    e->start_ns = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    /* Queue up behind a completion that is still being timed.  */
+    if (timer_pending(e->done_timer)) {
+        e->start_ns = MAX(e->start_ns, e->deadline_ns);
+    }
+}
+
+static bool dma_engine_step(DMAEngine *e, int64_t slice)
+{
+    int64_t budget = slice;
+    bool more;
+
+    more = e->run(e->opaque, &budget);
+    e->bytes += slice - budget;
+    return more;
+}
+
+static void dma_engine_complete(DMAEngine *e)
+{
+    e->busy = false;
+
+    if (e->throughput) {
+        int64_t now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+
+        /* MB/s is bytes per microsecond.  */
+        e->deadline_ns = e->start_ns + muldiv64(e->bytes, 1000,
+                                                e->throughput);
+        if (e->deadline_ns > now) {
+            timer_mod(e->done_timer, e->deadline_ns);
+            return;
+        }
+    }
+    e->done(e->opaque);
+}
+
+static void dma_engine_bh(void *opaque)
+{
+    DMAEngine *e = opaque;
+
+    dma_engine_start(e);
+    if (dma_engine_step(e, DMA_ENGINE_SLICE)) {
+        qemu_bh_schedule(e->bh);
+        return;
+    }
+    dma_engine_complete(e);
+}
+
+static void dma_engine_done_timer(void *opaque)
+{
+    DMAEngine *e = opaque;
+
+    e->done(e->opaque);
+}
+
+static void dma_engine_vm_state_change(void *opaque, int running,
+                                       RunState state)
+{
+    DMAEngine *e = opaque;
+
+    if (running) {
+        return;
+    }
+
+    /* Neither the bottom half nor the timer are part of the vmstate.  */
+    dma_engine_flush(e);
+    if (timer_pending(e->done_timer)) {
+        timer_del(e->done_timer);
+        e->done(e->opaque);
+    }
+}
+
+void dma_engine_init(DMAEngine *e, DMAEngineRunFn *run, DMAEngineDoneFn *done,
+                     void *opaque)
+{
+    e->run = run;
+    e->done = done;
+    e->opaque = opaque;
+    e->bh = qemu_bh_new(dma_engine_bh, e);
+    e->done_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, dma_engine_done_timer, e);
+    e->vmstate = qemu_add_vm_change_state_handler(dma_engine_vm_state_change,
+                                                  e);
+}
+
+void dma_engine_kick(DMAEngine *e)
+{
+    dma_engine_start(e);
+
+    if (e->async) {
+        qemu_bh_schedule(e->bh);
+        return;
+    }
+    dma_engine_flush(e);
+}
+
+void dma_engine_flush(DMAEngine *e)
+{
+    if (!e->busy) {
+        return;
+    }
+
+    qemu_bh_cancel(e->bh);
+    while (dma_engine_step(e, INT64_MAX)) {
+        continue;
+    }
+    dma_engine_complete(e);
+}
+
+void dma_engine_cancel(DMAEngine *e)
+{
+    qemu_bh_cancel(e->bh);
+    timer_del(e->done_timer);
+    e->busy = false;
+}
@@ -35,6 +35,7 @@
 
 #include "sysemu/dma.h"
 #include "hw/stream.h"
+#include "hw/dma/dma-engine.h"
 
 #define D(x)
 
@@ -138,6 +139,8 @@ struct XilinxAXIDMA {
     XilinxAXIDMAStreamSlave rx_control_dev;
 
     struct Stream streams[2];
+    /* Runs the MM2S descriptor ring.  */
+    DMAEngine mm2s_engine;
 
     MemoryRegion *sg_mr;
 
@@ -266,22 +269,23 @@ static void stream_complete(struct Stream *s)
     ptimer_transaction_commit(s->ptimer);
 }
 
-static void stream_process_mem2s(struct Stream *s, StreamSlave *tx_data_dev,
-                                 StreamSlave *tx_control_dev)
+/* Returns true if the ring was left unfinished after using up budget.  */
+static bool stream_process_mem2s(struct Stream *s, StreamSlave *tx_data_dev,
+                                 StreamSlave *tx_control_dev, int64_t *budget)
 {
     uint32_t prev_d;
     unsigned int txlen;
 
     if (!stream_running(s) || stream_idle(s)) {
-        return;
+        return false;
     }
 
-    while (1) {
+    while (*budget > 0) {
         stream_desc_load(s, s->regs[R_CURDESC]);
 
         if (s->desc.status & SDESC_STATUS_COMPLETE) {
             s->regs[R_DMASR] |= DMASR_HALTED;
-            break;
+            return false;
         }
 
         if (stream_desc_sof(&s->desc)) {
@@ -309,15 +313,33 @@ static void stream_process_mem2s(struct Stream *s, StreamSlave *tx_data_dev,
         /* Update the descriptor.  */
         s->desc.status = txlen | SDESC_STATUS_COMPLETE;
         stream_desc_store(s, s->regs[R_CURDESC]);
+        *budget -= sizeof(s->desc) + txlen;
 
         /* Advance.  */
         prev_d = s->regs[R_CURDESC];
         s->regs[R_CURDESC] = s->desc.nxtdesc;
         if (prev_d == s->regs[R_TAILDESC]) {
             s->regs[R_DMASR] |= DMASR_IDLE;
-            break;
+            return false;
         }
     }
+
+    return true;
+}
+
+static bool axidma_mm2s_run(void *opaque, int64_t *budget)
+{
+    XilinxAXIDMA *d = opaque;
+
+    return stream_process_mem2s(&d->streams[0], d->tx_data_dev,
+                                d->tx_control_dev, budget);
+}
+
+static void axidma_mm2s_done(void *opaque)
+{
+    XilinxAXIDMA *d = opaque;
+
+    stream_update_irq(&d->streams[0]);
 }
 
 static size_t stream_process_s2mem(struct Stream *s, unsigned char *buf,
@@ -382,6 +404,7 @@ static void xilinx_axidma_reset(DeviceState *dev)
     for (i = 0; i < 2; i++) {
         stream_reset(&s->streams[i]);
     }
+    dma_engine_cancel(&s->mm2s_engine);
 }
 
 static size_t
@@ -506,7 +529,7 @@ static void axidma_write(void *opaque, hwaddr addr,
             s->regs[addr] = value;
             s->regs[R_DMASR] &= ~DMASR_IDLE; /* Not idle.  */
             if (!sid) {
-                stream_process_mem2s(s, d->tx_data_dev, d->tx_control_dev);
+                dma_engine_kick(&d->mm2s_engine);
             }
             break;
         default:
@@ -575,6 +598,8 @@ static void xilinx_axidma_realize(DeviceState *dev, Error **errp)
         address_space_init(st->data_as, st->data_mr, NULL);
         st->sg_as = sg_as;
     }
+
+    dma_engine_init(&s->mm2s_engine, axidma_mm2s_run, axidma_mm2s_done, s);
     return;
 
 xilinx_axidma_realize_fail:
@@ -625,6 +650,7 @@ static Property axidma_properties[] = {
                      tx_data_dev, TYPE_STREAM_SLAVE, StreamSlave *),
     DEFINE_PROP_LINK("axistream-control-connected", XilinxAXIDMA,
                      tx_control_dev, TYPE_STREAM_SLAVE, StreamSlave *),
+    DEFINE_DMA_ENGINE_PROPERTIES(XilinxAXIDMA, mm2s_engine),
     DEFINE_PROP_END_OF_LIST(),
 };
 
@@ -264,7 +264,6 @@ static void zdma_src_done(XlnxZDMA *s)
     if (cnt != ARRAY_FIELD_EX32(s->regs, ZDMA_CH_IRQ_SRC_ACCT, CNT)) {
         ARRAY_FIELD_DP32(s->regs, ZDMA_CH_ISR, IRQ_SRC_ACCT_ERR, true);
     }
-    zdma_ch_imr_update_irq(s);
 }
 
 static void zdma_dst_done(XlnxZDMA *s)
@@ -279,7 +278,6 @@ static void zdma_dst_done(XlnxZDMA *s)
     if (cnt != ARRAY_FIELD_EX32(s->regs, ZDMA_CH_IRQ_DST_ACCT, CNT)) {
         ARRAY_FIELD_DP32(s->regs, ZDMA_CH_ISR, IRQ_DST_ACCT_ERR, true);
     }
-    zdma_ch_imr_update_irq(s);
 }
 
 static uint64_t zdma_get_regaddr64(XlnxZDMA *s, unsigned int basereg)
@@ -374,7 +372,48 @@ static void zdma_load_dst_descriptor(XlnxZDMA *s)
     zdma_update_descr_addr(s, dst_type, R_ZDMA_CH_DST_CUR_DSCR_LSB);
 }
 
-static void zdma_write_dst(XlnxZDMA *s, uint8_t *buf, uint32_t len)
+/*
+ * Map guest memory for a RAM to RAM copy. Returns NULL if the range does
+ * not start in directly accessible RAM, in which case the caller has to
+ * go through address_space_rw. May map less than *len.
+ */
+static void *zdma_map(XlnxZDMA *s, uint64_t addr, hwaddr *len, bool is_write)
+{
+    MemoryRegion *mr;
+    hwaddr xlat, l = *len;
+
+    WITH_RCU_READ_LOCK_GUARD() {
+        mr = address_space_translate(s->dma_as, addr, &xlat, &l, is_write,
+                                     s->attr);
+        if (!memory_access_is_direct(mr, is_write)) {
+            return NULL;
+        }
+    }
+    return address_space_map(s->dma_as, addr, len, is_write, s->attr);
+}
+
+static void zdma_dst_write(XlnxZDMA *s, uint64_t addr, const uint8_t *buf,
+                           uint32_t len)
+{
+    while (len) {
+        hwaddr mlen = len;
+        uint8_t *dst = zdma_map(s, addr, &mlen, true);
+
+        if (!dst) {
+            address_space_write(s->dma_as, addr, s->attr, buf, len);
+            return;
+        }
+
+        /* buf may be mapped guest memory overlapping the destination.  */
+        memmove(dst, buf, mlen);
+        address_space_unmap(s->dma_as, dst, mlen, true, mlen);
+        addr += mlen;
+        buf += mlen;
+        len -= mlen;
+    }
+}
+
+static void zdma_write_dst(XlnxZDMA *s, const uint8_t *buf, uint32_t len)
 {
     uint32_t dst_size, dlen;
     bool dst_intr;
@@ -413,10 +452,12 @@ static void zdma_write_dst(XlnxZDMA *s, uint8_t *buf, uint32_t len)
             }
         }
 
-        address_space_rw(s->dma_as, s->dsc_dst.addr, s->attr, buf, dlen,
-                         true);
         if (burst_type == AXI_BURST_INCR) {
+            zdma_dst_write(s, s->dsc_dst.addr, buf, dlen);
             s->dsc_dst.addr += dlen;
+        } else {
+            address_space_write(s->dma_as, s->dsc_dst.addr, s->attr,
+                                buf, dlen);
         }
         dst_size -= dlen;
         buf += dlen;
@@ -434,7 +475,33 @@ static void zdma_write_dst(XlnxZDMA *s, uint8_t *buf, uint32_t len)
     }
 }
 
-static void zdma_process_descr(XlnxZDMA *s)
+/*
+ * RAM to RAM fast path. Map as much of the source as is contiguous in
+ * host memory and hand it straight to zdma_write_dst, which maps the
+ * destination as well, so the data is copied exactly once instead of
+ * bouncing through s->buf. Returns the number of bytes moved, 0 if the
+ * source is not RAM.
+ */
+static uint32_t zdma_copy_mapped(XlnxZDMA *s, uint64_t src_addr, uint32_t len)
+{
+    hwaddr mlen = len;
+    uint8_t *src = zdma_map(s, src_addr, &mlen, false);
+
+    if (!src) {
+        return 0;
+    }
+
+    zdma_write_dst(s, src, mlen);
+    address_space_unmap(s->dma_as, src, mlen, false, mlen);
+    return mlen;
+}
+
+/*
+ * Processes the current source descriptor until it is done or *budget
+ * has been used up. Progress is written back to the buffered descriptor
+ * so that the next call picks up where this one stopped.
+ */
+static void zdma_process_descr(XlnxZDMA *s, int64_t *budget)
 {
     uint64_t src_addr;
     uint32_t src_size, len;
@@ -472,12 +539,34 @@ static void zdma_process_descr(XlnxZDMA *s)
     if (rw_mode == RW_MODE_WO) {
         /* In Simple DMA Write-Only, we need to push DST size bytes
          * regardless of what SRC size is set to.  */
-        src_size = FIELD_EX32(s->dsc_dst.words[2], ZDMA_CH_DST_DSCR_WORD2,
-                              SIZE);
+        if (!s->dsc_src_active) {
+            src_size = FIELD_EX32(s->dsc_dst.words[2],
+                                  ZDMA_CH_DST_DSCR_WORD2, SIZE);
+        }
         memcpy(s->buf, &s->regs[R_ZDMA_CH_WR_ONLY_WORD0], s->cfg.bus_width / 8);
     }
 
+    s->dsc_src_active = true;
     while (src_size) {
+        if (*budget <= 0) {
+            s->dsc_src.addr = src_addr;
+            s->dsc_src.words[2] = FIELD_DP32(s->dsc_src.words[2],
+                                             ZDMA_CH_SRC_DSCR_WORD2,
+                                             SIZE, src_size);
+            return;
+        }
+
+        if (rw_mode == RW_MODE_RW && burst_type == AXI_BURST_INCR) {
+            len = zdma_copy_mapped(s, src_addr, MIN(src_size, *budget));
+            if (len) {
+                src_addr += len;
+                s->regs[R_ZDMA_CH_TOTAL_BYTE] += len;
+                src_size -= len;
+                *budget -= len;
+                continue;
+            }
+        }
+
         len = src_size > ARRAY_SIZE(s->buf) ? ARRAY_SIZE(s->buf) : src_size;
         if (burst_type == AXI_BURST_FIXED) {
             if (len > (s->cfg.bus_width / 8)) {
@@ -503,8 +592,10 @@ static void zdma_process_descr(XlnxZDMA *s)
 
         s->regs[R_ZDMA_CH_TOTAL_BYTE] += len;
         src_size -= len;
+        *budget -= len;
     }
 
+    s->dsc_src_active = false;
     ARRAY_FIELD_DP32(s->regs, ZDMA_CH_ISR, DMA_DONE, true);
 
     if (src_intr) {
@@ -520,32 +611,54 @@ static void zdma_process_descr(XlnxZDMA *s)
         zdma_set_state(s, PAUSED);
         ARRAY_FIELD_DP32(s->regs, ZDMA_CH_ISR, DMA_PAUSE, 1);
         ARRAY_FIELD_DP32(s->regs, ZDMA_CH_ISR, DMA_DONE, false);
-        zdma_ch_imr_update_irq(s);
         return;
     }
 
     zdma_update_descr_addr(s, src_type, R_ZDMA_CH_SRC_CUR_DSCR_LSB);
 }
 
-static void zdma_run(XlnxZDMA *s)
+/*
+ * Runs the descriptor chain from the DMA engine. The per descriptor done
+ * handlers only latch ISR bits, the interrupt line is evaluated once
+ * when the chain stops. A descriptor can be up to 1 GiB, so one that
+ * doesn't fit in the budget is left half done and resumed next time.
+ */
+static bool zdma_engine_run(void *opaque, int64_t *budget)
 {
-    while (s->state == ENABLED && !s->error) {
-        zdma_load_src_descriptor(s);
+    XlnxZDMA *s = XLNX_ZDMA(opaque);
 
-        if (s->error) {
-            zdma_set_state(s, DISABLED);
-        } else {
-            zdma_process_descr(s);
+    while (s->state == ENABLED && !s->error && *budget > 0) {
+        if (!s->dsc_src_active) {
+            zdma_load_src_descriptor(s);
+            *budget -= sizeof(XlnxZDMADescr);
+            if (s->error) {
+                zdma_set_state(s, DISABLED);
+                break;
+            }
         }
+        zdma_process_descr(s, budget);
     }
 
+    return s->state == ENABLED && !s->error;
+}
+
+static void zdma_engine_done(void *opaque)
+{
+    XlnxZDMA *s = XLNX_ZDMA(opaque);
+
     zdma_ch_imr_update_irq(s);
 }
 
+static void zdma_run(XlnxZDMA *s)
+{
+    dma_engine_kick(&s->engine);
+}
+
 static void zdma_update_descr_addr_from_start(XlnxZDMA *s)
 {
     uint64_t src_addr, dst_addr;
 
+    s->dsc_src_active = false;
     src_addr = zdma_get_regaddr64(s, R_ZDMA_CH_SRC_START_LSB);
     zdma_put_regaddr64(s, R_ZDMA_CH_SRC_CUR_DSCR_LSB, src_addr);
     dst_addr = zdma_get_regaddr64(s, R_ZDMA_CH_DST_START_LSB);
@@ -704,6 +817,8 @@ static void zdma_reset(DeviceState *dev)
         register_reset(&s->regs_info[i]);
     }
 
+    dma_engine_cancel(&s->engine);
+    s->dsc_src_active = false;
     zdma_ch_imr_update_irq(s);
 }
 
@@ -781,6 +896,8 @@ static void zdma_realize(DeviceState *dev, Error **errp)
     if (s->attr_ptr) {
         s->attr = *s->attr_ptr;
     }
+
+    dma_engine_init(&s->engine, zdma_engine_run, zdma_engine_done, s);
 }
 
 static void zdma_init(Object *obj)
@@ -821,6 +938,7 @@ static const VMStateDescription vmstate_zdma = {
 
 static Property zdma_props[] = {
     DEFINE_PROP_UINT32("bus-width", XlnxZDMA, cfg.bus_width, 64),
+    DEFINE_DMA_ENGINE_PROPERTIES(XlnxZDMA, engine),
     DEFINE_PROP_END_OF_LIST(),
 };
 
@@ -327,6 +327,7 @@ static size_t xlx_aes_stream_push(StreamSlave *obj, uint8_t *buf, size_t len,
                                   uint32_t attr)
 {
     ZynqMPCSUAES *s = ZYNQMP_CSU_AES(obj);
+    unsigned char inbuf[8 * 1024];
     unsigned char outbuf[8 * 1024 + 16];
     int outlen = 0;
     bool feedback;
@@ -338,9 +339,13 @@ static size_t xlx_aes_stream_push(StreamSlave *obj, uint8_t *buf, size_t len,
         attr &= ~STREAM_ATTR_EOP;
     }
 
-    /* TODO: Add explicit eop to the stream interface.  */
-    bswap32_buf8(buf, len);
-    ret = xlx_aes_push_data(s, buf, len, stream_attr_has_eop(attr), 4,
+    /*
+     * TODO: Add explicit eop to the stream interface.
+     * buf may be mapped guest memory, swap a private copy of it.
+     */
+    memcpy(inbuf, buf, len);
+    bswap32_buf8(inbuf, len);
+    ret = xlx_aes_push_data(s, inbuf, len, stream_attr_has_eop(attr), 4,
                             outbuf, &outlen);
     bswap32_buf8(outbuf, outlen);
 
@@ -352,13 +352,13 @@ static size_t ss_stream_push(StreamSlave *obj, uint8_t *buf, size_t len,
                 uint32_t attr)
 {
     SlaveBootInt *s = SBI(obj);
-    uint32_t free = fifo_num_free(&s->fifo);
+    uint32_t num = MIN(fifo_num_free(&s->fifo), len);
 
     /* FIXME: Implement Other Interfaces mentioned above */
-    fifo_push_all(&s->fifo, buf, free);
+    fifo_push_all(&s->fifo, buf, num);
     ss_update_busy_line(s);
     sbi_update_irq(s);
-    return free > len ? len : free;
+    return num;
 }
 
 /*** Chardev Stream handlers */
@@ -158,6 +158,7 @@ static void xlnx_aes_push_iv(XlnxAES *s, uint32_t v)
             memset(s->key, 0, sizeof s->key);
             keylen = 256;
         }
+        gcm_free(&s->gcm_ctx);
         r = gcm_init(&s->gcm_ctx, (void *) s->key, keylen);
         if (r != 0) {
             qemu_log_mask(LOG_GUEST_ERROR, "CSU-AES: GCM init failed\n");
@@ -320,6 +321,13 @@ static void xlnx_aes_realize(DeviceState *dev, Error **errp)
     qdev_init_gpio_in_named(dev, reset_handler, "reset", 1);
 }
 
+static void xlnx_aes_finalize(Object *obj)
+{
+    XlnxAES *s = XLNX_AES(obj);
+
+    gcm_free(&s->gcm_ctx);
+}
+
 static void xlnx_aes_class_init(ObjectClass *klass, void *data)
 {
     DeviceClass *dc = DEVICE_CLASS(klass);
@@ -332,6 +340,7 @@ static const TypeInfo xlnx_aes_info = {
     .name          = TYPE_XLNX_AES,
     .parent        = TYPE_DEVICE,
     .instance_size = sizeof(XlnxAES),
+    .instance_finalize = xlnx_aes_finalize,
     .class_init    = xlnx_aes_class_init,
 };
 
@@ -1138,28 +1138,34 @@ static size_t aes_stream_push(StreamSlave *obj, uint8_t *buf, size_t len,
                                   uint32_t attr)
 {
     Zynq3AES *s = XILINX_AES(obj);
+    unsigned char inbuf[8 * 1024];
     unsigned char outbuf[8 * 1024 + 16];
     int outlen = 0;
     bool feedback;
     bool encrypt;
     size_t ret;
 
-    /* When encrypting, we need to be prepared to receive the 16 byte tag.  */
+    /*
+     * When encrypting, we need to be prepared to receive the 16 byte tag.
+     * Bulk DMA masters may push more than fits in either direction.
+     */
     encrypt = s->aes->encrypt;
-    if (encrypt && len > (sizeof(outbuf) - 16)) {
-        len = sizeof(outbuf) - 16;
+    if (len > sizeof(inbuf)) {
+        len = sizeof(inbuf);
         attr &= ~STREAM_ATTR_EOP;
     }
 
     /* TODO: Add explicit eop to the stream interface.  */
     /* As QEMU aes is big endian, we would change the endianess when
      * user dosent request endianess swapp, i.e data is sent le.
+     * buf may be mapped guest memory, so swap a private copy of it.
      */
+    memcpy(inbuf, buf, len);
     if (!s->regs[R_AES_DATA_ENDIANNESS_SWAP]) {
-        wswap128_buf8(buf, len);
+        wswap128_buf8(inbuf, len);
     }
-    bswap32_buf8(buf, len);
-    ret = xlx_aes_push_data(s, buf, len, stream_attr_has_eop(attr), 4,
+    bswap32_buf8(inbuf, len);
+    ret = xlx_aes_push_data(s, inbuf, len, stream_attr_has_eop(attr), 4,
                             outbuf, &outlen);
     if (!s->regs[R_AES_DATA_ENDIANNESS_SWAP]) {
         wswap128_buf8(outbuf, outlen);
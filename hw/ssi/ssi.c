@@ -46,14 +46,21 @@ static void ssi_cs_default(void *opaque, int n, int level)
     s->cs = cs;
 }
 
+static bool ssi_slave_selected(SSISlave *dev)
+{
+    SSISlaveClass *ssc = SSI_SLAVE_GET_CLASS(dev);
+
+    return (dev->cs && ssc->cs_polarity == SSI_CS_HIGH) ||
+           (!dev->cs && ssc->cs_polarity == SSI_CS_LOW) ||
+           ssc->cs_polarity == SSI_CS_NONE;
+}
+
 static uint32_t ssi_transfer_raw_default(SSISlave *dev, uint32_t val,
                                          int num_bits)
 {
     SSISlaveClass *ssc = SSI_SLAVE_GET_CLASS(dev);
 
-    if ((dev->cs && ssc->cs_polarity == SSI_CS_HIGH) ||
-            (!dev->cs && ssc->cs_polarity == SSI_CS_LOW) ||
-            ssc->cs_polarity == SSI_CS_NONE) {
+    if (ssi_slave_selected(dev)) {
         if (ssc->transfer_bits) {
            return ssc->transfer_bits(dev, val, num_bits);
         } else if (ssc->transfer) {
@@ -181,6 +188,43 @@ uint32_t ssi_transfer(SSIBus *bus, uint32_t val)
     return ssi_transfer_bits(bus, val, 0);
 }
 
+uint32_t ssi_read_bulk(SSIBus *bus, uint8_t *buf, uint32_t len)
+{
+    BusState *b = BUS(bus);
+    BusChild *kid;
+    SSISlaveClass *ssc;
+    SSISlave *sel = NULL;
+
+    /*
+     * Only short-cut the byte transfers when they would have reached a
+     * single slave using the standard CS handling, anything else might
+     * have side effects we cannot reproduce here.
+     */
+    QTAILQ_FOREACH(kid, &b->children, sibling) {
+        SSISlave *slave = SSI_SLAVE(kid->child);
+
+        ssc = SSI_SLAVE_GET_CLASS(slave);
+        if (ssc->transfer_raw != ssi_transfer_raw_default) {
+            return 0;
+        }
+        if (ssi_slave_selected(slave)) {
+            if (sel) {
+                return 0;
+            }
+            sel = slave;
+        }
+    }
+
+    if (!sel) {
+        return 0;
+    }
+    ssc = SSI_SLAVE_GET_CLASS(sel);
+    if (!ssc->read_bulk) {
+        return 0;
+    }
+    return ssc->read_bulk(sel, buf, len);
+}
+
 void ssi_set_datalines(SSIBus *bus, uint8_t val)
 {
     BusState *b = BUS(bus);
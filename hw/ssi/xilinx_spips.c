@@ -1189,6 +1189,47 @@ static const MemoryRegionOps xlnx_zynqmp_qspips_ops = {
 
 #define LQSPI_CACHE_SIZE 1024
 
+/*
+ * Clock len bytes of read data in from the flashes the way
+ * xilinx_spips_flush_txfifo() would for len zero tx bytes, but without
+ * going through the FIFOs a byte at a time. Returns false, with nothing
+ * transferred, if the controller is not in a state that allows it.
+ */
+static bool lqspi_read_bulk(XilinxSPIPS *s, uint8_t *buf, int len)
+{
+    int num = num_effective_busses(s);
+    uint8_t data[MAX_NUM_BUSSES][LQSPI_CACHE_SIZE];
+    int i, j;
+
+    if (!(s->snoop_state == SNOOP_STRIPING ||
+          (s->snoop_state == SNOOP_NONE && num == 1)) ||
+        (s->regs[R_CMND] & R_CMND_RXFIFO_DRAIN) || s->rx_discard ||
+        s->link_state_next_when || len % num) {
+        return false;
+    }
+
+    for (i = 0; i < num; i++) {
+        SSIBus *bus = s->spi[num - 1 - i];
+        uint32_t done = ssi_read_bulk(bus, data[i], len / num);
+
+        for (j = done; j < len / num; j++) {
+            data[i][j] = ssi_transfer(bus, 0);
+        }
+    }
+
+    for (j = 0; j < len / num; j++) {
+        uint8_t *rx = &buf[j * num];
+
+        for (i = 0; i < num; i++) {
+            rx[i] = data[i][j];
+        }
+        if (num > 1) {
+            stripe8(rx, num, true);
+        }
+    }
+    return true;
+}
+
 static void lqspi_load_cache(void *opaque, hwaddr addr)
 {
     XilinxQSPIPS *q = opaque;
@@ -1242,6 +1283,9 @@ static void lqspi_load_cache(void *opaque, hwaddr addr)
 
         DB_PRINT_L(0, "starting QSPI data read\n");
 
+        if (lqspi_read_bulk(s, q->lqspi_buf, LQSPI_CACHE_SIZE)) {
+            cache_entry = LQSPI_CACHE_SIZE;
+        }
         while (cache_entry < LQSPI_CACHE_SIZE) {
             for (i = 0; i < 64; ++i) {
                 tx_data_bytes(&s->tx_fifo, 0, 1, false);
@@ -339,6 +339,7 @@ REG32(MODULE_ID_REG, 0xfc)
 
 #define RXFF_SZ 1024
 #define TXFF_SZ 1024
+#define DAC_CACHE_SZ 1024
 
 #define SZ_512MBIT (512 * 1024 * 1024)
 #define SZ_1GBIT   (1024 * 1024 * 1024)
@@ -421,6 +422,10 @@ typedef struct OSPI {
 
     /* Maximum inferred membank size is 512 bytes */
     uint8_t stig_membank[512];
+
+    /* Last block fetched through the direct access window */
+    uint8_t dac_cache[DAC_CACHE_SZ];
+    hwaddr dac_cached_addr;
 } OSPI;
 
 /* Type to avoid cpu endian byte swaps */
@@ -743,6 +748,19 @@ static void ospi_flush_txfifo(OSPI *s)
     DPRINTF("\n");
 }
 
+/*
+ * Clock in len bytes of read data, short-cutting the byte transfers when
+ * the flash supports bulk reads.
+ */
+static void ospi_rx_data(OSPI *s, uint8_t *buf, uint32_t len)
+{
+    uint32_t i = ssi_read_bulk(s->spi, buf, len);
+
+    for (; i < len; i++) {
+        buf[i] = ssi_transfer(s->spi, 0);
+    }
+}
+
 static void ospi_tx_fifo_push_address_raw(OSPI *s, uint32_t flash_addr,
                                           unsigned int addr_bytes)
 {
@@ -835,6 +853,7 @@ static void ospi_rx_fifo_pop_stig_rd_data(OSPI *s)
 
 static void ospi_ind_read(OSPI *s, uint32_t flash_addr, uint32_t len)
 {
+    uint8_t buf[RXFF_SZ];
     int i;
 
     /* Create first section of read cmd */
@@ -847,13 +866,14 @@ static void ospi_ind_read(OSPI *s, uint32_t flash_addr, uint32_t len)
     fifo_reset(&s->rx_fifo);
 
     /* transmit second part (data) */
-    for (i = 0; i < len; ++i) {
-        fifo_push8(&s->tx_fifo, 0);
-    }
-    ospi_flush_txfifo(s);
+    while (len) {
+        uint32_t n = MIN(len, sizeof(buf));
 
-    for (i = 0; i < len; ++i) {
-        fifo_push8(&s->rx_sram, fifo_pop8(&s->rx_fifo));
+        ospi_rx_data(s, buf, n);
+        for (i = 0; i < n; ++i) {
+            fifo_push8(&s->rx_sram, buf[i]);
+        }
+        len -= n;
     }
 
     /* done */
@@ -1252,11 +1272,28 @@ static void ospi_tx_sram_write(OSPI *s, uint64_t value, unsigned int size)
     }
 }
 
-static uint64_t ospi_do_dac_read(void *opaque, hwaddr addr, unsigned int size)
+static void ospi_dac_invalidate_cache(OSPI *s)
 {
-    OSPI *s = XILINX_OSPI(opaque);
-    OSPIRdData ret = {};
-    int i;
+    s->dac_cached_addr = ~0ULL;
+}
+
+/*
+ * Reads through the direct access window are served from a block of
+ * DAC_CACHE_SZ bytes, fetched with a single read command. Anything that
+ * could change the flash contents or the way the window is decoded goes
+ * through a register or a window write, which drop the block.
+ *
+ * Blocks are aligned, except when the remap offset makes an access
+ * straddle two of them. The block then starts at the access instead.
+ */
+static void ospi_dac_load_cache(OSPI *s, hwaddr addr, unsigned int size)
+{
+    hwaddr start = addr & ~(hwaddr)(DAC_CACHE_SZ - 1);
+
+    if (addr + size > start + DAC_CACHE_SZ) {
+        start = addr;
+    }
+    addr = start;
 
     /* Create first section of read cmd */
     ospi_tx_fifo_push_rd_op_addr(s, (uint32_t) addr);
@@ -1268,21 +1305,25 @@ static uint64_t ospi_do_dac_read(void *opaque, hwaddr addr, unsigned int size)
     fifo_reset(&s->rx_fifo);
 
     /* transmit second part (data) */
-    for (i = 0; i < size; ++i) {
-        fifo_push8(&s->tx_fifo, 0);
-    }
-    ospi_flush_txfifo(s);
-
-    /* fill in result */
-    size = MIN(fifo_num_used(&s->rx_fifo), size);
-
-    for (i = 0; i < size; i++) {
-        ret.u8[i] = fifo_pop8(&s->rx_fifo);
-    }
+    ospi_rx_data(s, s->dac_cache, DAC_CACHE_SZ);
 
     /* done */
     ospi_disable_cs(s);
 
+    s->dac_cached_addr = addr;
+}
+
+static uint64_t ospi_do_dac_read(void *opaque, hwaddr addr, unsigned int size)
+{
+    OSPI *s = XILINX_OSPI(opaque);
+    OSPIRdData ret = {};
+
+    if (addr < s->dac_cached_addr ||
+        addr + size > s->dac_cached_addr + DAC_CACHE_SZ) {
+        ospi_dac_load_cache(s, addr, size);
+    }
+
+    memcpy(ret.u8, &s->dac_cache[addr - s->dac_cached_addr], size);
     return ret.u64;
 }
 
@@ -1507,6 +1548,8 @@ static void ospi_reset(DeviceState *dev)
     s->rd_ind_op[1].completed = true;
     s->wr_ind_op[0].completed = true;
     s->wr_ind_op[1].completed = true;
+
+    ospi_dac_invalidate_cache(s);
 }
 
 static RegisterAccessInfo ospi_regs_info[] = {
@@ -1681,6 +1724,7 @@ static void ospi_write(void *opaque, hwaddr addr, uint64_t value,
 {
     OSPI *s = xilinx_ospi_of_mr(opaque);
 
+    ospi_dac_invalidate_cache(s);
     register_write_memory(opaque, addr, value, size);
     ospi_update_irq_line(s);
 }
@@ -1780,6 +1824,8 @@ static void ospi_dac_write(void *opaque, hwaddr addr, uint64_t value,
 {
     OSPI *s = XILINX_OSPI(opaque);
 
+    ospi_dac_invalidate_cache(s);
+
     if (ARRAY_FIELD_EX32(s->regs, CONFIG_REG, ENB_SPI_FLD)) {
         if (ospi_is_indac_active(s) &&
             !s->ind_write_disabled &&
@@ -1824,6 +1870,7 @@ static void ospi_update_dac_status(void *opaque, int n, int level)
 {
     OSPI *s = XILINX_OSPI(opaque);
 
+    ospi_dac_invalidate_cache(s);
     s->dac_enable = level;
 }
 
@@ -1869,11 +1916,18 @@ static void ospi_init(Object *obj)
                              NULL);
 }
 
+static int ospi_post_load(void *opaque, int version_id)
+{
+    ospi_dac_invalidate_cache(XILINX_OSPI(opaque));
+    return 0;
+}
+
 static const VMStateDescription vmstate_ospi = {
     .name = TYPE_XILINX_OSPI,
     .version_id = 1,
     .minimum_version_id = 1,
     .minimum_version_id_old = 1,
+    .post_load = ospi_post_load,
     .fields = (VMStateField[]) {
         VMSTATE_UINT32_ARRAY(regs, OSPI, R_MAX),
         VMSTATE_END_OF_LIST(),
@@ -2,6 +2,7 @@
 #define GEN_ICOUNT_H
 
 #include "qemu/timer.h"
+#include "qemu/etrace.h"
 
 /* Helpers for instruction counting code generation.  */
 
@@ -32,6 +33,24 @@ static inline void gen_io_end(void)
     tcg_temp_free_i32(tmp);
 }
 
+/*
+ * Make the TB count its own executions, chained entries included. The
+ * increment isn't atomic, so MTTCG vCPUs racing on a shared TB may lose
+ * a few counts, which is fine for a profile.
+ */
+static inline void gen_etrace_tb_count(TranslationBlock *tb)
+{
+    TCGv_ptr ptr = tcg_const_ptr(&tb->exec_count);
+    TCGv_i64 count = tcg_temp_new_i64();
+
+    tcg_gen_ld_i64(count, ptr, 0);
+    tcg_gen_addi_i64(count, count, 1);
+    tcg_gen_st_i64(count, ptr, 0);
+
+    tcg_temp_free_i64(count);
+    tcg_temp_free_ptr(ptr);
+}
+
 static inline void gen_tb_start(TranslationBlock *tb)
 {
     TCGv_i32 count, imm;
@@ -69,6 +88,11 @@ static inline void gen_tb_start(TranslationBlock *tb)
     }
 
     tcg_temp_free_i32(count);
+
+    /* Only count executions that get past the exit request check.  */
+    if (qemu_etrace_mask(ETRACE_F_PROFILE)) {
+        gen_etrace_tb_count(tb);
+    }
 }
 
 static inline void gen_tb_end(TranslationBlock *tb, int num_insns)
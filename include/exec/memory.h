@@ -1418,6 +1418,23 @@ void memory_region_reset_dirty(MemoryRegion *mr, hwaddr addr,
  */
 void memory_region_flush_rom_device(MemoryRegion *mr, hwaddr addr, hwaddr size);
 
+/**
+ * memory_region_flush_ram: Mark a range of RAM dirty and invalidate TBs
+ *
+ * RAM that is shared with an external agent, e.g a co-simulation peer
+ * mapping the same memory backend, can change without QEMU noticing.
+ * This function must be called for byte ranges modified that way.
+ *
+ * This function marks the range dirty and invalidates TBs so that TCG can
+ * detect self-modifying code.
+ *
+ * @mr: the RAM region being flushed.
+ * @addr: the start, relative to the start of the region, of the range being
+ *        flushed.
+ * @size: the size, in bytes, of the range being flushed.
+ */
+void memory_region_flush_ram(MemoryRegion *mr, hwaddr addr, hwaddr size);
+
 /**
  * memory_region_set_readonly: Turn a memory region read-only (or read-write)
  *
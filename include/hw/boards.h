@@ -282,6 +282,7 @@ struct MachineState {
     int kvm_shadow_mem;
     char *dtb;
     char *hw_dtb;
+    char *hw_dtb_cache;
     char *dumpdtb;
     bool is_linux;
     int phandle_start;
@@ -0,0 +1,101 @@
+/*
+ * Deferred execution of DMA descriptor chains.
+ *
+ * Copyright (c) 2020 Xilinx Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+#ifndef HW_DMA_ENGINE_H
+#define HW_DMA_ENGINE_H
+
+#include "qemu/timer.h"
+#include "hw/qdev-properties.h"
+
+/*
+ * DMA models typically run a whole transfer from within the MMIO write
+ * that kicks the channel, leaving the issuing vCPU stalled until the
+ * last byte has been copied. A DMAEngine instead runs the channel from a
+ * bottom half in the main loop, in slices, so the vCPU can continue
+ * while a long descriptor chain is being processed.
+ *
+ * The model splits its channel processing in two:
+ *
+ *  - run() does the actual work: fetches descriptors, moves data and
+ *    latches status bits. It must stop once *budget (in bytes) has been
+ *    used up and return true if there is more to do.
+ *  - done() evaluates the interrupt lines once the channel has stopped.
+ *
+ * Both are called with the BQL held, like the MMIO handlers. With
+ * throughput set, done() is delayed until the transfer would have taken
+ * that long on QEMU_CLOCK_VIRTUAL. Status registers are not delayed.
+ *
+ * Pending work is drained when the VM stops so that nothing is left in
+ * flight across savevm and migration.
+ */
+
+typedef bool DMAEngineRunFn(void *opaque, int64_t *budget);
+typedef void DMAEngineDoneFn(void *opaque);
+
+typedef struct DMAEngine {
+    /* Properties.  */
+    bool async;
+    uint32_t throughput;   /* In MB/s, 0 completes immediately.  */
+
+    DMAEngineRunFn *run;
+    DMAEngineDoneFn *done;
+    void *opaque;
+
+    QEMUBH *bh;
+    QEMUTimer *done_timer;
+    VMChangeStateEntry *vmstate;
+
+    bool busy;
+    int64_t start_ns;
+    int64_t deadline_ns;
+    uint64_t bytes;
+} DMAEngine;
+
+#define DEFINE_DMA_ENGINE_PROPERTIES(_state, _engine)                   \
+    DEFINE_PROP_BOOL("dma-async", _state, _engine.async, true),         \
+    DEFINE_PROP_UINT32("dma-throughput", _state, _engine.throughput, 0)
+
+/**
+ * dma_engine_init:
+ * @e: The engine, embedded in the device state.
+ * @run: Processes a slice of the channel.
+ * @done: Updates the interrupt state once the channel stopped.
+ * @opaque: Passed to @run and @done.
+ *
+ * To be called from realize, after the properties have been set.
+ */
+void dma_engine_init(DMAEngine *e, DMAEngineRunFn *run, DMAEngineDoneFn *done,
+                     void *opaque);
+
+/**
+ * dma_engine_kick:
+ * @e: The engine.
+ *
+ * Starts or continues processing the channel. Without dma-async the
+ * channel is run to completion before returning.
+ */
+void dma_engine_kick(DMAEngine *e);
+
+/**
+ * dma_engine_flush:
+ * @e: The engine.
+ *
+ * Runs pending work to completion before returning, for callers that
+ * rely on the transfer having happened, e.g other device models.
+ */
+void dma_engine_flush(DMAEngine *e);
+
+/**
+ * dma_engine_cancel:
+ * @e: The engine.
+ *
+ * Drops any pending work and completion, e.g on reset.
+ */
+void dma_engine_cancel(DMAEngine *e);
+
+#endif
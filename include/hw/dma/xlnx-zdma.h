@@ -32,6 +32,7 @@
 #include "hw/sysbus.h"
 #include "hw/register.h"
 #include "sysemu/dma.h"
+#include "hw/dma/dma-engine.h"
 
 #define ZDMA_R_MAX (0x204 / 4)
 
@@ -63,11 +64,17 @@ typedef struct XlnxZDMA {
         uint32_t bus_width;
     } cfg;
 
+    DMAEngine engine;
     XlnxZDMAState state;
     bool error;
 
     XlnxZDMADescr dsc_src;
     XlnxZDMADescr dsc_dst;
+    /*
+     * dsc_src was left half done by the DMA engine budget. Not migrated,
+     * the engine drains the channel when the VM stops.
+     */
+    bool dsc_src_active;
 
     uint32_t regs[ZDMA_R_MAX];
     RegisterInfo regs_info[ZDMA_R_MAX];
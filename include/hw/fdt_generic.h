@@ -42,6 +42,9 @@ typedef struct FDTMachineInfo {
     qemu_irq *irq_base;
     /* per-device specific opaques */
     FDTDevOpaque *dev_opaques;
+    int nr_dev_opaques;
+    /* dev_opaques indexed by node_path */
+    GHashTable *dev_opaque_index;
     /* recheck coroutine queue */
     CoQueue *cq;
     /* list of all IRQ connections */
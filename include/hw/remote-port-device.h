@@ -48,6 +48,8 @@ void rp_restart_sync_timer(RemotePort *s);
 void rp_leave_iothread(RemotePort *s);
 
 ssize_t rp_write(RemotePort *s, const void *buf, size_t count);
+/* Writes the elements of iov back to back as a single packet.  */
+ssize_t rp_writev(RemotePort *s, const struct iovec *iov, int iovcnt);
 
 RemotePortDynPkt rp_wait_resp(RemotePort *s);
 
@@ -0,0 +1,79 @@
+/*
+ * QEMU remote port packet log for record and replay.
+ *
+ * Copyright (c) 2020 Xilinx Inc.
+ *
+ * This code is licensed under the GNU GPL.
+ */
+#ifndef REMOTE_PORT_LOG_H__
+#define REMOTE_PORT_LOG_H__
+
+#include "qemu/thread.h"
+
+/*
+ * A log holds every packet received by a RemotePort, exactly as it
+ * arrived on the wire, tagged with the normalized vmclk at reception and
+ * the channel it arrived on. All log fields are little endian, the
+ * packets themselves stay in remote-port (big endian) wire format.
+ *
+ *   struct rp_log_hdr
+ *   struct rp_log_rec, followed by rec.len bytes of packet
+ *   struct rp_log_rec, ...
+ */
+
+#define RP_LOG_MAGIC            0x474c5052   /* "RPLG" */
+#define RP_LOG_VERSION          1
+
+struct rp_log_hdr {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t nr_channels;
+    uint32_t reserved;
+};
+
+struct rp_log_rec {
+    uint64_t clk;
+    uint32_t channel;
+    uint32_t len;
+};
+
+typedef struct RemotePortLog {
+    FILE *f;
+    char *path;
+    bool replay;
+    uint32_t nr_channels;
+    /* Serializes records coming from multiple channel threads.  */
+    QemuMutex lock;
+} RemotePortLog;
+
+/**
+ * rp_log_open:
+ * @path: File to record into or replay from.
+ * @replay: Open for replay rather than recording.
+ * @nr_channels: Number of channels of the adaptor.
+ * @errp: returns an error if this function fails
+ *
+ * When replaying, the log must have been recorded with the same number
+ * of channels.
+ */
+RemotePortLog *rp_log_open(const char *path, bool replay,
+                           uint32_t nr_channels, Error **errp);
+
+/* Append a packet, given as a vector, to a recording.  */
+void rp_log_write(RemotePortLog *log, int64_t clk, uint32_t channel,
+                  const struct iovec *iov, int iovcnt);
+
+/*
+ * Step to the next record of a replay. Returns false at the end of the
+ * log. The packet bytes are then consumed with rp_log_read.
+ */
+bool rp_log_next(RemotePortLog *log, int64_t *clk, uint32_t *channel);
+ssize_t rp_log_read(RemotePortLog *log, void *buf, size_t count);
+
+/*
+ * Close the underlying file. Channel threads may still hold the log, so
+ * it stays allocated and records written after this are dropped.
+ */
+void rp_log_close(RemotePortLog *log);
+
+#endif
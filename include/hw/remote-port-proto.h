@@ -69,7 +69,8 @@ enum rp_cmd {
     RP_CMD_write       = 4,
     RP_CMD_interrupt   = 5,
     RP_CMD_sync        = 6,
-    RP_CMD_max         = 6
+    RP_CMD_batch       = 7,
+    RP_CMD_max         = 7
 };
 
 enum {
@@ -135,8 +136,39 @@ enum {
      * of the posted header-flag.
      */
     CAP_WIRE_POSTED_UPDATES = 3,
+
+    /*
+     * Support for RP_CMD_batch, a vector of bus accesses carried in a
+     * single packet and answered with a single aggregate response.
+     */
+    CAP_BUSACCESS_BATCH = 4,
+
+    /*
+     * Support for multiple channels. The peers open several transports
+     * towards each other, each served by its own thread. Packets for
+     * device D, requests and responses in both directions, travel on
+     * channel D % nr_channels. The hello sent on every channel carries
+     * RP_HELLO_CHANNEL(nr, nr_channels) in hdr.dev, which is 0 for
+     * single channel setups.
+     */
+    CAP_MULTI_CHANNEL = 5,
+
+    /*
+     * Support for memory regions shared between the peers. A memory
+     * master may back its regions with memory that both sides map, e.g
+     * a file on /dev/shm, instead of forwarding every access. A peer
+     * that modifies such memory sends a coherence notification to the
+     * memory master device: an RP_CMD_write busaccess for the modified
+     * range with RP_BUS_ATTR_NOTIFY set and no data (see
+     * rp_encode_mem_notify). It is answered like a write unless posted.
+     */
+    CAP_SHARED_MEMORY = 6,
 };
 
+#define RP_HELLO_CHANNEL(nr, count)   ((((count) - 1) << 16) | (nr))
+#define RP_HELLO_CHANNEL_NR(dev)      ((dev) & 0xffff)
+#define RP_HELLO_CHANNEL_COUNT(dev)   (((dev) >> 16) + 1)
+
 struct rp_pkt_hello {
     struct rp_pkt_hdr hdr;
     struct rp_version version;
@@ -144,10 +176,27 @@ struct rp_pkt_hello {
 } PACKED;
 
 
+/* Completion status of a bus access, see RP_BUS_RESP_MASK.  */
+enum {
+    RP_RESP_OK                  =  0x0,
+    RP_RESP_BUS_GENERIC_ERROR   =  0x1,
+    RP_RESP_ADDR_ERROR          =  0x2,
+    RP_RESP_MAX                 =  0xF,
+};
+
 enum {
     RP_BUS_ATTR_EOP        =  (1 << 0),
     RP_BUS_ATTR_SECURE     =  (1 << 1),
     RP_BUS_ATTR_EXT_BASE   =  (1 << 2),
+    /* Coherence notification, see CAP_SHARED_MEMORY. Requests only.  */
+    RP_BUS_ATTR_NOTIFY     =  (1 << 3),
+    /*
+     * Responses carry the RP_RESP_* status of the access in these bits.
+     * Peers that predate it leave them at zero, i.e RP_RESP_OK. Reserved
+     * in requests, no request attribute may live here.
+     */
+    RP_BUS_RESP_SHIFT      =  8,
+    RP_BUS_RESP_MASK       =  (RP_RESP_MAX << RP_BUS_RESP_SHIFT),
 };
 
 struct rp_pkt_busaccess {
@@ -217,6 +266,11 @@ struct rp_pkt_busaccess_ext_base {
      */
 } PACKED;
 
+static inline unsigned int rp_busaccess_resp(struct rp_pkt_busaccess *pkt)
+{
+    return (pkt->attributes & RP_BUS_RESP_MASK) >> RP_BUS_RESP_SHIFT;
+}
+
 struct rp_pkt_interrupt {
     struct rp_pkt_hdr hdr;
     uint64_t timestamp;
@@ -230,6 +284,45 @@ struct rp_pkt_sync {
     uint64_t timestamp;
 } PACKED;
 
+/*
+ * Batched bus accesses.
+ *
+ * A request carries nr_entries struct rp_batch_entry at entries_offset,
+ * followed by the data of all write entries concatenated in entry order
+ * at data_offset. Entries are applied in order.
+ *
+ * The single response echoes the header fields and the entries, and
+ * carries the data of all read entries concatenated in entry order at
+ * data_offset. The RP_BATCH_ENTRY_RESP_MASK bits of each echoed entry
+ * hold the RP_RESP_* status of that access; the RP_BUS_RESP_MASK bits of
+ * attributes hold the first failing status, or RP_RESP_OK.
+ *
+ * Requests flagged RP_PKT_FLAGS_posted get no response.
+ */
+enum {
+    RP_BATCH_ENTRY_WRITE       =  (1 << 0),
+    /* Responses only.  */
+    RP_BATCH_ENTRY_RESP_SHIFT  =  8,
+    RP_BATCH_ENTRY_RESP_MASK   =  (RP_RESP_MAX << RP_BATCH_ENTRY_RESP_SHIFT),
+};
+
+struct rp_batch_entry {
+    uint64_t addr;
+    uint32_t len;
+    uint32_t flags;
+} PACKED;
+
+struct rp_pkt_batch {
+    struct rp_pkt_hdr hdr;
+    uint64_t timestamp;
+    uint64_t attributes;
+    uint64_t master_id;
+    uint32_t nr_entries;
+    uint32_t entries_offset;    /* Offset from start of pkt.  */
+    uint32_t data_offset;       /* Offset from start of pkt.  */
+    uint32_t data_len;
+} PACKED;
+
 struct rp_pkt {
     union {
         struct rp_pkt_hdr hdr;
@@ -238,6 +331,7 @@ struct rp_pkt {
         struct rp_pkt_busaccess_ext_base busaccess_ext_base;
         struct rp_pkt_interrupt interrupt;
         struct rp_pkt_sync sync;
+        struct rp_pkt_batch batch;
     };
 };
 
@@ -253,6 +347,9 @@ struct rp_peer_state {
         bool busaccess_ext_base;
         bool busaccess_ext_byte_en;
         bool wire_posted_updates;
+        bool busaccess_batch;
+        bool multi_channel;
+        bool shared_memory;
     } caps;
 
     /* Used to normalize our clk.  */
@@ -416,6 +513,15 @@ size_t rp_encode_busaccess(struct rp_peer_state *peer,
                            struct rp_pkt_busaccess_ext_base *pkt,
                            struct rp_encode_busaccess_in *in);
 
+/*
+ * Encodes a coherence notification for size bytes of shared memory at
+ * addr. Returns the size of the complete packet, there is no data.
+ */
+size_t rp_encode_mem_notify(struct rp_peer_state *peer,
+                            struct rp_pkt_busaccess_ext_base *pkt,
+                            uint32_t id, uint32_t dev, uint32_t flags,
+                            int64_t clk, uint64_t addr, uint32_t size);
+
 size_t rp_encode_interrupt_f(uint32_t id, uint32_t dev,
                              struct rp_pkt_interrupt *pkt,
                              int64_t clk,
@@ -435,6 +541,32 @@ size_t rp_encode_sync_resp(uint32_t id, uint32_t dev,
                            struct rp_pkt_sync *pkt,
                            int64_t clk);
 
+/*
+ * Encodes the batch header. The caller places the nr_entries encoded
+ * entries (see rp_encode_batch_entry) right after the header, followed
+ * by the write data for requests or the read data for responses.
+ * Returns the size of the header.
+ */
+size_t rp_encode_batch(uint32_t id, uint32_t dev,
+                       struct rp_pkt_batch *pkt,
+                       int64_t clk, uint64_t master_id, uint64_t attr,
+                       uint32_t nr_entries, uint32_t data_len,
+                       uint32_t flags);
+
+void rp_encode_batch_entry(struct rp_batch_entry *entry,
+                           uint64_t addr, uint32_t len, uint32_t flags);
+
+static inline struct rp_batch_entry *
+rp_batch_entries(struct rp_pkt_batch *pkt)
+{
+    return (void *) ((unsigned char *) pkt + pkt->entries_offset);
+}
+
+static inline unsigned char *rp_batch_dataptr(struct rp_pkt_batch *pkt)
+{
+    return (unsigned char *) pkt + pkt->data_offset;
+}
+
 void rp_process_caps(struct rp_peer_state *peer,
                      void *caps, size_t caps_len);
 
@@ -0,0 +1,123 @@
+/*
+ * QEMU remote port shared-memory ring transport.
+ *
+ * Copyright (c) 2020 Xilinx Inc.
+ *
+ * This code is licensed under the GNU GPL.
+ */
+#ifndef REMOTE_PORT_SHM_H__
+#define REMOTE_PORT_SHM_H__
+
+/*
+ * The shared-memory transport replaces the socket/chardev byte-stream
+ * with a pair of single-producer single-consumer byte rings living in a
+ * file that both simulators mmap (typically on /dev/shm). The rings carry
+ * the exact same RP packet stream as the socket would, so peers only
+ * need to swap the transport layer.
+ *
+ * Layout of the file:
+ *
+ *   struct rp_shm_hdr          (one page)
+ *   ring[0] data               (ring_size bytes, creator -> attacher)
+ *   ring[1] data               (ring_size bytes, attacher -> creator)
+ *
+ * QEMU is always the creator. head and tail are free running byte
+ * counters, the position in the ring is counter & (ring_size - 1).
+ * A consumer that has run out of data sets data_waiters and sleeps on
+ * head with FUTEX_WAIT, a producer that has run out of space sets
+ * space_waiters and sleeps on tail. The other side wakes them up after
+ * moving its index only if the corresponding waiters flag is set, so the
+ * common case never enters the kernel.
+ *
+ * Each side flags closed (producer) or consumer_closed (consumer) when it
+ * goes away cleanly. To also notice a peer that died, the creator holds
+ * an OFD lock on byte 0 of the file and the attacher one on byte 1.
+ * Sleepers periodically check that the lock of the other side is still
+ * held.
+ */
+
+#define RP_SHM_MAGIC            0x52505348   /* "RPSH" */
+#define RP_SHM_VERSION          1
+#define RP_SHM_HDR_SIZE         4096
+#define RP_SHM_MIN_RING_SIZE    4096
+#define RP_SHM_ATTACH_TIMEOUT_MS 10000
+
+struct rp_shm_ring {
+    /* Producer owned.  */
+    uint32_t head;
+    uint32_t space_waiters;
+    uint32_t closed;
+    uint32_t reserved0[13];
+
+    /* Consumer owned.  */
+    uint32_t tail;
+    uint32_t data_waiters;
+    uint32_t consumer_closed;
+    uint32_t reserved1[13];
+};
+
+struct rp_shm_hdr {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t ring_size;
+    uint32_t ready;
+    uint32_t attached;
+    uint32_t reserved[11];
+
+    struct rp_shm_ring ring[2];
+};
+
+typedef struct RemotePortShm {
+    int fd;
+    bool creator;
+    char *path;
+    size_t map_size;
+    struct rp_shm_hdr *hdr;
+
+    struct rp_shm_ring *rx;
+    struct rp_shm_ring *tx;
+    uint8_t *rx_data;
+    uint8_t *tx_data;
+    uint32_t ring_size;
+
+    /* Number of spins before going to sleep on a futex.  */
+    uint32_t poll;
+} RemotePortShm;
+
+/**
+ * rp_shm_create:
+ * @path: File to create and map, e.g on /dev/shm.
+ * @ring_size: Size in bytes of each ring. Must be a power of 2.
+ * @poll: Number of busy-poll iterations before sleeping.
+ * @errp: returns an error if this function fails
+ *
+ * Creates and initializes a ring pair for the creator side (QEMU).
+ */
+RemotePortShm *rp_shm_create(const char *path, uint32_t ring_size,
+                             uint32_t poll, Error **errp);
+
+/**
+ * rp_shm_attach:
+ * @path: File previously created by rp_shm_create.
+ * @poll: Number of busy-poll iterations before sleeping.
+ * @errp: returns an error if this function fails
+ *
+ * Maps an existing ring pair from the attaching (peer) side. Waits up to
+ * RP_SHM_ATTACH_TIMEOUT_MS for the creator to finish initializing the
+ * header.
+ */
+RemotePortShm *rp_shm_attach(const char *path, uint32_t poll, Error **errp);
+
+/*
+ * Blocking stream accessors. They behave like read_all/write_all on a
+ * socket and return count, or 0 if the other side closed its end or
+ * died.
+ */
+ssize_t rp_shm_read(RemotePortShm *shm, void *buf, size_t count);
+ssize_t rp_shm_write(RemotePortShm *shm, const void *buf, size_t count);
+ssize_t rp_shm_writev(RemotePortShm *shm, const struct iovec *iov,
+                      int iovcnt);
+
+void rp_shm_close(RemotePortShm *shm);
+
+#endif
@@ -10,8 +10,11 @@
 #define REMOTE_PORT_H__
 
 #include <stdbool.h>
+#include "qemu/notify.h"
 #include "hw/remote-port-proto.h"
 #include "hw/remote-port-device.h"
+#include "hw/remote-port-shm.h"
+#include "hw/remote-port-log.h"
 #include "chardev/char.h"
 #include "chardev/char-fe.h"
 #include "hw/ptimer.h"
@@ -24,12 +27,50 @@ typedef struct RemotePortRespSlot {
             uint32_t id;
             bool used;
             bool valid;
+            /* Response is consumed by the protocol thread.  */
+            bool posted;
 } RemotePortRespSlot;
 
+/*
+ * A channel is one transport towards the peer with its own reader thread
+ * and rx queue. A RemotePort has at least one. Devices are spread over
+ * the channels by device number so that a busy device does not stall
+ * packets for the others behind it.
+ */
+#define RP_MAX_CHANNELS 8
+#define REMOTE_PORT_MAX_DEVS 1024
+#define RP_MAX_OUTSTANDING_TRANSACTIONS 32
+typedef struct RemotePortChannel {
+    RemotePort *rp;
+    unsigned int nr;
+
+    QemuThread thread;
+    /* Channel 0 uses the chardev property of the adaptor.  */
+    CharBackend *chr;
+    CharBackend chr_be;
+    RemotePortShm *shm;
+    /* To serialize writes to the transport.  */
+    QemuMutex write_mutex;
+
+    struct {
+        /* This array must be sized minimum 2 and always a power of 2.  */
+        RemotePortDynPkt pkt[16];
+        QemuSemaphore sem;
+        unsigned int wpos;
+        unsigned int rpos;
+    } rx_queue;
+
+    struct {
+        uint64_t tx_bytes;
+        uint64_t rx_bytes;
+        uint64_t rx_req[RP_CMD_max + 1];
+        uint64_t rx_rsp[RP_CMD_max + 1];
+    } stats;
+} RemotePortChannel;
+
 struct RemotePort {
     DeviceState parent;
 
-    QemuThread thread;
     union {
        int pipes[2];
        struct {
@@ -39,13 +80,54 @@ struct RemotePort {
     } event;
     CharBackend chr;
     bool do_sync;
-    /* To serialize writes to fd.  */
-    QemuMutex write_mutex;
+
+    uint32_t nr_channels;
+    RemotePortChannel chan[RP_MAX_CHANNELS];
+
+    /*
+     * Property, the peer must support CAP_SHARED_MEMORY. Required by
+     * memory masters mapping memory shared with the peer, and known
+     * before the protocol threads start so the hello check can't miss it.
+     */
+    bool shared_memory;
 
     char *chardesc;
     char *chrdev_id;
     struct rp_peer_state peer;
 
+    /* Optional shared-memory ring transport, replaces the chardev.  */
+    struct {
+        bool enable;
+        char *path;
+        uint32_t size;
+        uint32_t poll;
+    } shm;
+
+    /* Log every received packet for later replay.  */
+    struct {
+        char *path;
+        RemotePortLog *log;
+        Notifier exit;
+    } record;
+
+    /*
+     * Run against a recorded log instead of a live peer. Requests from
+     * the log are delivered once the vmclk reaches their timestamp,
+     * responses once we have sent the matching request. Everything we
+     * send is dropped.
+     */
+    struct {
+        char *path;
+        RemotePortLog *log;
+        QemuThread thread;
+        QEMUTimer *timer;
+        QemuSemaphore sem;
+        QemuMutex lock;
+        QemuCond cond;
+        /* Ids of recently sent requests, indexed by id modulo size.  */
+        uint32_t tx_id[2 * RP_MAX_OUTSTANDING_TRANSACTIONS];
+    } replay;
+
     struct {
         ptimer_state *ptimer;
         ptimer_state *ptimer_resp;
@@ -53,19 +135,28 @@ struct RemotePort {
         bool need_sync;
         struct rp_pkt rsp;
         uint64_t quantum;
+
+        /*
+         * Adaptive quantum. The window doubles after a quantum without
+         * cross-boundary traffic and halves after one with traffic,
+         * staying within [quantum_min, quantum_max].
+         */
+        bool adaptive;
+        uint64_t quantum_min;
+        uint64_t quantum_max;
+        bool activity;
+
+        struct {
+            uint64_t count;
+            /* Host time spent blocked waiting for sync responses.  */
+            uint64_t stall_ns;
+            int64_t start_ns;
+        } stats;
     } sync;
 
     QemuMutex rsp_mutex;
     QemuCond progress_cond;
 
-    struct {
-        /* This array must be sized minimum 2 and always a power of 2.  */
-        RemotePortDynPkt pkt[16];
-        QemuSemaphore sem;
-        unsigned int wpos;
-        unsigned int rpos;
-    } rx_queue;
-
     /*
      * rsp holds responses for the remote side.
      * Used by the slave.
@@ -86,10 +177,28 @@ struct RemotePort {
 
     uint32_t current_id;
 
-#define REMOTE_PORT_MAX_DEVS 1024
-#define RP_MAX_OUTSTANDING_TRANSACTIONS 32
+    /* Number of posted transactions still waiting for a response.  */
+    unsigned int posted_outstanding;
+
+    /*
+     * Performance counters, see query-remote-port. Traffic counters
+     * live in the channels.
+     */
+#define RP_LAT_HIST_BUCKETS 24
+    struct {
+        uint64_t wait_ns;
+        uint64_t lat_hist[RP_LAT_HIST_BUCKETS];
+    } stats;
+
     struct {
         RemotePortRespSlot rsp_queue[RP_MAX_OUTSTANDING_TRANSACTIONS];
+        unsigned int posted_outstanding;
+
+        struct {
+            uint64_t transactions;
+            uint64_t wait_ns;
+            unsigned int max_outstanding;
+        } stats;
     } dev_state[REMOTE_PORT_MAX_DEVS];
 
     RemotePortDevice *devs[REMOTE_PORT_MAX_DEVS];
@@ -132,4 +241,28 @@ static inline void rp_resp_slot_done(RemotePort *s,
 
 RemotePortRespSlot *rp_dev_wait_resp(RemotePort *s, uint32_t dev, uint32_t id);
 
+/**
+ * rp_dev_post_resp:
+ * @s: The remote-port adaptor
+ * @dev: The device/channel number issuing the transaction
+ * @id: The id of the transaction
+ *
+ * Reserves a response slot for a transaction that the caller will not
+ * wait for. The response may arrive in any order and is retired by the
+ * protocol thread. Must be called with the rsp mutex held and before the
+ * request is written.
+ */
+void rp_dev_post_resp(RemotePort *s, uint32_t dev, uint32_t id);
+
+/**
+ * rp_dev_drain_posted:
+ * @s: The remote-port adaptor
+ * @dev: The device/channel number
+ * @max: Number of posted transactions allowed to remain outstanding
+ *
+ * Waits until no more than @max posted transactions are outstanding
+ * for @dev. Must be called with the rsp mutex held.
+ */
+void rp_dev_drain_posted(RemotePort *s, uint32_t dev, unsigned int max);
+
 #endif
@@ -60,6 +60,13 @@ struct SSISlaveClass {
     uint32_t (*transfer_raw)(SSISlave *dev, uint32_t val, int num_bits);
     /* Call this method to set the spi mode to single, dual or quad mode */
     void (*set_data_lines)(SSISlave *dev, uint8_t val);
+    /* Optional. Clocks len bytes of data out of a selected slave as if
+     * len transfers with a zero tx byte had been made, for masters that
+     * stream large reads (e.g linear flash windows). Returns the number
+     * of bytes read, which may be 0 if the slave is not in a state that
+     * allows it, in which case the master falls back to transfer.
+     */
+    uint32_t (*read_bulk)(SSISlave *dev, uint8_t *buf, uint32_t len);
 };
 
 struct SSISlave {
@@ -89,6 +96,11 @@ SSIBus *ssi_create_bus(DeviceState *parent, const char *name);
 
 uint32_t ssi_transfer_bits(SSIBus *bus, uint32_t val, int num_bits);
 uint32_t ssi_transfer(SSIBus *bus, uint32_t val);
+/* Reads up to len bytes from the selected slave through read_bulk.
+ * Returns the number of bytes read, the remainder has to be transferred
+ * a byte at a time.
+ */
+uint32_t ssi_read_bulk(SSIBus *bus, uint8_t *buf, uint32_t len);
 
 void ssi_set_datalines(SSIBus *bus, uint8_t val);
 
@@ -18,4 +18,17 @@
 int save_snapshot(const char *name, Error **errp);
 int load_snapshot(const char *name, Error **errp);
 
+typedef struct VMCheckpoint VMCheckpoint;
+
+/*
+ * In-memory VM checkpoints: the full VM state minus block devices. Like
+ * with snapshots the VM is stopped while saving, callers should stop it
+ * before loading.
+ */
+VMCheckpoint *save_checkpoint(Error **errp);
+int load_checkpoint(VMCheckpoint *cp, Error **errp);
+size_t checkpoint_size(VMCheckpoint *cp);
+int64_t checkpoint_vm_clock(VMCheckpoint *cp);
+void free_checkpoint(VMCheckpoint *cp);
+
 #endif
@@ -21,6 +21,7 @@
 
 #include <stdio.h>
 #include <stdbool.h>
+#include "qemu/thread.h"
 
 struct etrace_entry32 {
     uint32_t duration;
@@ -39,6 +40,7 @@ enum qemu_etrace_flag {
     ETRACE_F_MEM         = (1 << 2),
     ETRACE_F_CPU         = (1 << 3),
     ETRACE_F_GPIO         = (1 << 4),
+    ETRACE_F_PROFILE      = (1 << 5),
 };
 
 enum qemu_etrace_event_u64_flag {
@@ -51,12 +53,107 @@ enum etrace_mem_attr {
     MEM_WRITE   = (1 << 0),
 };
 
+/* What to do when a producer outruns the writer thread.  */
+enum etrace_policy {
+    ETRACE_POLICY_BLOCK,    /* Stall the producer until there is room.  */
+    ETRACE_POLICY_DROP,     /* Drop the record and count it.  */
+    ETRACE_POLICY_SYNC,     /* No writer thread, fwrite from the producer.  */
+};
+
+#define ETRACE_MAX_RINGS            64
+#define ETRACE_RING_SIZE_DEFAULT    (4 * 1024 * 1024)
+
+struct etrace_stats {
+    uint64_t records;
+    uint64_t bytes;
+    uint64_t dropped_records;
+    uint64_t dropped_bytes;
+    uint64_t stalls;
+};
+
+/*
+ * Single-producer single-consumer byte ring staging whole records from
+ * one producer thread. The producer fills the record at wpos and only
+ * moves head once the record is complete, so the writer thread always
+ * drains whole records and records from different rings never interleave
+ * in the output. head and tail are free running, the position in buf is
+ * counter & (size - 1).
+ */
+struct etrace_ring {
+    struct etracer *t;
+    uint8_t *buf;
+    uint32_t size;
+
+    /* Producer owned.  */
+    uint32_t head;
+    uint32_t wpos;
+    bool rec_drop;
+    bool rec_direct;
+    bool waiting;
+    QemuSemaphore space;
+    struct etrace_stats stats;
+
+    /* Consumer owned.  */
+    uint32_t tail;
+
+    /* Ring 0 is shared by threads that didn't get a ring of their own.  */
+    bool shared;
+    QemuMutex lock;
+};
+
 struct etracer {
     const char *filename;
     FILE *fp;
+    bool fp_error;
     unsigned int arch_bits;
     uint64_t flags;
 
+    enum etrace_policy policy;
+    uint32_t ring_size;
+    struct etrace_ring *rings[ETRACE_MAX_RINGS];
+    unsigned int nr_rings;
+    QemuMutex rings_lock;
+    /*
+     * Serializes the writer thread against oversized direct records, and
+     * whole records against each other with policy=sync.
+     */
+    QemuMutex fp_lock;
+    struct {
+        QemuThread thread;
+        QemuSemaphore wakeup;
+        bool stop;
+    } writer;
+
+#define ETRACE_CHUNK_SIZE_DEFAULT   (1 * 1024 * 1024)
+    /* Bytes written to fp so far.  */
+    uint64_t offset;
+    struct {
+        bool enabled;
+        bool active;
+        uint32_t size;
+        /* Uncompressed records, parsed up to the last whole record.  */
+        uint8_t *buf;
+        size_t len;
+        size_t cap;
+        size_t parsed;
+        uint32_t nr_records;
+        uint64_t start_time;
+        uint64_t end_time;
+        uint8_t *zbuf;
+        size_t zcap;
+        GArray *index;
+    } chunk;
+
+    /* Per-TB execution counts, see etrace_profile_dump.  */
+    struct {
+        uint32_t period_ms;
+        QemuMutex lock;
+        /* Counts harvested from TBs that have been invalidated.  */
+        GHashTable *retired;
+        QemuThread thread;
+        QemuSemaphore stop;
+    } profile;
+
     /* FIXME: Removeme.  */
     unsigned int current_unit_id;
 
@@ -79,6 +176,7 @@ bool etrace_init(struct etracer *t, const char *filename,
                  const char *opts,
                  unsigned int arch_id, unsigned int arch_bits);
 void etrace_close(struct etracer *t);
+void etrace_get_stats(struct etracer *t, struct etrace_stats *st);
 void etrace_dump_exec(struct etracer *t, unsigned int unit_id,
                       uint64_t start, uint64_t end,
                       uint64_t start_time, uint32_t duration);
@@ -101,6 +199,10 @@ void etrace_dump_tb(struct etracer *t, AddressSpace *as, uint16_t unit_id,
                     size_t guest_len,
                     void *host_buf, size_t host_len);
 
+struct TranslationBlock;
+void etrace_profile_retire_tb(struct etracer *t, struct TranslationBlock *tb);
+void etrace_profile_dump(struct etracer *t);
+
 void etrace_note_write(struct etracer *t, unsigned int unit_id,
                        void *buf, size_t len);
 
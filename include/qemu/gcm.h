@@ -37,6 +37,7 @@
 #include <assert.h>
 #include <string.h>
 #include "crypto/aes.h"
+#include "crypto/cipher.h"
 
 typedef AES_KEY aes_context;
 
@@ -96,6 +97,9 @@ typedef struct {
 
     uint64_t HL[16];            /*!< Precalculated HTable */
     uint64_t HH[16];            /*!< Precalculated HTable */
+    uint8_t H[16];              /*!< Hash subkey */
+    QCryptoCipher *ctr;         /*!< Host AES-CTR, NULL if not available */
+    bool accel;                 /*!< Host acceleration, fixed at gcm_init() */
 }
 gcm_context;
 
@@ -111,9 +115,24 @@ extern "C" {
  * \param keysize   must be 128, 192 or 256
  *
  * \return          0 if successful, or POLARSSL_ERR_AES_INVALID_KEY_LENGTH
+ *
+ * \note            A context that has been initialized before must be
+ *                  released with gcm_free() first.
  */
 int gcm_init( gcm_context *ctx, const unsigned char *key, unsigned int keysize );
 
+/**
+ * \brief           Release the host resources held by a GCM context
+ */
+void gcm_free(gcm_context *ctx);
+
+/**
+ * \brief           Allow or forbid the use of host crypto acceleration
+ *                  by contexts initialized from now on, mainly for
+ *                  comparing the two paths.
+ */
+void gcm_set_accel(bool enable);
+
 void gcm_push_iv(gcm_context *ctx,
                  const unsigned char *iv,
                  size_t iv_len, size_t tag_len);
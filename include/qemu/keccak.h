@@ -0,0 +1,44 @@
+/*
+ * Keccak-f[1600] permutation and sponge absorb, shared by the SHA-3
+ * models.
+ *
+ * Copyright (c) 2020 Xilinx Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+#ifndef QEMU_KECCAK_H
+#define QEMU_KECCAK_H
+
+/* The state is 5x5 64-bit lanes, lane (x, y) is at index x + 5 * y.  */
+#define KECCAK_LANES 25
+
+/**
+ * keccak_f1600:
+ * @a: The state.
+ *
+ * Apply the 24 round Keccak-f[1600] permutation to @a.
+ */
+void keccak_f1600(uint64_t a[KECCAK_LANES]);
+
+/**
+ * keccak_absorb:
+ * @a: The state.
+ * @rate: Block size in bytes, a multiple of 8 and at most 200.
+ * @data: @nblocks blocks of @rate bytes.
+ * @nblocks: Number of blocks to absorb.
+ *
+ * XOR each block into the state, as little endian lanes, and permute.
+ * No padding is done, that's up to the caller.
+ */
+void keccak_absorb(uint64_t a[KECCAK_LANES], size_t rate,
+                   const uint8_t *data, size_t nblocks);
+
+/*
+ * Switch to the next slower implementation available on the host and
+ * return true, or return false if the portable one is already in use.
+ * For testing and benchmarking all the variants.
+ */
+bool test_keccak_next_accel(void);
+
+#endif
@@ -19,17 +19,20 @@
 #include "qapi/error.h"
 #include "qapi/qapi-types-injection.h"
 #include "qapi/qapi-commands-injection.h"
+#include "qapi/qapi-visit-injection.h"
+#include "qapi/clone-visitor.h"
 #include "qemu/timer.h"
 #include "exec/memory.h"
 #include "hw/irq.h"
 #include "qemu/log.h"
-#include "qemu/queue.h"
+#include "qemu/error-report.h"
 #include "sysemu/sysemu.h"
 #include "sysemu/runstate.h"
 #include "exec/exec-all.h"
+#include "migration/snapshot.h"
+#include "sysemu/block-backend.h"
 
 typedef struct FaultEventEntry FaultEventEntry;
-static QLIST_HEAD(, FaultEventEntry) events = QLIST_HEAD_INITIALIZER(events);
 static QEMUTimer *timer;
 
 #ifndef DEBUG_FAULT_INJECTION
@@ -123,66 +126,348 @@ ReadValue *qmp_read_mem(int64_t addr, int64_t size, bool has_cpu, int64_t cpu,
 
 struct FaultEventEntry {
     uint64_t time_ns;
+    uint64_t seq;
     int64_t val;
-    QLIST_ENTRY(FaultEventEntry) node;
+    FaultWrite *write;
 };
 
-static void mod_next_event_timer(void)
+/*
+ * Pending events, as a binary min-heap ordered on (time_ns, seq). seq keeps
+ * events that are due at the same time in the order they got scheduled.
+ * Campaigns schedule tens of thousands of events, so both scheduling and
+ * firing need to stay logarithmic.
+ */
+static FaultEventEntry **events;
+static unsigned int nr_events;
+static unsigned int events_size;
+static uint64_t next_seq;
+
+static struct {
+    uint64_t max_pending;
+    uint64_t scheduled;
+    uint64_t fired;
+    uint64_t late_ns;
+} fault_stats;
+
+static inline bool fault_event_before(FaultEventEntry *a, FaultEventEntry *b)
 {
-    uint64_t val;
-    FaultEventEntry *entry;
+    return a->time_ns < b->time_ns
+           || (a->time_ns == b->time_ns && a->seq < b->seq);
+}
 
-    if (QLIST_EMPTY(&events)) {
-        return;
-    } else {
-        val = QLIST_FIRST(&events)->time_ns;
+static void fault_event_sift_up(unsigned int pos)
+{
+    FaultEventEntry *entry = events[pos];
+
+    while (pos && fault_event_before(entry, events[(pos - 1) / 2])) {
+        events[pos] = events[(pos - 1) / 2];
+        pos = (pos - 1) / 2;
     }
+    events[pos] = entry;
+}
 
-    QLIST_FOREACH(entry, &events, node) {
-        if (val > entry->time_ns) {
-            val = entry->time_ns;
+static void fault_event_sift_down(unsigned int pos)
+{
+    FaultEventEntry *entry = events[pos];
+
+    for (;;) {
+        unsigned int child = 2 * pos + 1;
+
+        if (child >= nr_events) {
+            break;
+        }
+        if (child + 1 < nr_events
+            && fault_event_before(events[child + 1], events[child])) {
+            child++;
         }
+        if (!fault_event_before(events[child], entry)) {
+            break;
+        }
+        events[pos] = events[child];
+        pos = child;
     }
+    events[pos] = entry;
+}
 
-    timer_mod(timer, val);
+static void fault_event_reserve(unsigned int n)
+{
+    if (nr_events + n > events_size) {
+        events_size = MAX(nr_events + n, events_size * 2);
+        events = g_renew(FaultEventEntry *, events, events_size);
+    }
+}
+
+static FaultEventEntry *fault_event_pop(void)
+{
+    FaultEventEntry *entry = events[0];
+
+    events[0] = events[--nr_events];
+    if (nr_events) {
+        fault_event_sift_down(0);
+    }
+    return entry;
+}
+
+static FaultEventEntry *fault_event_new(uint64_t now, int64_t time_ns,
+                                        int64_t event_id, FaultWrite *write)
+{
+    FaultEventEntry *entry = g_new0(FaultEventEntry, 1);
+
+    entry->time_ns = now + time_ns;
+    entry->seq = next_seq++;
+    entry->val = event_id;
+    entry->write = write ? QAPI_CLONE(FaultWrite, write) : NULL;
+    return entry;
+}
+
+static void fault_event_free(FaultEventEntry *entry)
+{
+    qapi_free_FaultWrite(entry->write);
+    g_free(entry);
+}
+
+static void mod_next_event_timer(void)
+{
+    if (nr_events) {
+        timer_mod(timer, events[0]->time_ns);
+    }
+}
+
+static void fault_event_fire(FaultEventEntry *entry, uint64_t current_time)
+{
+    FaultWrite *w = entry->write;
+
+    if (w) {
+        Error *err = NULL;
+
+        qmp_write_mem(w->addr, w->val, w->size, w->has_cpu, w->cpu,
+                      w->has_qom, w->qom, w->has_debug && w->debug, &err);
+        if (err) {
+            error_report_err(err);
+        }
+    }
+
+    DPRINTF("fault %"PRId64" happened @%"PRId64"!\n", entry->val,
+            current_time);
+    qapi_event_send_fault_event(entry->val, current_time);
+    fault_stats.fired++;
+    fault_stats.late_ns += current_time - entry->time_ns;
+    fault_event_free(entry);
+    vm_stop_from_timer(RUN_STATE_DEBUG);
 }
 
 static void do_fault(void *opaque)
 {
-    FaultEventEntry *entry;
-    FaultEventEntry *next;
     uint64_t current_time = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
 
-    QLIST_FOREACH_SAFE(entry, &events, node, next) {
-        if (entry->time_ns < current_time) {
-            DPRINTF("fault %"PRId64" happened @%"PRId64"!\n", entry->val,
-                    qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL));
-            qapi_event_send_fault_event(entry->val, current_time);
-            QLIST_REMOVE(entry, node);
-            g_free(entry);
-            vm_stop_from_timer(RUN_STATE_DEBUG);
+    while (nr_events && events[0]->time_ns < current_time) {
+        fault_event_fire(fault_event_pop(), current_time);
+    }
+
+    mod_next_event_timer();
+}
+
+/*
+ * Add n new events to the heap. Small batches get sifted in one by one,
+ * large ones are cheaper to add with a single heapify pass.
+ */
+static void fault_event_add(FaultEventEntry **entries, unsigned int n)
+{
+    unsigned int old = nr_events;
+    unsigned int i;
+
+    fault_event_reserve(n);
+    memcpy(&events[nr_events], entries, n * sizeof(*entries));
+    nr_events += n;
+
+    if (n > old) {
+        for (i = nr_events / 2; i-- > 0;) {
+            fault_event_sift_down(i);
         }
+    } else {
+        for (i = old; i < nr_events; i++) {
+            fault_event_sift_up(i);
+        }
+    }
+
+    fault_stats.scheduled += n;
+    fault_stats.max_pending = MAX(fault_stats.max_pending, nr_events);
+
+    if (!timer) {
+        timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, do_fault, NULL);
     }
 
     mod_next_event_timer();
 }
 
+static bool fault_write_check(FaultWrite *w, Error **errp)
+{
+    if (w->size <= 0 || w->size > sizeof(w->val)) {
+        error_setg(errp, "Invalid write size %" PRId64, w->size);
+        return false;
+    }
+
+    if (w->has_qom) {
+        if (!object_dynamic_cast(object_resolve_path(w->qom, NULL),
+                                 TYPE_CPU)) {
+            error_setg(errp, "'%s' is not a CPU or doesn't exists", w->qom);
+            return false;
+        }
+    } else if (w->has_cpu && !qemu_get_cpu(w->cpu)) {
+        error_setg(errp, "CPU %" PRId64 " doesn't exists", w->cpu);
+        return false;
+    }
+    return true;
+}
+
 void qmp_trigger_event(int64_t time_ns, int64_t event_id, Error **errp)
 {
     FaultEventEntry *entry;
 
     DPRINTF("trigger_event(%"PRId64", %"PRId64")\n", time_ns, event_id);
 
-    entry = g_new0(FaultEventEntry, 1);
-    entry->time_ns = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + time_ns;
-    entry->val = event_id;
-    QLIST_INSERT_HEAD(&events, entry, node);
+    entry = fault_event_new(qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL), time_ns,
+                            event_id, NULL);
+    fault_event_add(&entry, 1);
+}
 
-    if (!timer) {
-        timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, do_fault, NULL);
+void qmp_trigger_events(FaultEventList *list, Error **errp)
+{
+    uint64_t now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    GPtrArray *batch = g_ptr_array_new();
+    FaultEventList *l;
+    unsigned int i;
+
+    for (l = list; l; l = l->next) {
+        FaultEvent *ev = l->value;
+
+        if (ev->has_write && !fault_write_check(ev->write, errp)) {
+            for (i = 0; i < batch->len; i++) {
+                fault_event_free(g_ptr_array_index(batch, i));
+            }
+            g_ptr_array_free(batch, true);
+            return;
+        }
+        g_ptr_array_add(batch, fault_event_new(now, ev->time_ns, ev->event_id,
+                                               ev->has_write ? ev->write
+                                                             : NULL));
     }
 
-    mod_next_event_timer();
+    DPRINTF("trigger_events(%u)\n", batch->len);
+    if (batch->len) {
+        fault_event_add((FaultEventEntry **) batch->pdata, batch->len);
+    }
+    g_ptr_array_free(batch, true);
+}
+
+FaultEventStats *qmp_query_fault_events(Error **errp)
+{
+    FaultEventStats *stats = g_new0(FaultEventStats, 1);
+
+    stats->pending = nr_events;
+    stats->max_pending = fault_stats.max_pending;
+    stats->scheduled = fault_stats.scheduled;
+    stats->fired = fault_stats.fired;
+    stats->late_ns = fault_stats.late_ns;
+    if (nr_events) {
+        stats->has_next_ns = true;
+        stats->next_ns = events[0]->time_ns;
+    }
+    return stats;
+}
+
+static struct {
+    VMCheckpoint *cp;
+    uint64_t restores;
+} checkpoint;
+
+static CheckpointInfo *checkpoint_info(void)
+{
+    CheckpointInfo *info = g_new0(CheckpointInfo, 1);
+
+    info->size = checkpoint_size(checkpoint.cp);
+    info->time_ns = checkpoint_vm_clock(checkpoint.cp);
+    info->restores = checkpoint.restores;
+    return info;
+}
+
+/*
+ * A restore only rolls back RAM and device state, whatever the guest
+ * wrote to a disk since the checkpoint would survive it. That includes
+ * snapshot=on drives, their temporary overlay is just another writable
+ * image. Only allow checkpoints while all the disks are read-only.
+ */
+static bool checkpoint_disks_ok(Error **errp)
+{
+    BlockBackend *blk = NULL;
+
+    while ((blk = blk_all_next(blk)) != NULL) {
+        char *id;
+
+        if (!blk_get_attached_dev(blk) || !blk_is_inserted(blk) ||
+            blk_is_read_only(blk)) {
+            continue;
+        }
+        id = blk_get_attached_dev_id(blk);
+        error_setg(errp, "Device '%s' has a writable block device, "
+                   "checkpoints don't cover disk contents", id);
+        error_append_hint(errp, "Use read-only drives for fault "
+                          "campaigns.\n");
+        g_free(id);
+        return false;
+    }
+    return true;
+}
+
+CheckpointInfo *qmp_checkpoint_save(Error **errp)
+{
+    VMCheckpoint *cp;
+
+    if (!checkpoint_disks_ok(errp)) {
+        return NULL;
+    }
+
+    cp = save_checkpoint(errp);
+    if (!cp) {
+        return NULL;
+    }
+
+    free_checkpoint(checkpoint.cp);
+    checkpoint.cp = cp;
+    checkpoint.restores = 0;
+    DPRINTF("checkpoint @%"PRId64", %zu bytes\n", checkpoint_vm_clock(cp),
+            checkpoint_size(cp));
+    return checkpoint_info();
+}
+
+CheckpointInfo *qmp_checkpoint_restore(Error **errp)
+{
+    int saved_vm_running = runstate_is_running();
+
+    if (!checkpoint.cp) {
+        error_setg(errp, "No checkpoint has been taken");
+        return NULL;
+    }
+
+    vm_stop(RUN_STATE_RESTORE_VM);
+
+    /* The guest clock goes back, pending events belong to the last run.  */
+    while (nr_events) {
+        fault_event_free(fault_event_pop());
+    }
+    if (timer) {
+        timer_del(timer);
+    }
+
+    if (load_checkpoint(checkpoint.cp, errp) < 0) {
+        return NULL;
+    }
+    checkpoint.restores++;
+
+    if (saved_vm_running) {
+        vm_start();
+    }
+    return checkpoint_info();
 }
 
 void qmp_inject_gpio(const char *device_name, bool has_gpio, const char *gpio,
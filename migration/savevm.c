@@ -2908,6 +2908,156 @@ err_drain:
     return ret;
 }
 
+/*
+ * In-memory checkpoints. Same stream as a snapshot, but kept in host
+ * memory rather than in a block device so it can be restored over and
+ * over again cheaply. Block devices are not part of a checkpoint.
+ */
+struct VMCheckpoint {
+    GByteArray *data;
+    int64_t vm_clock_nsec;
+};
+
+static ssize_t checkpoint_writev_buffer(void *opaque, struct iovec *iov,
+                                        int iovcnt, int64_t pos, Error **errp)
+{
+    VMCheckpoint *cp = opaque;
+    ssize_t len = 0;
+    int i;
+
+    assert(pos == cp->data->len);
+    for (i = 0; i < iovcnt; i++) {
+        g_byte_array_append(cp->data, iov[i].iov_base, iov[i].iov_len);
+        len += iov[i].iov_len;
+    }
+    return len;
+}
+
+static ssize_t checkpoint_get_buffer(void *opaque, uint8_t *buf, int64_t pos,
+                                     size_t size, Error **errp)
+{
+    VMCheckpoint *cp = opaque;
+
+    if (pos >= cp->data->len) {
+        return 0;
+    }
+    size = MIN(size, cp->data->len - pos);
+    memcpy(buf, cp->data->data + pos, size);
+    return size;
+}
+
+static int checkpoint_fclose(void *opaque, Error **errp)
+{
+    return 0;
+}
+
+static const QEMUFileOps checkpoint_read_ops = {
+    .get_buffer = checkpoint_get_buffer,
+    .close =      checkpoint_fclose
+};
+
+static const QEMUFileOps checkpoint_write_ops = {
+    .writev_buffer = checkpoint_writev_buffer,
+    .close =         checkpoint_fclose
+};
+
+VMCheckpoint *save_checkpoint(Error **errp)
+{
+    VMCheckpoint *cp;
+    QEMUFile *f;
+    int saved_vm_running;
+    int ret;
+
+    if (migration_is_blocked(errp)) {
+        return NULL;
+    }
+
+    if (!replay_can_snapshot()) {
+        error_setg(errp, "Record/replay does not allow making checkpoint "
+                   "right now. Try once more later.");
+        return NULL;
+    }
+
+    saved_vm_running = runstate_is_running();
+
+    if (global_state_store()) {
+        error_setg(errp, "Error saving global state");
+        return NULL;
+    }
+    vm_stop(RUN_STATE_SAVE_VM);
+
+    bdrv_drain_all_begin();
+
+    cp = g_new0(VMCheckpoint, 1);
+    cp->data = g_byte_array_new();
+    cp->vm_clock_nsec = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+
+    f = qemu_fopen_ops(cp, &checkpoint_write_ops);
+    ret = qemu_savevm_state(f, errp);
+    qemu_fclose(f);
+    if (ret < 0) {
+        free_checkpoint(cp);
+        cp = NULL;
+    }
+
+    bdrv_drain_all_end();
+
+    if (saved_vm_running) {
+        vm_start();
+    }
+    return cp;
+}
+
+int load_checkpoint(VMCheckpoint *cp, Error **errp)
+{
+    MigrationIncomingState *mis = migration_incoming_get_current();
+    QEMUFile *f;
+    int ret;
+
+    if (!replay_can_snapshot()) {
+        error_setg(errp, "Record/replay does not allow loading checkpoint "
+                   "right now. Try once more later.");
+        return -EINVAL;
+    }
+
+    /* Flush all IO requests so they don't interfere with the new state.  */
+    bdrv_drain_all_begin();
+
+    f = qemu_fopen_ops(cp, &checkpoint_read_ops);
+    qemu_system_reset(SHUTDOWN_CAUSE_NONE);
+    mis->from_src_file = f;
+
+    ret = qemu_loadvm_state(f);
+    migration_incoming_state_destroy();
+
+    bdrv_drain_all_end();
+
+    if (ret < 0) {
+        error_setg(errp, "Error %d while loading VM state", ret);
+        return ret;
+    }
+
+    return 0;
+}
+
+size_t checkpoint_size(VMCheckpoint *cp)
+{
+    return cp->data->len;
+}
+
+int64_t checkpoint_vm_clock(VMCheckpoint *cp)
+{
+    return cp->vm_clock_nsec;
+}
+
+void free_checkpoint(VMCheckpoint *cp)
+{
+    if (cp) {
+        g_byte_array_free(cp->data, true);
+        g_free(cp);
+    }
+}
+
 void vmstate_register_ram(MemoryRegion *mr, DeviceState *dev)
 {
     qemu_ram_set_idstr(mr->ram_block,
@@ -386,7 +386,9 @@ Dump an execution trace to @var{path}.
 ETEXI
 
 DEF("etrace-flags", HAS_ARG, QEMU_OPTION_etrace_flags,
-    "-etrace-flags FLAGS  Execution trace flags\n\texec,translation,mem,cpu\n", QEMU_ARCH_ALL)
+    "-etrace-flags FLAGS  Execution trace flags\n\texec,translation,mem,cpu\n"
+    "\tpolicy=block|drop|sync,buffer=SIZE\n"
+    "\tcompress=on|off,chunk=SIZE,profile-period=MS\n", QEMU_ARCH_ALL)
 STEXI
 @item -etrace-flags
 @findex -etrace-flags
@@ -397,7 +399,30 @@ exec          Trace instruction execution.
 translation   Trace TB translation with TB contents. (for off-line disassembly)
 mem           Trace memory accesses (Only MMIO at the moment).
 cpu           Trace CPU register state (slow, currently not binary).
+profile       Count executions per TB and dump a histogram at exit.
+all           All of the above but profile.
 @end example
+
+The @code{profile} flag makes each translated block count its own
+executions. Instead of a record per execution, a single histogram of
+all blocks, hottest first, is written when the trace is closed and
+additionally every @code{profile-period=MS} milliseconds when set.
+
+Records are staged in a per-thread ring buffer and written out by a
+separate thread. The following options control the staging:
+
+@example
+policy=block  Stall the vCPU when its ring is full (default, lossless).
+policy=drop   Drop records that don't fit and report the count at exit.
+policy=sync   Write records synchronously from the vCPU thread.
+buffer=SIZE   Size of each ring, a power of 2 (default 4M).
+@end example
+
+With @code{compress=on}, the records following the INFO and ARCH
+preamble are cut into independently deflated chunks of @code{chunk=SIZE}
+uncompressed bytes (default 1M). Each chunk carries the time range of its
+records and an index of all chunks is appended when the trace is closed,
+so tools can seek to a time window without decoding the whole file.
 ETEXI
 
 DEF("mem-path", HAS_ARG, QEMU_OPTION_mempath,
@@ -3389,6 +3414,11 @@ STEXI
 Use @var{file} as a device tree binary (dtb) image used to create the
 emulated machine. This dtb will not be passed to the kernel, use -dtb
 for that.
+
+With @option{-machine hw-dtb-cache=@var{dir}}, the instantiation order and
+the compatible to device type mapping worked out from the dtb are saved in
+@var{dir} on the first boot and reused by later boots of the same dtb with
+the same QEMU binary.
 ETEXI
 
 DEF("dtb", HAS_ARG, QEMU_OPTION_dtb, \
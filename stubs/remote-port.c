@@ -0,0 +1,15 @@
+/*
+ * QEMU remote port stubs for builds without remote port support.
+ *
+ * Copyright (c) 2020 Xilinx Inc.
+ *
+ * This code is licensed under the GNU GPL.
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/qapi-commands-remote-port.h"
+
+RemotePortStatsList *qmp_query_remote_port(Error **errp)
+{
+    return NULL;
+}
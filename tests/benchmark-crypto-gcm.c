@@ -0,0 +1,109 @@
+/*
+ * QEMU AES-GCM streaming speed benchmark
+ *
+ * Copyright (c) 2020 Xilinx Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "qemu/units.h"
+#include "crypto/init.h"
+#include "qemu/gcm.h"
+
+/*
+ * Mimic the way the ZynqMP CSU AES model drives the GCM code: one
+ * message per image, a 12 byte IV and the payload pushed in DMA sized
+ * chunks (up to 8K at a time), with the tag emitted at the end.
+ */
+#define GCM_IMAGE_SIZE  (4 * MiB)
+
+static void test_gcm_speed(size_t chunk_size, int mode, bool accel)
+{
+    const size_t total = 256 * MiB;
+    gcm_context ctx = { 0 };
+    uint8_t key[32], iv[12], tag[16];
+    uint8_t *in, *out;
+    size_t remain;
+
+    memset(key, g_test_rand_int(), sizeof(key));
+    memset(iv, g_test_rand_int(), sizeof(iv));
+    in = g_new(uint8_t, chunk_size);
+    out = g_new(uint8_t, chunk_size);
+    memset(in, g_test_rand_int(), chunk_size);
+
+    gcm_set_accel(accel);
+
+    g_test_timer_start();
+    remain = total;
+    while (remain) {
+        size_t image = GCM_IMAGE_SIZE;
+
+        gcm_free(&ctx);
+        g_assert(gcm_init(&ctx, key, 256) == 0);
+        gcm_push_iv(&ctx, iv, sizeof(iv), sizeof(tag));
+        while (image) {
+            gcm_push_data(&ctx, mode, out, in, chunk_size);
+            image -= chunk_size;
+        }
+        gcm_emit_tag(&ctx, tag, sizeof(tag));
+        remain -= GCM_IMAGE_SIZE;
+    }
+    g_test_timer_elapsed();
+
+    g_print("%s %s chunk %zu bytes ", accel ? "host" : "soft",
+            mode == GCM_ENCRYPT ? "enc" : "dec", chunk_size);
+    g_print("%.2f MB/sec ", (double)total / MiB / g_test_timer_last());
+
+    gcm_free(&ctx);
+    gcm_set_accel(true);
+    g_free(in);
+    g_free(out);
+}
+
+static void test_gcm_speed_enc_host(const void *opaque)
+{
+    test_gcm_speed((size_t)opaque, GCM_ENCRYPT, true);
+}
+
+static void test_gcm_speed_dec_host(const void *opaque)
+{
+    test_gcm_speed((size_t)opaque, GCM_DECRYPT, true);
+}
+
+static void test_gcm_speed_enc_soft(const void *opaque)
+{
+    test_gcm_speed((size_t)opaque, GCM_ENCRYPT, false);
+}
+
+static void test_gcm_speed_dec_soft(const void *opaque)
+{
+    test_gcm_speed((size_t)opaque, GCM_DECRYPT, false);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    g_assert(qcrypto_init(NULL) == 0);
+
+#define ADD_TEST(mode, path, chunk)                                     \
+    g_test_add_data_func(                                               \
+        "/crypto/gcm/csu-" #mode "-" #path "/chunk-" #chunk,            \
+        (void *)chunk, test_gcm_speed_ ## mode ## _ ## path)
+
+#define ADD_TESTS(chunk)                        \
+    do {                                        \
+        ADD_TEST(enc, host, chunk);             \
+        ADD_TEST(dec, host, chunk);             \
+        ADD_TEST(enc, soft, chunk);             \
+        ADD_TEST(dec, soft, chunk);             \
+    } while (0)
+
+    ADD_TESTS(256);
+    ADD_TESTS(1024);
+    ADD_TESTS(4096);
+    ADD_TESTS(8192);
+
+    return g_test_run();
+}
@@ -0,0 +1,61 @@
+/*
+ * Keccak-f[1600] absorb speed benchmark
+ *
+ * Copyright (c) 2020 Xilinx Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "qemu/units.h"
+#include "qemu/keccak.h"
+
+/* SHA3-384 rate, the only one the ZynqMP CSU uses.  */
+#define SHA3_384_RATE 104
+
+static void test_keccak_speed(size_t chunk_size)
+{
+    const size_t total = 64 * MiB;
+    uint64_t a[KECCAK_LANES] = { 0 };
+    size_t nblocks = chunk_size / SHA3_384_RATE;
+    uint8_t *in = g_new(uint8_t, nblocks * SHA3_384_RATE);
+    size_t remain;
+    int variant = 0;
+
+    memset(in, g_test_rand_int(), nblocks * SHA3_384_RATE);
+
+    do {
+        g_test_timer_start();
+        for (remain = total; remain >= nblocks * SHA3_384_RATE;
+             remain -= nblocks * SHA3_384_RATE) {
+            keccak_absorb(a, SHA3_384_RATE, in, nblocks);
+        }
+        g_test_timer_elapsed();
+
+        g_print("variant %d chunk %zu bytes ", variant++, chunk_size);
+        g_print("%.2f MB/sec ", (double)total / MiB / g_test_timer_last());
+    } while (test_keccak_next_accel());
+
+    g_free(in);
+}
+
+static void test_keccak_speed_chunk(const void *opaque)
+{
+    test_keccak_speed((size_t)opaque);
+}
+
+int main(int argc, char **argv)
+{
+    size_t i;
+    char name[64];
+
+    g_test_init(&argc, &argv, NULL);
+
+    for (i = 4 * KiB; i <= 64 * KiB; i *= 4) {
+        snprintf(name, sizeof(name), "/keccak/absorb/%zu", i);
+        g_test_add_data_func(name, (void *)i, test_keccak_speed_chunk);
+    }
+
+    return g_test_run();
+}
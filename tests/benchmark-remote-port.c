@@ -0,0 +1,339 @@
+/*
+ * QEMU remote-port transport benchmark
+ *
+ * Copyright (c) 2020 Xilinx Inc.
+ *
+ * Boots an arm-generic-fdt machine whose hardware DTB puts a remote-port
+ * memory master in front of the loopback peer, then drives MMIO, bulk
+ * transfers and syncs through it with qtest. Every operation crosses
+ * the real adaptor in remote-port.c, over each transport, and the
+ * round-trip rates and bandwidth are reported so that overhead
+ * regressions show up without an external simulator.
+ *
+ * This code is licensed under the GNU GPL.
+ */
+#include "qemu/osdep.h"
+#include "qemu/units.h"
+#include "qemu/thread.h"
+#include "qemu/sockets.h"
+#include "qapi/error.h"
+#include "libqtest.h"
+#include "contrib/remote-port-peer/rp-peer.h"
+
+#include <libfdt.h>
+
+#define BENCH_MEM_BASE      0xa0000000ULL
+#define BENCH_MEM_SIZE      (16 * MiB)
+#define BENCH_RAM_SIZE      (128 * MiB)
+#define BENCH_DTB_SIZE      (4 * KiB)
+#define BENCH_SHM_POLL      1000
+#define BENCH_SYNC_QUANTUM  (10 * 1000)
+#define BENCH_RP_PHANDLE    1
+#define BENCH_RP_DEV        9
+
+typedef enum {
+    BENCH_SOCKET,
+    BENCH_SHM,
+} BenchTransport;
+
+static const char *transport_names[] = {
+    [BENCH_SOCKET] = "socket",
+    [BENCH_SHM] = "shm",
+};
+
+typedef struct Bench {
+    BenchTransport transport;
+    QTestState *qts;
+    RPPeer peer;
+    QemuThread thread;
+    int listen_fd;
+    RemotePortShm *shm;
+    char *dir;
+    char *path;
+    char *dtb;
+} Bench;
+
+typedef struct BenchCase {
+    BenchTransport transport;
+    bool sync;
+    void (*fn)(Bench *b);
+} BenchCase;
+
+static void bench_fdt_cells(void *fdt, const char *name,
+                            const uint32_t *cells, int n)
+{
+    uint32_t be[4];
+    int i;
+
+    g_assert(n <= ARRAY_SIZE(be));
+    for (i = 0; i < n; i++) {
+        be[i] = cpu_to_be32(cells[i]);
+    }
+    g_assert(fdt_property(fdt, name, be, n * sizeof be[0]) == 0);
+}
+
+/*
+ * The smallest hardware description that puts the peer on the bus: some
+ * RAM for the machine, the adaptor and a memory master covering the
+ * peer's memory model.
+ */
+static void bench_make_dtb(Bench *b, bool sync)
+{
+    const uint32_t ram[] = { 0, 0, 0, BENCH_RAM_SIZE };
+    const uint32_t mm[] = { BENCH_MEM_BASE >> 32, (uint32_t) BENCH_MEM_BASE,
+                            0, BENCH_MEM_SIZE };
+    const uint32_t rp[] = { BENCH_RP_PHANDLE, BENCH_RP_DEV };
+    const uint64_t quantum = cpu_to_be64(BENCH_SYNC_QUANTUM);
+    void *fdt = g_malloc0(BENCH_DTB_SIZE);
+    char *node;
+
+    g_assert(fdt_create(fdt, BENCH_DTB_SIZE) == 0);
+    g_assert(fdt_finish_reservemap(fdt) == 0);
+    g_assert(fdt_begin_node(fdt, "") == 0);
+    g_assert(fdt_property_cell(fdt, "#address-cells", 2) == 0);
+    g_assert(fdt_property_cell(fdt, "#size-cells", 2) == 0);
+
+    g_assert(fdt_begin_node(fdt, "memory") == 0);
+    g_assert(fdt_property_string(fdt, "compatible",
+                                 "qemu:memory-region") == 0);
+    g_assert(fdt_property_cell(fdt, "qemu,ram", 1) == 0);
+    bench_fdt_cells(fdt, "reg", ram, ARRAY_SIZE(ram));
+    g_assert(fdt_end_node(fdt) == 0);
+
+    g_assert(fdt_begin_node(fdt, "cosim") == 0);
+    g_assert(fdt_property_string(fdt, "compatible", "remote-port") == 0);
+    g_assert(fdt_property_cell(fdt, "phandle", BENCH_RP_PHANDLE) == 0);
+    if (b->transport == BENCH_SHM) {
+        g_assert(fdt_property_string(fdt, "shm-path", b->path) == 0);
+        g_assert(fdt_property_cell(fdt, "shm-poll", BENCH_SHM_POLL) == 0);
+    } else {
+        node = g_strdup_printf("unix:%s", b->path);
+        g_assert(fdt_property_string(fdt, "chardesc", node) == 0);
+        g_free(node);
+    }
+    g_assert(fdt_property_cell(fdt, "sync", sync) == 0);
+    g_assert(fdt_property(fdt, "sync-quantum", &quantum,
+                          sizeof quantum) == 0);
+    g_assert(fdt_end_node(fdt) == 0);
+
+    node = g_strdup_printf("rp-mm@%" PRIx64, (uint64_t) BENCH_MEM_BASE);
+    g_assert(fdt_begin_node(fdt, node) == 0);
+    g_free(node);
+    g_assert(fdt_property_string(fdt, "compatible",
+                                 "remote-port-memory-master") == 0);
+    bench_fdt_cells(fdt, "remote-ports", rp, ARRAY_SIZE(rp));
+    bench_fdt_cells(fdt, "reg", mm, ARRAY_SIZE(mm));
+    g_assert(fdt_end_node(fdt) == 0);
+
+    g_assert(fdt_end_node(fdt) == 0);
+    g_assert(fdt_finish(fdt) == 0);
+
+    b->dtb = g_build_filename(b->dir, "hw.dtb", NULL);
+    g_assert(g_file_set_contents(b->dtb, fdt, fdt_totalsize(fdt), NULL));
+    g_free(fdt);
+}
+
+static void *bench_peer_thread(void *opaque)
+{
+    Bench *b = opaque;
+
+    if (b->transport == BENCH_SHM) {
+        int64_t deadline = g_get_monotonic_time()
+                           + RP_SHM_ATTACH_TIMEOUT_MS * 1000;
+
+        /* QEMU creates the ring while realizing the adaptor.  */
+        while (!g_file_test(b->path, G_FILE_TEST_EXISTS)) {
+            g_assert(g_get_monotonic_time() < deadline);
+            g_usleep(1000);
+        }
+        b->shm = rp_shm_attach(b->path, BENCH_SHM_POLL, &error_abort);
+        rp_peer_init(&b->peer, -1, b->shm, BENCH_MEM_BASE, BENCH_MEM_SIZE);
+    } else {
+        int fd = qemu_accept(b->listen_fd, NULL, NULL);
+
+        g_assert(fd >= 0);
+        rp_peer_init(&b->peer, fd, NULL, BENCH_MEM_BASE, BENCH_MEM_SIZE);
+    }
+
+    rp_peer_say_hello(&b->peer);
+    while (rp_peer_serve_one(&b->peer)) {
+        /* Serve until QEMU goes away.  */
+    }
+    return NULL;
+}
+
+static void bench_start(Bench *b, BenchTransport transport, bool sync)
+{
+    memset(b, 0, sizeof *b);
+    b->transport = transport;
+    b->listen_fd = -1;
+
+    b->dir = g_dir_make_tmp("rp-bench-XXXXXX", NULL);
+    g_assert(b->dir);
+    if (transport == BENCH_SHM) {
+        b->path = g_build_filename(b->dir, "ring", NULL);
+    } else {
+        b->path = g_build_filename(b->dir, "sock", NULL);
+        b->listen_fd = unix_listen(b->path, &error_abort);
+    }
+    bench_make_dtb(b, sync);
+
+    qemu_thread_create(&b->thread, "rp-peer", bench_peer_thread, b,
+                       QEMU_THREAD_JOINABLE);
+
+    b->qts = qtest_initf("-machine arm-generic-fdt,hw-dtb=%s -m %u",
+                         b->dtb, (unsigned) (BENCH_RAM_SIZE / MiB));
+}
+
+static void bench_stop(Bench *b)
+{
+    /* QEMU going away makes the peer thread exit.  */
+    qtest_quit(b->qts);
+    qemu_thread_join(&b->thread);
+
+    if (b->transport == BENCH_SHM) {
+        rp_shm_close(b->shm);
+    } else {
+        close(b->listen_fd);
+    }
+    rp_peer_cleanup(&b->peer);
+
+    unlink(b->path);
+    unlink(b->dtb);
+    rmdir(b->dir);
+    g_free(b->path);
+    g_free(b->dtb);
+    g_free(b->dir);
+}
+
+static void bench_mmio(Bench *b, bool write)
+{
+    const unsigned int ops = 20 * 1000;
+    unsigned int i;
+
+    /* Make sure the memory model really is behind the adaptor.  */
+    qtest_writel(b->qts, BENCH_MEM_BASE + 0x1000, 0x12345678);
+    g_assert_cmphex(qtest_readl(b->qts, BENCH_MEM_BASE + 0x1000), ==,
+                    0x12345678);
+
+    g_test_timer_start();
+    for (i = 0; i < ops; i++) {
+        uint64_t addr = BENCH_MEM_BASE + ((i * 4) & (BENCH_MEM_SIZE - 1));
+
+        if (write) {
+            qtest_writel(b->qts, addr, i);
+        } else {
+            qtest_readl(b->qts, addr);
+        }
+    }
+    g_test_timer_elapsed();
+
+    g_print("%s: 32-bit MMIO %s %.0f ops/sec ",
+            transport_names[b->transport], write ? "write" : "read",
+            ops / g_test_timer_last());
+}
+
+static void bench_mmio_read(Bench *b)
+{
+    bench_mmio(b, false);
+}
+
+static void bench_mmio_write(Bench *b)
+{
+    bench_mmio(b, true);
+}
+
+static void bench_stream(Bench *b)
+{
+    const size_t chunk = 64 * KiB;
+    const size_t total = 64 * MiB;
+    uint8_t *buf = g_malloc(chunk);
+    uint8_t *check = g_malloc(chunk);
+    size_t done;
+
+    memset(buf, g_test_rand_int(), chunk);
+
+    g_test_timer_start();
+    for (done = 0; done < total; done += chunk) {
+        qtest_bufwrite(b->qts, BENCH_MEM_BASE + (done & (BENCH_MEM_SIZE - 1)),
+                       buf, chunk);
+    }
+    g_test_timer_elapsed();
+
+    qtest_bufread(b->qts, BENCH_MEM_BASE, check, chunk);
+    g_assert(memcmp(buf, check, chunk) == 0);
+
+    g_print("%s: stream %zu MB in %zu KB writes %.2f MB/sec ",
+            transport_names[b->transport], total / MiB, chunk / KiB,
+            (double) total / MiB / g_test_timer_last());
+    g_free(check);
+    g_free(buf);
+}
+
+static void bench_sync_rate(Bench *b)
+{
+    const int64_t span = 1 * NANOSECONDS_PER_SECOND;
+    uint64_t syncs = b->peer.stats.syncs;
+
+    /*
+     * Every quantum of virtual time is a sync round-trip with the peer.
+     * The count is only sampled, give or take the sync in flight.
+     */
+    g_test_timer_start();
+    qtest_clock_step(b->qts, span);
+    g_test_timer_elapsed();
+
+    syncs = b->peer.stats.syncs - syncs;
+    g_assert_cmpuint(syncs, >, 0);
+    g_print("%s: sync %.0f syncs/sec ", transport_names[b->transport],
+            syncs / g_test_timer_last());
+}
+
+static void test_remote_port_speed(const void *opaque)
+{
+    const BenchCase *c = opaque;
+    Bench b;
+
+    bench_start(&b, c->transport, c->sync);
+    c->fn(&b);
+    bench_stop(&b);
+}
+
+int main(int argc, char **argv)
+{
+    static const struct {
+        const char *name;
+        bool sync;
+        void (*fn)(Bench *b);
+    } ops[] = {
+        { "mmio-read", false, bench_mmio_read },
+        { "mmio-write", false, bench_mmio_write },
+        { "stream", false, bench_stream },
+        { "sync", true, bench_sync_rate },
+    };
+    static BenchCase cases[ARRAY_SIZE(transport_names) * ARRAY_SIZE(ops)];
+    char name[64];
+    size_t t, i;
+
+    g_test_init(&argc, &argv, NULL);
+
+    if (!getenv("QTEST_QEMU_BINARY")) {
+        g_printerr("QTEST_QEMU_BINARY must point to qemu-system-aarch64\n");
+        return 0;
+    }
+
+    for (t = 0; t < ARRAY_SIZE(transport_names); t++) {
+        for (i = 0; i < ARRAY_SIZE(ops); i++) {
+            BenchCase *c = &cases[t * ARRAY_SIZE(ops) + i];
+
+            c->transport = t;
+            c->sync = ops[i].sync;
+            c->fn = ops[i].fn;
+            snprintf(name, sizeof(name), "/remote-port/%s/%s",
+                     transport_names[t], ops[i].name);
+            g_test_add_data_func(name, c, test_remote_port_speed);
+        }
+    }
+
+    return g_test_run();
+}
@@ -350,6 +350,97 @@ static void test_write_page_mem(void)
 
 static char tmp_path[] = "/tmp/qtest.m25p80.XXXXXX";
 
+static void write_page(uint32_t addr)
+{
+    int i;
+
+    spi_conf(CONF_ENABLE_W0);
+
+    spi_ctrl_start_user();
+    writeb(ASPEED_FLASH_BASE, EN_4BYTE_ADDR);
+    writeb(ASPEED_FLASH_BASE, WREN);
+    writeb(ASPEED_FLASH_BASE, PP);
+    writel(ASPEED_FLASH_BASE, make_be32(addr));
+
+    /* Fill the page with its own addresses */
+    for (i = 0; i < PAGE_SIZE / 4; i++) {
+        writel(ASPEED_FLASH_BASE, make_be32(addr + i * 4));
+    }
+    spi_ctrl_stop_user();
+
+    spi_conf_remove(CONF_ENABLE_W0);
+}
+
+/* Checks whether the image file has the page written by write_page */
+static bool image_has_page(const char *path, uint32_t addr)
+{
+    uint32_t page[PAGE_SIZE / 4];
+    int fd;
+    int i;
+
+    fd = open(path, O_RDONLY);
+    g_assert(fd >= 0);
+    g_assert(pread(fd, page, PAGE_SIZE, addr) == PAGE_SIZE);
+    close(fd);
+
+    for (i = 0; i < PAGE_SIZE / 4; i++) {
+        if (be32_to_cpu(page[i]) != addr + i * 4) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void test_write_back_mode(bool write_back)
+{
+    char path[] = "/tmp/qtest.m25p80.wb.XXXXXX";
+    uint32_t my_page_addr = 0x16000 * PAGE_SIZE;
+    QTestState *main_qtest = global_qtest;
+    int ret;
+    int fd;
+
+    fd = mkstemp(path);
+    g_assert(fd >= 0);
+    ret = ftruncate(fd, FLASH_SIZE);
+    g_assert(ret == 0);
+    close(fd);
+
+    global_qtest = qtest_initf("-m 256 -machine palmetto-bmc "
+                               "-drive file=%s,format=raw,if=mtd "
+                               "-global n25q256a.write-back=%s "
+                               "-global n25q256a.write-back-idle-ms=%u",
+                               path, write_back ? "on" : "off",
+                               UINT32_MAX);
+
+    write_page(my_page_addr);
+
+    /*
+     * The page stays in memory until something flushes it, the idle
+     * flush is pushed out of reach so that only stop can.
+     */
+    if (write_back) {
+        g_assert_false(image_has_page(path, my_page_addr));
+    }
+
+    /* Stopping the VM drains the block layer, and writes back first */
+    qtest_qmp_assert_success(global_qtest, "{ 'execute': 'stop' }");
+    g_assert_true(image_has_page(path, my_page_addr));
+
+    qtest_quit(global_qtest);
+    global_qtest = main_qtest;
+    unlink(path);
+}
+
+static void test_write_back(void)
+{
+    test_write_back_mode(true);
+}
+
+static void test_write_through(void)
+{
+    test_write_back_mode(false);
+}
+
 int main(int argc, char **argv)
 {
     int ret;
@@ -373,6 +464,8 @@ int main(int argc, char **argv)
     qtest_add_func("/m25p80/write_page", test_write_page);
     qtest_add_func("/m25p80/read_page_mem", test_read_page_mem);
     qtest_add_func("/m25p80/write_page_mem", test_write_page_mem);
+    qtest_add_func("/m25p80/write_back", test_write_back);
+    qtest_add_func("/m25p80/write_through", test_write_through);
 
     ret = g_test_run();
 
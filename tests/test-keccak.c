@@ -0,0 +1,119 @@
+/*
+ * Keccak-f[1600] known answer tests
+ *
+ * Copyright (c) 2020 Xilinx Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "qemu/keccak.h"
+
+#define SHA3_384_RATE 104
+
+/* Padded SHA3-384 on top of keccak_absorb, the way the CSU model does it.  */
+static char *sha3_384_hex(const uint8_t *data, size_t len)
+{
+    uint64_t a[KECCAK_LANES] = { 0 };
+    uint8_t last[SHA3_384_RATE] = { 0 };
+    uint8_t digest[48];
+    size_t nblocks = len / SHA3_384_RATE;
+    GString *hex = g_string_new(NULL);
+    int i;
+
+    keccak_absorb(a, SHA3_384_RATE, data, nblocks);
+    memcpy(last, data + nblocks * SHA3_384_RATE, len % SHA3_384_RATE);
+    last[len % SHA3_384_RATE] ^= 0x06;
+    last[SHA3_384_RATE - 1] ^= 0x80;
+    keccak_absorb(a, SHA3_384_RATE, last, 1);
+
+    for (i = 0; i < ARRAY_SIZE(digest); i++) {
+        digest[i] = a[i / 8] >> (8 * (i % 8));
+        g_string_append_printf(hex, "%02x", digest[i]);
+    }
+    return g_string_free(hex, false);
+}
+
+static const struct {
+    const char *msg;
+    size_t repeat;
+    const char *digest;
+} sha3_384_kat[] = {
+    { "", 1,
+      "0c63a75b845e4f7d01107d852e4c2485c51a50aaaa94fc61"
+      "995e71bbee983a2ac3713831264adb47fb6bd1e058d5f004" },
+    { "abc", 1,
+      "ec01498288516fc926459f58e2c6ad8df9b473cb0fc08c25"
+      "96da7cf0e49be4b298d88cea927ac7f539f1edf228376d25" },
+    { "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", 1,
+      "991c665755eb3a4b6bbdfb75c78a492e8c56a22c5c4d7e42"
+      "9bfdbc32b9d4ad5aa04a1f076e62fea19eef51acd0657c22" },
+    /* Exactly one block, the padding goes into a block of its own.  */
+    { "\xa3", 104,
+      "27ac5ebc6f9995eb1038253a951df5471c866f4c764a8509"
+      "1124be6acd81e369c14b5323bbcd2b39310d5e2768317cbd" },
+    { "\xa3", 200,
+      "1881de2ca7e41ef95dc4732b8f5f002b189cc1e42b74168e"
+      "d1732649ce1dbcdd76197a31fd55ee989f2d7050dd473e8f" },
+};
+
+static void test_permute_zero(void)
+{
+    uint64_t a[KECCAK_LANES] = { 0 };
+
+    keccak_f1600(a);
+    g_assert_cmphex(a[0], ==, 0xf1258f7940e1dde7ULL);
+    g_assert_cmphex(a[24], ==, 0xeaf1ff7b5ceca249ULL);
+}
+
+static void test_sha3_384(void)
+{
+    size_t i, j, len;
+
+    for (i = 0; i < ARRAY_SIZE(sha3_384_kat); i++) {
+        size_t mlen = strlen(sha3_384_kat[i].msg);
+        uint8_t *msg = g_malloc(mlen * sha3_384_kat[i].repeat + 1);
+        char *hex;
+
+        for (j = 0, len = 0; j < sha3_384_kat[i].repeat; j++, len += mlen) {
+            memcpy(msg + len, sha3_384_kat[i].msg, mlen);
+        }
+        hex = sha3_384_hex(msg, len);
+        g_assert_cmpstr(hex, ==, sha3_384_kat[i].digest);
+        g_free(hex);
+        g_free(msg);
+    }
+}
+
+/* Absorbing blocks in one call or one by one must not matter.  */
+static void test_absorb_split(void)
+{
+    uint64_t a[KECCAK_LANES] = { 0 }, b[KECCAK_LANES] = { 0 };
+    uint8_t data[SHA3_384_RATE * 7];
+    int i;
+
+    for (i = 0; i < sizeof(data); i++) {
+        data[i] = i * 13;
+    }
+    keccak_absorb(a, SHA3_384_RATE, data, 7);
+    for (i = 0; i < 7; i++) {
+        keccak_absorb(b, SHA3_384_RATE, data + i * SHA3_384_RATE, 1);
+    }
+    g_assert(memcmp(a, b, sizeof(a)) == 0);
+}
+
+static void test_all(void)
+{
+    do {
+        test_permute_zero();
+        test_sha3_384();
+        test_absorb_split();
+    } while (test_keccak_next_accel());
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/keccak/all", test_all);
+    return g_test_run();
+}
@@ -32,6 +32,7 @@
  * Edgar E. Iglesias
  */
 #define POLARSSL_GCM_C
+#define POLARSSL_SELF_TEST
 
 #if defined(POLARSSL_GCM_C)
 
@@ -39,6 +40,8 @@
 #include "qemu-common.h"
 #include "qemu/gcm.h"
 #include "qemu/log.h"
+#include "qemu/bswap.h"
+#include "qapi/error.h"
 
 /*
  * 32-bit integer manipulation macros (big endian)
@@ -63,6 +66,13 @@
 }
 #endif
 
+static bool gcm_accel = true;
+
+void gcm_set_accel(bool enable)
+{
+    gcm_accel = enable;
+}
+
 static void gcm_gen_table( gcm_context *ctx )
 {
     int i, j;
@@ -72,6 +82,7 @@ static void gcm_gen_table( gcm_context *ctx )
 
     memset( h, 0, 16 );
     aes_crypt_ecb( &ctx->aes_ctx, AES_ENCRYPT, h, h );
+    memcpy( ctx->H, h, 16 );
 
     ctx->HH[0] = 0;
     ctx->HL[0] = 0;
@@ -116,15 +127,37 @@ int gcm_init( gcm_context *ctx, const unsigned char *key, unsigned int keysize )
     int ret;
 
     memset( ctx, 0, sizeof(gcm_context) );
+    ctx->accel = gcm_accel;
 
     if( ( ret = aes_setkey_enc( &ctx->aes_ctx, key, keysize ) ) != 0 )
         return( ret );
 
     gcm_gen_table( ctx );
 
+#if defined(CONFIG_NETTLE) || defined(CONFIG_GCRYPT)
+    /*
+     * The builtin cipher backend is the same table based AES as ours, only
+     * bother with the crypto layer when it is backed by a real library.
+     */
+    if (ctx->accel) {
+        QCryptoCipherAlgorithm alg = keysize == 128 ? QCRYPTO_CIPHER_ALG_AES_128
+                                   : keysize == 192 ? QCRYPTO_CIPHER_ALG_AES_192
+                                   : QCRYPTO_CIPHER_ALG_AES_256;
+
+        ctx->ctr = qcrypto_cipher_new(alg, QCRYPTO_CIPHER_MODE_CTR,
+                                      key, keysize / 8, NULL);
+    }
+#endif
+
     return( 0 );
 }
 
+void gcm_free(gcm_context *ctx)
+{
+    qcrypto_cipher_free(ctx->ctr);
+    ctx->ctr = NULL;
+}
+
 static const uint64_t last4[16] =
 {
     0x0000, 0x1c20, 0x3840, 0x2460,
@@ -133,7 +166,7 @@ static const uint64_t last4[16] =
     0x9180, 0x8da0, 0xa9c0, 0xb5e0
 };
 
-static void gcm_mult( gcm_context *ctx, const unsigned char x[16], unsigned char output[16] )
+static void gcm_mult_table( gcm_context *ctx, const unsigned char x[16], unsigned char output[16] )
 {
     int i = 0;
     unsigned char z[16];
@@ -180,6 +213,170 @@ static void gcm_mult( gcm_context *ctx, const unsigned char x[16], unsigned char
     PUT_UINT32_BE( zl, output, 12 );
 }
 
+/*
+ * Host acceleration. Bulk AES-CTR goes through the QEMU crypto layer,
+ * which gets AES-NI or the ARMv8 crypto extensions through nettle or
+ * gcrypt. GHASH uses PCLMULQDQ on x86 hosts that have it. Everything
+ * else falls back to the PolarSSL code above.
+ */
+#ifdef CONFIG_AVX2_OPT
+#pragma GCC push_options
+#pragma GCC target("pclmul,ssse3")
+#include <wmmintrin.h>
+#include <tmmintrin.h>
+
+/* GHASH works on bit reflected blocks, byte swap them into lane order.  */
+static inline __m128i gcm_clmul_load(const unsigned char *p)
+{
+    return _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) p),
+                            _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7,
+                                         8, 9, 10, 11, 12, 13, 14, 15));
+}
+
+static inline void gcm_clmul_store(unsigned char *p, __m128i x)
+{
+    _mm_storeu_si128((__m128i *) p,
+                     _mm_shuffle_epi8(x, _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7,
+                                                      8, 9, 10, 11, 12, 13,
+                                                      14, 15)));
+}
+
+/* a * b in GF(2^128), see Intel's "Carry-Less Multiplication and Its
+ * Usage for Computing the GCM Mode" white paper.  */
+static __m128i gcm_clmul_gfmul(__m128i a, __m128i b)
+{
+    __m128i lo, mid, hi, t, c;
+
+    lo = _mm_clmulepi64_si128(a, b, 0x00);
+    mid = _mm_xor_si128(_mm_clmulepi64_si128(a, b, 0x10),
+                        _mm_clmulepi64_si128(a, b, 0x01));
+    hi = _mm_clmulepi64_si128(a, b, 0x11);
+    lo = _mm_xor_si128(lo, _mm_slli_si128(mid, 8));
+    hi = _mm_xor_si128(hi, _mm_srli_si128(mid, 8));
+
+    /* The operands are bit reflected, shift the product left by one.  */
+    t = _mm_srli_epi32(lo, 31);
+    c = _mm_srli_epi32(hi, 31);
+    lo = _mm_slli_epi32(lo, 1);
+    hi = _mm_slli_epi32(hi, 1);
+    hi = _mm_or_si128(hi, _mm_srli_si128(t, 12));
+    hi = _mm_or_si128(hi, _mm_slli_si128(c, 4));
+    lo = _mm_or_si128(lo, _mm_slli_si128(t, 4));
+
+    /* Reduce modulo x^128 + x^7 + x^2 + x + 1.  */
+    t = _mm_xor_si128(_mm_slli_epi32(lo, 31),
+                      _mm_xor_si128(_mm_slli_epi32(lo, 30),
+                                    _mm_slli_epi32(lo, 25)));
+    c = _mm_srli_si128(t, 4);
+    lo = _mm_xor_si128(lo, _mm_slli_si128(t, 12));
+    t = _mm_xor_si128(_mm_srli_epi32(lo, 1),
+                      _mm_xor_si128(_mm_srli_epi32(lo, 2),
+                                    _mm_srli_epi32(lo, 7)));
+    lo = _mm_xor_si128(lo, _mm_xor_si128(t, c));
+    return _mm_xor_si128(hi, lo);
+}
+
+static void gcm_mult_clmul(gcm_context *ctx, const unsigned char x[16],
+                           unsigned char output[16])
+{
+    gcm_clmul_store(output, gcm_clmul_gfmul(gcm_clmul_load(x),
+                                            gcm_clmul_load(ctx->H)));
+}
+
+static void gcm_ghash_clmul(gcm_context *ctx, const unsigned char *data,
+                            size_t nblocks)
+{
+    __m128i h = gcm_clmul_load(ctx->H);
+    __m128i x = gcm_clmul_load(ctx->mul);
+
+    while (nblocks--) {
+        x = gcm_clmul_gfmul(_mm_xor_si128(x, gcm_clmul_load(data)), h);
+        data += 16;
+    }
+    gcm_clmul_store(ctx->mul, x);
+}
+#pragma GCC pop_options
+
+#include "qemu/cpuid.h"
+
+static bool gcm_have_clmul;
+
+static void __attribute__((constructor)) gcm_init_cpuid(void)
+{
+    int a, b, c, d;
+
+    if (__get_cpuid_max(0, NULL) >= 1) {
+        __cpuid(1, a, b, c, d);
+        gcm_have_clmul = (c & bit_PCLMUL) && (c & bit_SSSE3);
+    }
+}
+#endif
+
+static void gcm_mult( gcm_context *ctx, const unsigned char x[16], unsigned char output[16] )
+{
+#ifdef CONFIG_AVX2_OPT
+    if (gcm_have_clmul && ctx->accel) {
+        gcm_mult_clmul(ctx, x, output);
+        return;
+    }
+#endif
+    gcm_mult_table(ctx, x, output);
+}
+
+/* Hash nblocks whole blocks into ctx->mul.  */
+static void gcm_ghash(gcm_context *ctx, const unsigned char *data,
+                      size_t nblocks)
+{
+    size_t i;
+
+#ifdef CONFIG_AVX2_OPT
+    if (gcm_have_clmul && ctx->accel) {
+        gcm_ghash_clmul(ctx, data, nblocks);
+        return;
+    }
+#endif
+
+    while (nblocks--) {
+        for (i = 0; i < 16; i++) {
+            ctx->mul[i] ^= data[i];
+        }
+        gcm_mult_table(ctx, ctx->mul, ctx->mul);
+        data += 16;
+    }
+}
+
+/*
+ * En/decrypt as many whole blocks as possible with the host AES-CTR. Must
+ * be called on a block boundary. Returns the number of bytes consumed.
+ */
+static size_t gcm_push_blocks(gcm_context *ctx, int mode,
+                              unsigned char *output,
+                              const unsigned char *input, size_t length)
+{
+    unsigned char ctr[16];
+    uint64_t nblocks = length / 16;
+    uint32_t c32;
+
+    memcpy(ctr, ctx->iv, 16);
+    c32 = ldl_be_p(ctr + 12) + 1;
+    stl_be_p(ctr + 12, c32);
+    /* The crypto layer carries into all 128 bits, GCM only counts in 32.  */
+    nblocks = MIN(nblocks, 0x100000000ULL - c32);
+
+    qcrypto_cipher_setiv(ctx->ctr, ctr, 16, &error_abort);
+    if (mode == GCM_DECRYPT) {
+        gcm_ghash(ctx, input, nblocks);
+    }
+    qcrypto_cipher_encrypt(ctx->ctr, input, output, nblocks * 16,
+                           &error_abort);
+    if (mode == GCM_ENCRYPT) {
+        gcm_ghash(ctx, output, nblocks);
+    }
+
+    stl_be_p(ctx->iv + 12, c32 + nblocks - 1);
+    return nblocks * 16;
+}
+
 void gcm_push_iv(gcm_context *ctx,
                  const unsigned char *iv,
                  size_t iv_len, size_t tag_len)
@@ -236,6 +433,15 @@ void gcm_push_data(gcm_context *ctx,
     p = input;
     while( length > 0 )
     {
+        if (ctx->ctr && !ctx->ectr_len && !ctx->mul_idx && length >= 16) {
+            use_len = gcm_push_blocks(ctx, mode, out_p, p, length);
+            length -= use_len;
+            p += use_len;
+            out_p += use_len;
+            ctx->data_len += use_len;
+            continue;
+        }
+
         use_len = ( length < 16 ) ? length : 16;
         if (ctx->ectr_len && use_len > ctx->ectr_len) {
             use_len = ctx->ectr_len;
@@ -464,10 +670,10 @@ int gcm_auth_decrypt( gcm_context *ctx,
  */
 #define MAX_TESTS   6
 
-int key_index[MAX_TESTS] =
+static const int key_index[MAX_TESTS] =
     { 0, 0, 1, 1, 1, 1 };
 
-unsigned char key[MAX_TESTS][32] =
+static const unsigned char key[MAX_TESTS][32] =
 {
     { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
       0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
@@ -479,13 +685,13 @@ unsigned char key[MAX_TESTS][32] =
       0x6d, 0x6a, 0x8f, 0x94, 0x67, 0x30, 0x83, 0x08 },
 };
 
-size_t iv_len[MAX_TESTS] =
+static const size_t iv_len[MAX_TESTS] =
     { 12, 12, 12, 12, 8, 60 };
 
-int iv_index[MAX_TESTS] =
+static const int iv_index[MAX_TESTS] =
     { 0, 0, 1, 1, 1, 2 };
 
-unsigned char iv[MAX_TESTS][64] =
+static const unsigned char iv[MAX_TESTS][64] =
 {
     { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
       0x00, 0x00, 0x00, 0x00 },
@@ -501,13 +707,13 @@ unsigned char iv[MAX_TESTS][64] =
       0xa6, 0x37, 0xb3, 0x9b },
 };
 
-size_t add_len[MAX_TESTS] =
+static const size_t add_len[MAX_TESTS] =
     { 0, 0, 0, 20, 20, 20 };
 
-int add_index[MAX_TESTS] =
+static const int add_index[MAX_TESTS] =
     { 0, 0, 0, 1, 1, 1 };
 
-unsigned char additional[MAX_TESTS][64] =
+static const unsigned char additional[MAX_TESTS][64] =
 {
     { 0x00 },
     { 0xfe, 0xed, 0xfa, 0xce, 0xde, 0xad, 0xbe, 0xef,
@@ -515,13 +721,13 @@ unsigned char additional[MAX_TESTS][64] =
       0xab, 0xad, 0xda, 0xd2 },
 };
 
-size_t pt_len[MAX_TESTS] =
+static const size_t pt_len[MAX_TESTS] =
     { 0, 16, 64, 60, 60, 60 };
 
-int pt_index[MAX_TESTS] =
+static const int pt_index[MAX_TESTS] =
     { 0, 0, 1, 1, 1, 1 };
 
-unsigned char pt[MAX_TESTS][64] =
+static const unsigned char pt[MAX_TESTS][64] =
 {
     { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
       0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },
@@ -535,7 +741,7 @@ unsigned char pt[MAX_TESTS][64] =
       0xba, 0x63, 0x7b, 0x39, 0x1a, 0xaf, 0xd2, 0x55 },
 };
 
-unsigned char ct[MAX_TESTS * 3][64] =
+static const unsigned char ct[MAX_TESTS * 3][64] =
 {
     { 0x00 },
     { 0x03, 0x88, 0xda, 0xce, 0x60, 0xb6, 0xa3, 0x92,
@@ -644,7 +850,7 @@ unsigned char ct[MAX_TESTS * 3][64] =
       0x44, 0xae, 0x7e, 0x3f },
 };
 
-unsigned char tag[MAX_TESTS * 3][16] =
+static const unsigned char tag[MAX_TESTS * 3][16] =
 {
     { 0x58, 0xe2, 0xfc, 0xce, 0xfa, 0x7e, 0x30, 0x61,
       0x36, 0x7f, 0x1d, 0x57, 0xa4, 0xe7, 0x45, 0x5a },
@@ -697,7 +903,8 @@ int gcm_self_test( int verbose )
 
         for( i = 0; i < MAX_TESTS; i++ )
         {
-            printf( "  AES-GCM-%3d #%d (%s): ", key_len, i, "enc" );
+            if( verbose != 0 )
+                printf( "  AES-GCM-%3d #%d (%s): ", key_len, i, "enc" );
             gcm_init( &ctx, key[key_index[i]], key_len );
 
             ret = gcm_crypt_and_tag( &ctx, GCM_ENCRYPT,
@@ -706,6 +913,8 @@ int gcm_self_test( int verbose )
                                      additional[add_index[i]], add_len[i],
                                      pt[pt_index[i]], buf, 16, tag_buf );
 
+            gcm_free( &ctx );
+
             if( ret != 0 ||
                 memcmp( buf, ct[j * 6 + i], pt_len[i] ) != 0 ||
                 memcmp( tag_buf, tag[j * 6 + i], 16 ) != 0 )
@@ -719,7 +928,8 @@ int gcm_self_test( int verbose )
             if( verbose != 0 )
                 printf( "passed\n" );
 
-            printf( "  AES-GCM-%3d #%d (%s): ", key_len, i, "dec" );
+            if( verbose != 0 )
+                printf( "  AES-GCM-%3d #%d (%s): ", key_len, i, "dec" );
             gcm_init( &ctx, key[key_index[i]], key_len );
 
             ret = gcm_crypt_and_tag( &ctx, GCM_DECRYPT,
@@ -728,6 +938,8 @@ int gcm_self_test( int verbose )
                                      additional[add_index[i]], add_len[i],
                                      ct[j * 6 + i], buf, 16, tag_buf );
 
+            gcm_free( &ctx );
+
             if( ret != 0 ||
                 memcmp( buf, pt[pt_index[i]], pt_len[i] ) != 0 ||
                 memcmp( tag_buf, tag[j * 6 + i], 16 ) != 0 )
@@ -738,12 +950,41 @@ int gcm_self_test( int verbose )
                 return( 1 );
             }
 
+            if( verbose != 0 )
+                printf( "passed\n" );
+
+            /* The streaming interface only takes 96 bit IVs.  */
+            if( iv_len[i] != 12 )
+                continue;
+
+            if( verbose != 0 )
+                printf( "  AES-GCM-%3d #%d (%s): ", key_len, i, "stream" );
+            gcm_init( &ctx, key[key_index[i]], key_len );
+
+            gcm_push_iv( &ctx, iv[iv_index[i]], iv_len[i], 16 );
+            gcm_push_aad( &ctx, additional[add_index[i]], add_len[i] );
+            gcm_push_data( &ctx, GCM_ENCRYPT, buf, pt[pt_index[i]],
+                           pt_len[i] );
+            gcm_emit_tag( &ctx, tag_buf, 16 );
+
+            gcm_free( &ctx );
+
+            if( memcmp( buf, ct[j * 6 + i], pt_len[i] ) != 0 ||
+                memcmp( tag_buf, tag[j * 6 + i], 16 ) != 0 )
+            {
+                if( verbose != 0 )
+                    printf( "failed\n" );
+
+                return( 1 );
+            }
+
             if( verbose != 0 )
                 printf( "passed\n" );
         }
     }
 
-    printf( "\n" );
+    if( verbose != 0 )
+        printf( "\n" );
 
     return( 0 );
 }
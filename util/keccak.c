@@ -0,0 +1,363 @@
+/*
+ * Keccak-f[1600] permutation and sponge absorb.
+ *
+ * Copyright (c) 2013, 2020 Xilinx Inc.
+ *
+ * The portable permutation is borrowed LGPL code from nettle, moved here
+ * from the ZynqMP CSU SHA-3 model.
+ * This code is licensed under the GNU LGPL.
+ */
+#include "qemu/osdep.h"
+#include "qemu/bitops.h"
+#include "qemu/bswap.h"
+#include "qemu/keccak.h"
+
+static const uint64_t keccak_rc[24] = {
+    0x0000000000000001ULL, 0x0000000000008082ULL,
+    0x800000000000808aULL, 0x8000000080008000ULL,
+    0x000000000000808bULL, 0x0000000080000001ULL,
+    0x8000000080008081ULL, 0x8000000000008009ULL,
+    0x000000000000008aULL, 0x0000000000000088ULL,
+    0x0000000080008009ULL, 0x000000008000000aULL,
+    0x000000008000808bULL, 0x800000000000008bULL,
+    0x8000000000008089ULL, 0x8000000000008003ULL,
+    0x8000000000008002ULL, 0x8000000000000080ULL,
+    0x000000000000800aULL, 0x800000008000000aULL,
+    0x8000000080008081ULL, 0x8000000000008080ULL,
+    0x0000000080000001ULL, 0x8000000080008008ULL,
+};
+
+/*
+ * Portable version. Works in place on the state array, which is what
+ * suits hosts without an and-not instruction best as they run out of
+ * registers with the unrolled version below.
+ */
+#define ROTL64(n, x) rol64(x, n)
+
+static void keccak_permute_int(uint64_t *state_a)
+{
+  /* Original permutation:
+
+       0,10,20, 5,15,
+      16, 1,11,21, 6,
+       7,17, 2,12,22,
+      23, 8,18, 3,13,
+      14,24, 9,19, 4
+
+     Rotation counts:
+
+       0,  1, 62, 28, 27,
+      36, 44,  6, 55, 20,
+       3, 10, 43, 25, 39,
+      41, 45, 15, 21,  8,
+      18,  2, 61, 56, 14,
+  */
+
+  /* In-place implementation. Permutation done as a long sequence of
+     25 moves "following" the permutation.
+
+      T <--  1
+      1 <--  6
+      6 <--  9
+      9 <-- 22
+     22 <-- 14
+     14 <-- 20
+     20 <--  2
+      2 <-- 12
+     12 <-- 13
+     13 <-- 19
+     19 <-- 23
+     23 <-- 15
+     15 <--  4
+      4 <-- 24
+     24 <-- 21
+     21 <--  8
+      8 <-- 16
+     16 <--  5
+      5 <--  3
+      3 <-- 18
+     18 <-- 17
+     17 <-- 11
+     11 <--  7
+      7 <-- 10
+     10 <--  T
+
+  */
+    uint64_t C[5], D[5], T, X;
+    unsigned i, y;
+
+#define A state_a
+
+    C[0] = A[0] ^ A[5+0] ^ A[10+0] ^ A[15+0] ^ A[20+0];
+    C[1] = A[1] ^ A[5+1] ^ A[10+1] ^ A[15+1] ^ A[20+1];
+    C[2] = A[2] ^ A[5+2] ^ A[10+2] ^ A[15+2] ^ A[20+2];
+    C[3] = A[3] ^ A[5+3] ^ A[10+3] ^ A[15+3] ^ A[20+3];
+    C[4] = A[4] ^ A[5+4] ^ A[10+4] ^ A[15+4] ^ A[20+4];
+
+    for (i = 0; i < 24; i++) {
+        D[0] = C[4] ^ ROTL64(1, C[1]);
+        D[1] = C[0] ^ ROTL64(1, C[2]);
+        D[2] = C[1] ^ ROTL64(1, C[3]);
+        D[3] = C[2] ^ ROTL64(1, C[4]);
+        D[4] = C[3] ^ ROTL64(1, C[0]);
+
+        A[0] ^= D[0];
+        X = A[ 1] ^ D[1];     T = ROTL64(1, X);
+        X = A[ 6] ^ D[1]; A[ 1] = ROTL64(44, X);
+        X = A[ 9] ^ D[4]; A[ 6] = ROTL64(20, X);
+        X = A[22] ^ D[2]; A[ 9] = ROTL64(61, X);
+        X = A[14] ^ D[4]; A[22] = ROTL64(39, X);
+        X = A[20] ^ D[0]; A[14] = ROTL64(18, X);
+        X = A[ 2] ^ D[2]; A[20] = ROTL64(62, X);
+        X = A[12] ^ D[2]; A[ 2] = ROTL64(43, X);
+        X = A[13] ^ D[3]; A[12] = ROTL64(25, X);
+        X = A[19] ^ D[4]; A[13] = ROTL64( 8, X);
+        X = A[23] ^ D[3]; A[19] = ROTL64(56, X);
+        X = A[15] ^ D[0]; A[23] = ROTL64(41, X);
+        X = A[ 4] ^ D[4]; A[15] = ROTL64(27, X);
+        X = A[24] ^ D[4]; A[ 4] = ROTL64(14, X);
+        X = A[21] ^ D[1]; A[24] = ROTL64( 2, X);
+        X = A[ 8] ^ D[3]; A[21] = ROTL64(55, X); /* row 4 done */
+        X = A[16] ^ D[1]; A[ 8] = ROTL64(45, X);
+        X = A[ 5] ^ D[0]; A[16] = ROTL64(36, X);
+        X = A[ 3] ^ D[3]; A[ 5] = ROTL64(28, X);
+        X = A[18] ^ D[3]; A[ 3] = ROTL64(21, X); /* row 0 done */
+        X = A[17] ^ D[2]; A[18] = ROTL64(15, X);
+        X = A[11] ^ D[1]; A[17] = ROTL64(10, X); /* row 3 done */
+        X = A[ 7] ^ D[2]; A[11] = ROTL64( 6, X); /* row 1 done */
+        X = A[10] ^ D[0]; A[ 7] = ROTL64( 3, X);
+        A[10] = T;                                /* row 2 done */
+
+        D[0] = ~A[1] & A[2];
+        D[1] = ~A[2] & A[3];
+        D[2] = ~A[3] & A[4];
+        D[3] = ~A[4] & A[0];
+        D[4] = ~A[0] & A[1];
+
+        A[0] ^= D[0] ^ keccak_rc[i]; C[0] = A[0];
+        A[1] ^= D[1]; C[1] = A[1];
+        A[2] ^= D[2]; C[2] = A[2];
+        A[3] ^= D[3]; C[3] = A[3];
+        A[4] ^= D[4]; C[4] = A[4];
+
+        for (y = 5; y < 25; y += 5) {
+            D[0] = ~A[y+1] & A[y+2];
+            D[1] = ~A[y+2] & A[y+3];
+            D[2] = ~A[y+3] & A[y+4];
+            D[3] = ~A[y+4] & A[y+0];
+            D[4] = ~A[y+0] & A[y+1];
+
+            A[y+0] ^= D[0]; C[0] ^= A[y+0];
+            A[y+1] ^= D[1]; C[1] ^= A[y+1];
+            A[y+2] ^= D[2]; C[2] ^= A[y+2];
+            A[y+3] ^= D[3]; C[3] ^= A[y+3];
+            A[y+4] ^= D[4]; C[4] ^= A[y+4];
+        }
+    }
+#undef A
+}
+
+#undef ROTL64
+
+/*
+ * Fully unrolled, with the state kept in 25 local lanes that ping-pong
+ * between two sets of variables every round, so the compiler can keep
+ * most of it in registers instead of going through the array in memory.
+ * Lanes are named after the rows (b, g, k, m, s = y 0..4) and columns
+ * (a, e, i, o, u = x 0..4) of the state.
+ */
+#define KECCAK_CHI(E, r, B)                                     \
+    E##r##a = B##a ^ (~B##e & B##i);                            \
+    E##r##e = B##e ^ (~B##i & B##o);                            \
+    E##r##i = B##i ^ (~B##o & B##u);                            \
+    E##r##o = B##o ^ (~B##u & B##a);                            \
+    E##r##u = B##u ^ (~B##a & B##e)
+
+/* One round, reading the A lanes and writing the E lanes.  */
+#define KECCAK_ROUND(A, E, i)                                   \
+    do {                                                        \
+        uint64_t Ca, Ce, Ci, Co, Cu, Da, De, Di, Do, Du;        \
+        uint64_t Ba, Be, Bi, Bo, Bu;                            \
+                                                                \
+        Ca = A##ba ^ A##ga ^ A##ka ^ A##ma ^ A##sa;             \
+        Ce = A##be ^ A##ge ^ A##ke ^ A##me ^ A##se;             \
+        Ci = A##bi ^ A##gi ^ A##ki ^ A##mi ^ A##si;             \
+        Co = A##bo ^ A##go ^ A##ko ^ A##mo ^ A##so;             \
+        Cu = A##bu ^ A##gu ^ A##ku ^ A##mu ^ A##su;             \
+        Da = Cu ^ rol64(Ce, 1);                                 \
+        De = Ca ^ rol64(Ci, 1);                                 \
+        Di = Ce ^ rol64(Co, 1);                                 \
+        Do = Ci ^ rol64(Cu, 1);                                 \
+        Du = Co ^ rol64(Ca, 1);                                 \
+                                                                \
+        Ba = A##ba ^ Da;                                        \
+        Be = rol64(A##ge ^ De, 44);                             \
+        Bi = rol64(A##ki ^ Di, 43);                             \
+        Bo = rol64(A##mo ^ Do, 21);                             \
+        Bu = rol64(A##su ^ Du, 14);                             \
+        KECCAK_CHI(E, b, B);                                    \
+        E##ba ^= keccak_rc[i];                                  \
+                                                                \
+        Ba = rol64(A##bo ^ Do, 28);                             \
+        Be = rol64(A##gu ^ Du, 20);                             \
+        Bi = rol64(A##ka ^ Da, 3);                              \
+        Bo = rol64(A##me ^ De, 45);                             \
+        Bu = rol64(A##si ^ Di, 61);                             \
+        KECCAK_CHI(E, g, B);                                    \
+                                                                \
+        Ba = rol64(A##be ^ De, 1);                              \
+        Be = rol64(A##gi ^ Di, 6);                              \
+        Bi = rol64(A##ko ^ Do, 25);                             \
+        Bo = rol64(A##mu ^ Du, 8);                              \
+        Bu = rol64(A##sa ^ Da, 18);                             \
+        KECCAK_CHI(E, k, B);                                    \
+                                                                \
+        Ba = rol64(A##bu ^ Du, 27);                             \
+        Be = rol64(A##ga ^ Da, 36);                             \
+        Bi = rol64(A##ke ^ De, 10);                             \
+        Bo = rol64(A##mi ^ Di, 15);                             \
+        Bu = rol64(A##so ^ Do, 56);                             \
+        KECCAK_CHI(E, m, B);                                    \
+                                                                \
+        Ba = rol64(A##bi ^ Di, 62);                             \
+        Be = rol64(A##go ^ Do, 55);                             \
+        Bi = rol64(A##ku ^ Du, 39);                             \
+        Bo = rol64(A##ma ^ Da, 41);                             \
+        Bu = rol64(A##se ^ De, 2);                              \
+        KECCAK_CHI(E, s, B);                                    \
+    } while (0)
+
+#define KECCAK_LANE_VARS(A)                                     \
+    uint64_t A##ba, A##be, A##bi, A##bo, A##bu,                 \
+             A##ga, A##ge, A##gi, A##go, A##gu,                 \
+             A##ka, A##ke, A##ki, A##ko, A##ku,                 \
+             A##ma, A##me, A##mi, A##mo, A##mu,                 \
+             A##sa, A##se, A##si, A##so, A##su
+
+#define KECCAK_LANES_IO(OP, A, s)                               \
+    OP(A##ba, s[0]);  OP(A##be, s[1]);  OP(A##bi, s[2]);        \
+    OP(A##bo, s[3]);  OP(A##bu, s[4]);  OP(A##ga, s[5]);        \
+    OP(A##ge, s[6]);  OP(A##gi, s[7]);  OP(A##go, s[8]);        \
+    OP(A##gu, s[9]);  OP(A##ka, s[10]); OP(A##ke, s[11]);       \
+    OP(A##ki, s[12]); OP(A##ko, s[13]); OP(A##ku, s[14]);       \
+    OP(A##ma, s[15]); OP(A##me, s[16]); OP(A##mi, s[17]);       \
+    OP(A##mo, s[18]); OP(A##mu, s[19]); OP(A##sa, s[20]);       \
+    OP(A##se, s[21]); OP(A##si, s[22]); OP(A##so, s[23]);       \
+    OP(A##su, s[24])
+
+#define KECCAK_LOAD(lane, v)    (lane) = (v)
+#define KECCAK_STORE(lane, v)   (v) = (lane)
+
+static inline void keccak_xor_block(uint64_t *a, size_t rate,
+                                    const uint8_t *data)
+{
+    size_t i;
+
+    for (i = 0; i < rate / 8; i++) {
+        a[i] ^= ldq_le_p(data + i * 8);
+    }
+}
+
+static void keccak_absorb_int(uint64_t *a, size_t rate, const uint8_t *data,
+                              size_t nblocks)
+{
+    do {
+        if (data) {
+            keccak_xor_block(a, rate, data);
+            data += rate;
+        }
+        keccak_permute_int(a);
+    } while (data && --nblocks);
+}
+
+#ifdef CONFIG_AVX2_OPT
+/*
+ * With BMI1 chi becomes one andn per lane and BMI2's rorx rotates
+ * without touching the flags or needing a copy, which leaves enough
+ * registers for the unrolled version.
+ */
+static void __attribute__((target("bmi,bmi2")))
+keccak_absorb_bmi2(uint64_t *a, size_t rate, const uint8_t *data,
+                   size_t nblocks)
+{
+    KECCAK_LANE_VARS(A);
+    KECCAK_LANE_VARS(E);
+    int r;
+
+    do {
+        if (data) {
+            keccak_xor_block(a, rate, data);
+            data += rate;
+        }
+
+        KECCAK_LANES_IO(KECCAK_LOAD, A, a);
+        for (r = 0; r < 24; r += 2) {
+            KECCAK_ROUND(A, E, r);
+            KECCAK_ROUND(E, A, r + 1);
+        }
+        KECCAK_LANES_IO(KECCAK_STORE, A, a);
+    } while (data && --nblocks);
+}
+
+#define CACHE_BMI2  1
+
+static unsigned cpuid_cache;
+#endif
+
+static void (*keccak_accel)(uint64_t *, size_t, const uint8_t *, size_t) =
+    keccak_absorb_int;
+
+#ifdef CONFIG_AVX2_OPT
+#include "qemu/cpuid.h"
+
+static void init_accel(unsigned cache)
+{
+    keccak_accel = cache & CACHE_BMI2 ? keccak_absorb_bmi2
+                                      : keccak_absorb_int;
+}
+
+static void __attribute__((constructor)) init_cpuid_cache(void)
+{
+    int max = __get_cpuid_max(0, NULL);
+    int a, b, c, d;
+    unsigned cache = 0;
+
+    if (max >= 7) {
+        __cpuid_count(7, 0, a, b, c, d);
+        if ((b & bit_BMI) && (b & bit_BMI2)) {
+            cache |= CACHE_BMI2;
+        }
+    }
+    cpuid_cache = cache;
+    init_accel(cache);
+}
+
+bool test_keccak_next_accel(void)
+{
+    if (cpuid_cache == 0) {
+        return false;
+    }
+    cpuid_cache &= cpuid_cache - 1;
+    init_accel(cpuid_cache);
+    return true;
+}
+#else
+bool test_keccak_next_accel(void)
+{
+    return false;
+}
+#endif
+
+void keccak_f1600(uint64_t a[KECCAK_LANES])
+{
+    keccak_accel(a, 0, NULL, 1);
+}
+
+void keccak_absorb(uint64_t a[KECCAK_LANES], size_t rate,
+                   const uint8_t *data, size_t nblocks)
+{
+    assert(rate % 8 == 0 && rate <= KECCAK_LANES * 8);
+    if (nblocks) {
+        keccak_accel(a, rate, data, nblocks);
+    }
+}